@@ -0,0 +1,740 @@
+// chat_bench.cpp
+// load generator + latency benchmark for the chat server.
+//
+// opens a pile of headless clients against the server on localhost, has a
+// few of them talk at a fixed rate with a mix of message sizes, and every
+// client measures how long each broadcast took to reach it (the send time
+// is baked into the message text). at the end it prints fan-out throughput,
+// p50/p99/p999 delivery latency and how much server cpu each message cost.
+//
+// by default the server runs inside this process (so we can read its
+// threads' cpu clocks); --external talks to one that is already running.
+// the in-process server's heap allocations are counted too (operator new
+// is replaced below): in steady state the read -> route -> queue path
+// should make none, so anything above ~0 per message is a regression.
+//
+// --deflate has every client ask for compressed frames (chat_compress.h)
+// and the senders pack what they send. run it with and without to compare
+// bytes per frame and what it costs the server and the clients in cpu.
+// message padding is random common words, so it squeezes about like chat.
+//
+// usage: chat_bench [--clients=N] [--senders=N] [--rate=MSGS_PER_SEC]
+//                   [--sizes=64,256,1024] [--duration=SEC] [--warmup=SEC]
+//                   [--threads=N] [--workers=N] [--port=N]
+//                   [--external[=HOST]] [--server-pid=PID] [--deflate]
+//                   [any chat_server option, e.g. --flush-us=N]
+
+#include "chat_compress.h"
+#include "chat_net.h"
+#include "chat_poller.h"
+#include "chat_protocol.h"
+#include "chat_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+// allocation counting --------------------------------------------------------
+
+// the bench's own threads (main and the client threads) mark themselves,
+// whatever is left is the server's workers asking for memory
+static std::atomic<uint64_t> g_serverAllocs{0};
+static thread_local bool     t_benchThread = false;
+
+void* operator new(size_t size) {
+    if (!t_benchThread) {
+        g_serverAllocs.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// marks our messages so we only time what we sent: "#B <send ns> xxxx..."
+const char kMarker[] = "#B ";
+
+// message padding, so a deflated run sees text and not "xxxx..."
+const char* const kWords[] = {
+    "the", "and", "you", "that", "was", "for", "are", "with", "his", "they",
+    "this", "have", "from", "one", "had", "word", "but", "not", "what", "all",
+    "were", "when", "your", "can", "said", "there", "use", "each", "which", "she",
+    "how", "their", "will", "other", "about", "out", "many", "then", "them", "these",
+    "some", "her", "would", "make", "like", "him", "into", "time", "has", "look",
+    "two", "more", "write", "see", "number", "way", "could", "people", "than", "first",
+    "water", "been", "call", "who", "lol", "ok", "yeah", "thanks", "tonight", "pizza",
+};
+
+uint64_t NowNanos() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count());
+}
+
+// cpu time of the calling thread (0 where we cant tell)
+uint64_t ThreadCpuNanos() {
+#ifndef _WIN32
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+    }
+#endif
+    return 0;
+}
+
+struct BenchConfig {
+    std::string      host     = "127.0.0.1";
+    int              port     = 9888;
+    int              clients  = 1000;
+    int              senders  = 10;
+    double           rate     = 1000;   // messages per second, all senders together
+    std::vector<int> sizes    = {64, 256, 1024};
+    double           duration = 10;
+    double           warmup   = 1;
+    int              threads  = 2;
+    int              workers  = 0;
+    bool             external = false;
+    int              serverPid = 0;
+    bool             deflate  = false;   // clients ask for compressed frames
+    ChatServerConfig server;   // the in-process one, any server option goes here
+};
+
+// log-linear latency histogram (microseconds). 16 sub-buckets per power of
+// two keeps the error under ~6% all the way to minutes, in a few KB
+class LatencyHistogram {
+public:
+    LatencyHistogram() : m_counts(kBuckets, 0), m_total(0), m_max(0) {}
+
+    void Record(uint64_t us) {
+        m_counts[BucketOf(us)]++;
+        m_total++;
+        m_max = std::max(m_max, us);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < m_counts.size(); i++) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+        m_max    = std::max(m_max, other.m_max);
+    }
+
+    uint64_t Count() const { return m_total; }
+    uint64_t Max() const { return m_max; }
+
+    uint64_t Percentile(double p) const {
+        if (m_total == 0) {
+            return 0;
+        }
+        uint64_t want = static_cast<uint64_t>(p / 100.0 * m_total);
+        if (want >= m_total) {
+            want = m_total - 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); i++) {
+            seen += m_counts[i];
+            if (seen > want) {
+                return std::min(UpperBound(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static const int    kSubBits = 4;
+    static const size_t kBuckets = 64 << kSubBits;
+
+    static size_t BucketOf(uint64_t v) {
+        if (v < (1u << kSubBits)) {
+            return static_cast<size_t>(v);
+        }
+        int top = 0;
+        while (v >> (top + 1)) {
+            top++;
+        }
+        int shift = top - kSubBits;
+        return static_cast<size_t>(((shift + 1) << kSubBits) +
+                                   ((v >> shift) & ((1u << kSubBits) - 1)));
+    }
+
+    static uint64_t UpperBound(size_t bucket) {
+        if (bucket < (1u << kSubBits)) {
+            return bucket;
+        }
+        uint64_t shift = (bucket >> kSubBits) - 1;
+        uint64_t sub   = bucket & ((1u << kSubBits) - 1);
+        return (((1ULL << kSubBits) | sub) << shift) + (1ULL << shift) - 1;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t              m_total;
+    uint64_t              m_max;
+};
+
+// one simulated client
+struct BenchConn {
+    socket_t     sock = CHAT_INVALID_SOCKET;
+    FrameDecoder decoder;
+    std::string  pending;     // bytes send() didnt take yet
+    bool         welcomed = false;
+    bool         deflate  = false;   // the server said yes
+};
+
+// a slice of the clients, driven by one thread
+class BenchThread {
+public:
+    BenchThread(const BenchConfig& config, int senders, double rate, unsigned seed)
+        : m_config(config), m_senders(senders), m_rate(rate), m_rng(seed),
+          m_sent(0), m_sendStalls(0), m_delivered(0), m_bytesIn(0), m_welcomed(0),
+          m_cpuStart(0), m_cpuNs(0) {}
+
+    bool Connect(int count, const sockaddr_in& addr) {
+        for (int i = 0; i < count; i++) {
+            std::unique_ptr<BenchConn> conn(new BenchConn);
+            conn->sock = socket(AF_INET, SOCK_STREAM, 0);
+            if (conn->sock == CHAT_INVALID_SOCKET ||
+                connect(conn->sock, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+                std::fprintf(stderr, "connect %d failed (ulimit -n?)\n", i);
+                CloseSocket(conn->sock);
+                return false;
+            }
+            SetNonBlocking(conn->sock);
+            m_poller.Add(conn->sock, m_conns.size(), false);
+            m_conns.push_back(std::move(conn));
+        }
+        return true;
+    }
+
+    void Start(Clock::time_point measureFrom, Clock::time_point stopAt) {
+        m_measureFrom = measureFrom;
+        m_stopAt      = stopAt;
+        m_thread      = std::thread(&BenchThread::Run, this);
+    }
+
+    void Join() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    void Close() {
+        for (auto& conn : m_conns) {
+            m_poller.Remove(conn->sock);
+            CloseSocket(conn->sock);
+        }
+        m_conns.clear();
+    }
+
+    // runs the loop until everyone got their welcome (or timeout)
+    bool WaitWelcomed(double seconds) {
+        Clock::time_point until = Clock::now() +
+            std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6));
+        PollEvent events[256];
+        while (m_welcomed < m_conns.size() && Clock::now() < until) {
+            int n = m_poller.Wait(events, 256, 50);
+            for (int i = 0; i < n; i++) {
+                HandleEvent(events[i], false);
+            }
+        }
+        return m_welcomed == m_conns.size();
+    }
+
+    const LatencyHistogram& Latency() const { return m_latency; }
+    uint64_t Sent() const { return m_sent; }
+    uint64_t SendStalls() const { return m_sendStalls; }
+    uint64_t Delivered() const { return m_delivered; }
+    uint64_t BytesIn() const { return m_bytesIn; }
+    // this thread's cpu over the measured window: sending, reading, unpacking
+    uint64_t CpuNanos() const { return m_cpuNs; }
+
+private:
+    void Run() {
+        t_benchThread = true;
+        // senders are the first m_senders conns of this slice, round robin
+        std::uniform_int_distribution<size_t> pickSize(0, m_config.sizes.size() - 1);
+        double   interval = m_rate > 0 ? 1.0 / m_rate : 0;
+        size_t   next     = 0;
+        Clock::time_point due = Clock::now();
+
+        PollEvent events[256];
+        for (;;) {
+            Clock::time_point now = Clock::now();
+            if (now >= m_stopAt) {
+                break;
+            }
+
+            // catch up on every send that is due (bounded so a stalled
+            // server doesnt make us burst forever)
+            int burst = 0;
+            while (m_senders > 0 && interval > 0 && due <= now && burst < 1000) {
+                BenchConn& conn = *m_conns[next];
+                next = (next + 1) % static_cast<size_t>(m_senders);
+                SendOne(conn, static_cast<size_t>(m_config.sizes[pickSize(m_rng)]));
+                due += std::chrono::nanoseconds(static_cast<int64_t>(interval * 1e9));
+                burst++;
+            }
+
+            int timeoutMs = 1;
+            if (m_senders == 0 || interval == 0) {
+                timeoutMs = 10;
+            }
+            int n = m_poller.Wait(events, 256, timeoutMs);
+            bool measuring = Clock::now() >= m_measureFrom;
+            if (measuring && m_cpuStart == 0) {
+                m_cpuStart = ThreadCpuNanos();
+            }
+            for (int i = 0; i < n; i++) {
+                HandleEvent(events[i], measuring);
+            }
+        }
+        if (m_cpuStart != 0) {
+            m_cpuNs = ThreadCpuNanos() - m_cpuStart;
+        }
+    }
+
+    void SendOne(BenchConn& conn, size_t size) {
+        char head[64];
+        int  len = std::snprintf(head, sizeof(head), "%s%llu ", kMarker,
+                                 static_cast<unsigned long long>(NowNanos()));
+        std::string text(head, len);
+        std::uniform_int_distribution<size_t> pickWord(0, sizeof(kWords) / sizeof(kWords[0]) - 1);
+        while (text.size() < size) {
+            text += kWords[pickWord(m_rng)];
+            text += ' ';
+        }
+        text.resize(size > size_t(len) ? size : size_t(len));
+
+        if (!conn.pending.empty()) {
+            // server isnt draining this socket, dont pile up
+            m_sendStalls++;
+            return;
+        }
+
+        std::string frame = EncodeFrame(FrameType::Chat, 0, text);
+        if (conn.deflate) {
+            std::string packed;
+            if (m_codec.Pack(frame.data(), frame.size(), &packed)) {
+                frame.swap(packed);
+            }
+        }
+        int n = send(conn.sock, frame.data(), static_cast<int>(frame.size()), CHAT_SEND_FLAGS);
+        if (n < 0) {
+            n = 0;
+        }
+        if (static_cast<size_t>(n) < frame.size()) {
+            conn.pending.assign(frame, n, std::string::npos);
+        }
+        m_sent++;
+    }
+
+    void HandleEvent(const PollEvent& ev, bool measuring) {
+        BenchConn& conn = *m_conns[ev.token];
+
+        if (ev.writable && !conn.pending.empty()) {
+            int n = send(conn.sock, conn.pending.data(),
+                         static_cast<int>(conn.pending.size()), CHAT_SEND_FLAGS);
+            if (n > 0) {
+                conn.pending.erase(0, n);
+            }
+        }
+
+        if (!ev.readable) {
+            return;
+        }
+
+        for (;;) {
+            char* dst = conn.decoder.WritePtr(64 * 1024);
+            int   n   = recv(conn.sock, dst, static_cast<int>(conn.decoder.WriteSpace()), 0);
+            if (n <= 0) {
+                break;
+            }
+            conn.decoder.Commit(n);
+            if (measuring) {
+                m_bytesIn += static_cast<uint64_t>(n);
+            }
+
+            uint64_t  now = NowNanos();
+            FrameView frame;
+            FrameView inner;
+            while (conn.decoder.Next(&frame) == FrameDecoder::Ready) {
+                if (frame.header.type != FrameType::Deflate) {
+                    OnFrame(conn, frame, now, measuring);
+                } else if (m_codec.Unpack(frame, &inner, &m_unpackError)) {
+                    OnFrame(conn, inner, now, measuring);
+                }
+            }
+        }
+    }
+
+    void Answer(BenchConn& conn, const std::string& frame) {
+        conn.pending.append(frame);
+        int n = send(conn.sock, conn.pending.data(),
+                     static_cast<int>(conn.pending.size()), CHAT_SEND_FLAGS);
+        if (n > 0) {
+            conn.pending.erase(0, n);
+        }
+    }
+
+    void OnFrame(BenchConn& conn, const FrameView& frame, uint64_t now, bool measuring) {
+        if (frame.header.type == FrameType::Hello) {
+            // fresh client: echo the server's seq back, broadcasts start after
+            conn.deflate = m_config.deflate && (HelloCodecs(frame) & kCodecDeflate);
+            Answer(conn, EncodeHello(frame.header.seq, HelloEpoch(frame),
+                                     conn.deflate ? kCodecDeflate : 0));
+            return;
+        }
+        if (frame.header.type == FrameType::Ping) {
+            // listeners never say anything, a long run gets them pinged
+            Answer(conn, EncodeFrame(FrameType::Pong, 0, nullptr, 0));
+            return;
+        }
+        if (frame.header.type == FrameType::System && !conn.welcomed) {
+            conn.welcomed = true;
+            m_welcomed++;
+            return;
+        }
+        if (frame.header.type != FrameType::Chat || !measuring) {
+            return;
+        }
+
+        // "[UserN] #B <ns> xxx"
+        const char* p   = frame.payload;
+        const char* end = p + frame.header.length;
+        const char* mark = std::search(p, end, kMarker, kMarker + sizeof(kMarker) - 1);
+        if (mark == end) {
+            return;
+        }
+        uint64_t sentAt = std::strtoull(mark + sizeof(kMarker) - 1, nullptr, 10);
+        m_delivered++;
+        if (now > sentAt) {
+            m_latency.Record((now - sentAt) / 1000);
+        } else {
+            m_latency.Record(0);
+        }
+    }
+
+    const BenchConfig&  m_config;
+    int                 m_senders;
+    double              m_rate;
+    std::mt19937        m_rng;
+
+    Poller                                  m_poller;
+    std::vector<std::unique_ptr<BenchConn>> m_conns;
+    FrameCodec                              m_codec;   // for all of them, one thread
+    std::string                             m_unpackError;
+    std::thread                             m_thread;
+    Clock::time_point                       m_measureFrom;
+    Clock::time_point                       m_stopAt;
+
+    LatencyHistogram m_latency;
+    uint64_t         m_sent;
+    uint64_t         m_sendStalls;
+    uint64_t         m_delivered;
+    uint64_t         m_bytesIn;
+    size_t           m_welcomed;
+    uint64_t         m_cpuStart;
+    uint64_t         m_cpuNs;
+};
+
+// cpu seconds of another process, from /proc (linux only)
+double ProcessCpuSeconds(int pid) {
+#ifdef __linux__
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* f = std::fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    char buf[1024];
+    size_t n = std::fread(buf, 1, sizeof(buf) - 1, f);
+    std::fclose(f);
+    buf[n] = '\0';
+
+    // fields after the ")" of the command name; utime/stime are 14 and 15
+    const char* p = std::strrchr(buf, ')');
+    if (!p) {
+        return 0;
+    }
+    unsigned long long utime = 0, stime = 0;
+    int field = 2;
+    for (const char* q = p + 1; *q && field < 15; q++) {
+        if (*q == ' ') {
+            field++;
+            if (field == 14) utime = std::strtoull(q + 1, nullptr, 10);
+            if (field == 15) stime = std::strtoull(q + 1, nullptr, 10);
+        }
+    }
+    return double(utime + stime) / double(sysconf(_SC_CLK_TCK));
+#else
+    (void)pid;
+    return 0;
+#endif
+}
+
+void RaiseFdLimit() {
+#ifndef _WIN32
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+#endif
+}
+
+std::vector<int> ParseSizes(const char* list) {
+    std::vector<int> sizes;
+    while (*list) {
+        char* end;
+        long  v = std::strtol(list, &end, 10);
+        if (end == list) {
+            break;
+        }
+        if (v > 0) {
+            sizes.push_back(static_cast<int>(v));
+        }
+        list = (*end == ',') ? end + 1 : end;
+    }
+    return sizes;
+}
+
+bool ParseArgs(int argc, char** argv, BenchConfig* config) {
+    // every bench client comes from 127.0.0.1 and talks way past any sane
+    // flood limit, so the limits are off unless asked for (--msg-rate=...)
+    config->server.limits.messages        = RateLimit();
+    config->server.limits.bytes           = RateLimit();
+    config->server.limits.addressMessages = RateLimit();
+    config->server.limits.addressBytes    = RateLimit();
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* eq  = std::strchr(arg, '=');
+        std::string key(arg, eq ? eq - arg : std::strlen(arg));
+        const char* val = eq ? eq + 1 : "";
+
+        if (key == "--clients")         config->clients   = std::atoi(val);
+        else if (key == "--senders")    config->senders   = std::atoi(val);
+        else if (key == "--rate")       config->rate      = std::atof(val);
+        else if (key == "--duration")   config->duration  = std::atof(val);
+        else if (key == "--warmup")     config->warmup    = std::atof(val);
+        else if (key == "--threads")    config->threads   = std::max(1, std::atoi(val));
+        else if (key == "--workers")    config->workers   = std::atoi(val);
+        else if (key == "--port")       config->port      = std::atoi(val);
+        else if (key == "--server-pid") config->serverPid = std::atoi(val);
+        else if (key == "--sizes")      config->sizes     = ParseSizes(val);
+        else if (key == "--deflate")    config->deflate   = true;
+        else if (key == "--external") {
+            config->external = true;
+            if (*val) config->host = val;
+        } else if (!ParseServerOption(arg, &config->server)) {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (config->sizes.empty()) {
+        config->sizes.push_back(64);
+    }
+    config->senders = std::min(config->senders, config->clients);
+    config->threads = std::min(config->threads, std::max(1, config->clients));
+    return config->clients > 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::fprintf(stderr, "winsock init fail\n");
+        return 1;
+    }
+#endif
+
+    t_benchThread = true;
+
+    BenchConfig config;
+    if (!ParseArgs(argc, argv, &config)) {
+        return 2;
+    }
+    RaiseFdLimit();
+
+    // server under test
+    std::unique_ptr<ChatServer> server;
+    if (!config.external) {
+        ChatServerConfig serverConfig = config.server;
+        serverConfig.port    = config.port;
+        serverConfig.workers = config.workers;
+        server.reset(new ChatServer(serverConfig));
+
+        std::string error;
+        if (!server->Start(&error)) {
+            std::fprintf(stderr, "server: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(static_cast<unsigned short>(config.port));
+    if (inet_pton(AF_INET, config.host.c_str(), &addr.sin_addr) != 1) {
+        std::fprintf(stderr, "bad host %s (ipv4 address please)\n", config.host.c_str());
+        return 2;
+    }
+
+    // deal clients, senders and rate out to the threads
+    std::vector<std::unique_ptr<BenchThread>> threads;
+    for (int t = 0; t < config.threads; t++) {
+        int clients = config.clients / config.threads + (t < config.clients % config.threads);
+        int senders = config.senders / config.threads + (t < config.senders % config.threads);
+        double rate = config.senders > 0 ? config.rate * senders / config.senders : 0;
+
+        std::unique_ptr<BenchThread> thread(new BenchThread(config, senders, rate, 1234u + t));
+        if (!thread->Connect(clients, addr)) {
+            return 1;
+        }
+        threads.push_back(std::move(thread));
+    }
+
+    for (auto& thread : threads) {
+        if (!thread->WaitWelcomed(10)) {
+            std::fprintf(stderr, "not every client got its welcome, server overloaded?\n");
+            return 1;
+        }
+    }
+
+    std::printf("clients %d  senders %d  rate %.0f/s  sizes", config.clients,
+                config.senders, config.rate);
+    for (int size : config.sizes) {
+        std::printf(" %d", size);
+    }
+    std::printf("  duration %.1fs (+%.1fs warmup)  server %s\n", config.duration,
+                config.warmup, config.external ? "external" : "in-process");
+    std::fflush(stdout);
+
+    Clock::time_point start        = Clock::now();
+    Clock::time_point measureFrom  = start + std::chrono::microseconds(static_cast<int64_t>(config.warmup * 1e6));
+    Clock::time_point stopAt       = measureFrom + std::chrono::microseconds(static_cast<int64_t>(config.duration * 1e6));
+
+    for (auto& thread : threads) {
+        thread->Start(measureFrom, stopAt);
+    }
+
+    // server cpu over the measured window only
+    std::this_thread::sleep_until(measureFrom);
+    uint64_t        cpuStart     = server ? server->CpuNanos() : 0;
+    MetricsSnapshot metricsStart = server ? server->Metrics() : MetricsSnapshot();
+    uint64_t        allocStart   = g_serverAllocs.load();
+    double   pidStart = config.serverPid ? ProcessCpuSeconds(config.serverPid) : 0;
+
+    for (auto& thread : threads) {
+        thread->Join();
+    }
+    double elapsed  = std::chrono::duration<double>(Clock::now() - measureFrom).count();
+    double serverCpu = 0;
+    MetricsSnapshot metricsEnd;
+    uint64_t        allocs = 0;
+    if (server) {
+        serverCpu  = double(server->CpuNanos() - cpuStart) / 1e9;
+        metricsEnd = server->Metrics();
+        allocs     = g_serverAllocs.load() - allocStart;
+    } else if (config.serverPid) {
+        serverCpu = ProcessCpuSeconds(config.serverPid) - pidStart;
+    }
+
+    LatencyHistogram latency;
+    uint64_t sent = 0, stalls = 0, delivered = 0, bytesIn = 0, clientCpu = 0;
+    for (auto& thread : threads) {
+        latency.Merge(thread->Latency());
+        sent      += thread->Sent();
+        stalls    += thread->SendStalls();
+        delivered += thread->Delivered();
+        bytesIn   += thread->BytesIn();
+        clientCpu += thread->CpuNanos();
+        thread->Close();
+    }
+
+    std::printf("sent        %llu msgs (%.0f/s incl. warmup), %llu skipped (socket full)\n",
+                (unsigned long long)sent, sent / (elapsed + config.warmup),
+                (unsigned long long)stalls);
+    std::printf("delivered   %llu frames  %.0f frames/s  %.1f MB/s  %.1f bytes/frame%s\n",
+                (unsigned long long)delivered, delivered / elapsed,
+                bytesIn / elapsed / 1e6, delivered ? double(bytesIn) / double(delivered) : 0.0,
+                config.deflate ? " (deflated)" : "");
+    std::printf("latency us  p50 %llu  p99 %llu  p999 %llu  max %llu\n",
+                (unsigned long long)latency.Percentile(50),
+                (unsigned long long)latency.Percentile(99),
+                (unsigned long long)latency.Percentile(99.9),
+                (unsigned long long)latency.Max());
+    if (serverCpu > 0 && delivered > 0) {
+        // a message sent reaches every client, so per message = per fan-out
+        double messages = double(delivered) / config.clients;
+        std::printf("server cpu  %.3fs  %.2f us/message  %.3f us/delivered frame\n",
+                    serverCpu, serverCpu * 1e6 / messages, serverCpu * 1e6 / delivered);
+    } else {
+        std::printf("server cpu  n/a (use the in-process server or --server-pid)\n");
+    }
+    if (clientCpu > 0 && delivered > 0) {
+        // reading (and unpacking) every frame, what a pi on the other end pays
+        std::printf("client cpu  %.3fs  %.3f us/delivered frame\n",
+                    double(clientCpu) / 1e9, double(clientCpu) / 1e3 / double(delivered));
+    }
+    if (server) {
+        // how well writes get batched: frames handed to the kernel per syscall
+        uint64_t frames = metricsEnd.total.framesOut - metricsStart.total.framesOut;
+        uint64_t writes = metricsEnd.total.writes - metricsStart.total.writes;
+        std::printf("server out  %llu frames in %llu write syscalls  %.1f frames/write\n",
+                    (unsigned long long)frames, (unsigned long long)writes,
+                    writes ? double(frames) / double(writes) : 0.0);
+        // should be ~0 once warmed up (see the top of the file)
+        uint64_t messages = metricsEnd.total.framesIn - metricsStart.total.framesIn;
+        std::printf("server heap %llu allocations  %.4f per message\n",
+                    (unsigned long long)allocs,
+                    messages ? double(allocs) / double(messages) : 0.0);
+        uint64_t throttled = metricsEnd.total.throttled - metricsStart.total.throttled;
+        if (throttled > 0) {
+            std::printf("server flood %llu frames over the rate limit\n",
+                        (unsigned long long)throttled);
+        }
+        uint64_t packed = metricsEnd.total.packed - metricsStart.total.packed;
+        if (packed > 0) {
+            std::printf("server deflated %llu broadcasts (once each, shared)\n",
+                        (unsigned long long)packed);
+        }
+    }
+
+    if (server) {
+        server->Stop();
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
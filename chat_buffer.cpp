@@ -0,0 +1,161 @@
+// chat_buffer.cpp
+// SharedBuffer allocation, from the block pool
+
+#include "chat_buffer.h"
+
+#include <mutex>
+#include <new>
+
+namespace {
+
+// blocks (header + bytes) are 64 bytes to 128K, power of two steps. the
+// biggest frame (64K payload) fits the last class
+const int      kMinShift   = 6;
+const uint32_t kClasses    = 12;
+const uint32_t kUnpooled   = kClasses;
+const size_t   kParkBytes  = 512 * 1024;   // per class, in the spill
+const size_t   kBatchBytes = 32 * 1024;    // what moves to/from the spill at once
+
+// a parked block, the links live in the block itself
+struct FreeBlock {
+    FreeBlock* next;
+    // the first block of a batch in the spill: the batch under it, and
+    // how many blocks this one has
+    FreeBlock* below;
+    size_t     count;
+};
+
+// a thread's own free list for one class, no lock
+struct LocalClass {
+    FreeBlock* head  = nullptr;
+    size_t     count = 0;
+};
+
+// where a thread's extra blocks go, and where one that ran dry looks
+// first. blocks move a batch at a time, so the lock is taken once per
+// batch and not per message. (a buffer made on one worker is often
+// released on another, this is how it finds its way back)
+struct Spill {
+    std::mutex lock;
+    FreeBlock* top    = nullptr;
+    size_t     parked = 0;   // blocks, all batches
+};
+
+Spill g_spill[kClasses];
+
+uint32_t ClassOf(size_t block) {
+    uint32_t cls = 0;
+    while (cls < kClasses && (size_t(1) << (kMinShift + cls)) < block) {
+        cls++;
+    }
+    return cls;
+}
+
+size_t BlockBytes(uint32_t cls) {
+    return size_t(1) << (kMinShift + cls);
+}
+
+size_t BatchOf(uint32_t cls) {
+    size_t batch = kBatchBytes / BlockBytes(cls);
+    return batch > 0 ? batch : 1;
+}
+
+// a chain of count blocks into the spill, or back to the heap if its full
+void Park(uint32_t cls, FreeBlock* chain, size_t count) {
+    Spill& spill = g_spill[cls];
+    {
+        std::lock_guard<std::mutex> lock(spill.lock);
+        if ((spill.parked + count) * BlockBytes(cls) <= kParkBytes) {
+            chain->below  = spill.top;
+            chain->count  = count;
+            spill.top     = chain;
+            spill.parked += count;
+            return;
+        }
+    }
+    while (chain) {
+        FreeBlock* next = chain->next;
+        ::operator delete(static_cast<void*>(chain));
+        chain = next;
+    }
+}
+
+struct LocalCache {
+    LocalClass classes[kClasses];
+
+    // the thread is done, what it kept goes to the others
+    ~LocalCache() {
+        for (uint32_t cls = 0; cls < kClasses; cls++) {
+            if (classes[cls].head) {
+                Park(cls, classes[cls].head, classes[cls].count);
+                classes[cls] = LocalClass();
+            }
+        }
+    }
+};
+
+thread_local LocalCache t_cache;
+
+}  // namespace
+
+SharedBuffer* SharedBuffer::Create(size_t size) {
+    // header and bytes in one block
+    size_t   block = sizeof(SharedBuffer) + size;
+    uint32_t cls   = ClassOf(block);
+    void*    mem   = nullptr;
+    if (cls != kUnpooled) {
+        LocalClass& local = t_cache.classes[cls];
+        if (!local.head) {
+            Spill& spill = g_spill[cls];
+            std::lock_guard<std::mutex> lock(spill.lock);
+            if (FreeBlock* batch = spill.top) {
+                spill.top     = batch->below;
+                spill.parked -= batch->count;
+                local.head    = batch;
+                local.count   = batch->count;
+            }
+        }
+        if (FreeBlock* free = local.head) {
+            local.head = free->next;
+            local.count--;
+            mem = free;
+        }
+    }
+    if (!mem) {
+        mem = ::operator new(cls != kUnpooled ? BlockBytes(cls) : block);
+    }
+    return new (mem) SharedBuffer(size, cls);
+}
+
+void SharedBuffer::Release() {
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    uint32_t cls = m_class;
+    this->~SharedBuffer();
+    if (cls == kUnpooled) {
+        ::operator delete(this);
+        return;
+    }
+
+    LocalClass& local = t_cache.classes[cls];
+    FreeBlock*  free  = new (static_cast<void*>(this)) FreeBlock;
+    free->next = local.head;
+    local.head = free;
+    local.count++;
+
+    // two batches kept here at most: the newest one stays (still warm in
+    // this core's cache), the older one moves on
+    size_t batch = BatchOf(cls);
+    if (local.count >= 2 * batch) {
+        FreeBlock* last = local.head;
+        for (size_t i = 1; i < batch; i++) {
+            last = last->next;
+        }
+        FreeBlock* older  = last->next;
+        size_t     spared = local.count - batch;
+        last->next  = nullptr;
+        local.count = batch;
+        Park(cls, older, spared);
+    }
+}
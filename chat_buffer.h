@@ -0,0 +1,80 @@
+// chat_buffer.h
+// immutable, ref-counted byte buffers for outgoing frames.
+//
+// a broadcast gets encoded once into a SharedBuffer and then every
+// recipient's outbound queue just holds a BufferRef to that same memory.
+// so fan-out costs one refcount bump per client instead of a copy (and a
+// re-encode) per client.
+//
+// the memory comes from a pool: blocks are rounded up to a power of two
+// and a released one is parked on its size class's free list for the next
+// Create, so a busy room doesnt go to malloc for every message. the free
+// lists are per thread (no lock), a thread with more than ~64KB of a class
+// spills the extra to a shared list a batch at a time, which keeps at most
+// ~512KB per class. anything past that goes back to the heap.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+class SharedBuffer {
+public:
+    // refcount starts at 1 and belongs to the caller.
+    // bytes are writable until you hand it out, treat it as read-only after
+    static SharedBuffer* Create(size_t size);
+
+    char*       Data()       { return reinterpret_cast<char*>(this + 1); }
+    const char* Data() const { return reinterpret_cast<const char*>(this + 1); }
+    size_t      Size() const { return m_size; }
+
+    void AddRef() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+    void Release();
+
+private:
+    SharedBuffer(size_t size, uint32_t sizeClass)
+        : m_refs(1), m_size(static_cast<uint32_t>(size)), m_class(sizeClass) {}
+    ~SharedBuffer() {}
+    SharedBuffer(const SharedBuffer&) = delete;
+    SharedBuffer& operator=(const SharedBuffer&) = delete;
+
+    std::atomic<uint32_t> m_refs;   // atomic: refs may be dropped on other threads
+    uint32_t              m_size;
+    uint32_t              m_class;  // pool size class, or too big to pool
+    // data follows right after the header, same allocation
+};
+
+// owning handle to a SharedBuffer (like a tiny intrusive shared_ptr)
+class BufferRef {
+public:
+    BufferRef() : m_buf(nullptr) {}
+    // takes over the caller's reference
+    explicit BufferRef(SharedBuffer* adopt) : m_buf(adopt) {}
+    BufferRef(const BufferRef& other) : m_buf(other.m_buf) {
+        if (m_buf) m_buf->AddRef();
+    }
+    BufferRef(BufferRef&& other) noexcept : m_buf(other.m_buf) {
+        other.m_buf = nullptr;
+    }
+    ~BufferRef() {
+        if (m_buf) m_buf->Release();
+    }
+
+    BufferRef& operator=(BufferRef other) noexcept {
+        std::swap(m_buf, other.m_buf);
+        return *this;
+    }
+
+    static BufferRef Allocate(size_t size) { return BufferRef(SharedBuffer::Create(size)); }
+
+    explicit operator bool() const { return m_buf != nullptr; }
+
+    const char* Data() const { return m_buf->Data(); }
+    char*       MutableData()  { return m_buf->Data(); }
+    size_t      Size() const { return m_buf->Size(); }
+
+private:
+    SharedBuffer* m_buf;
+};
@@ -0,0 +1,536 @@
+// chat_client_gui.cpp
+// simple multi-user chat client (gui)
+//
+// this used to be two copy-pasted programs (user2_gui, user3_gui). now its
+// one, the name in the title comes from the command line:
+//   chat_client_gui [name] [host] [port]
+// run it a few times with different names to get a room going.
+// the protocol side (handshake, resume, outbox) is ClientSession in
+// chatcore, this file is just the window + the wx socket.
+
+#include <wx/wx.h>        // wx gui
+#include <wx/socket.h>    // tcp socket
+
+#include "chat_session.h"         // frames, resume, outbox
+#include "chat_transcript_view.h" // capped chat log
+#include "chat_connector.h"       // connect without freezing the window
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+// for the session's timers: doesnt jump when the wall clock does
+static int64_t SteadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// main client window (connect, type, chat)
+class ClientFrame : public wxFrame, public ConnectListener, public ClientSessionListener {
+public:
+    ClientFrame(const wxString& name, const wxString& host, int port);
+    ~ClientFrame();
+
+    // from m_connector, gui thread
+    void OnConnectDone(wxSocketClient* socket, const wxString& address) override;
+    void OnConnectFailed(const wxString& reason) override;
+
+    // from m_session
+    void OnSessionText(FrameType type, uint32_t sender, const std::string& text) override;
+    void OnSessionNotice(const std::string& line) override;
+    void OnSessionExit() override;
+    void OnSessionRoster() override;
+    void OnSessionTyping(uint32_t id, const std::string& name) override;
+
+private:
+    // ui events
+    void OnQuit(wxCommandEvent& event);           // exit app
+    void OnAbout(wxCommandEvent& event);          //about box
+    void OnConnect(wxCommandEvent& event);        //connect btn
+    void OnDisconnect(wxCommandEvent& event);     //disconnect btn
+    void OnSendMessage(wxCommandEvent& event);    //send / enter
+    void OnSocketEvent(wxSocketEvent& event);     //net events
+    void OnReconnectTimer(wxTimerEvent& event);   //backoff is up
+    void OnTypingTimer(wxTimerEvent& event);      //"x is typing" wore off
+    void OnHeartbeatTimer(wxTimerEvent& event);   //is the server still there
+    void OnInputChanged(wxCommandEvent& event);   //a key in the msg box
+    
+    // helpers functions
+    void ConnectToServer(const wxString& host, int port);  // open conn
+    void DisconnectFromServer();                           // close conn
+    void StartConnect();                                   // (re)dial m_host:m_port
+    void DropSocket();                                     // just the socket
+    void ScheduleReconnect();                              // after a backoff
+    void FlushOutput();                                    // session -> socket
+    void LogMessage(const wxString& message);              // print in chat
+    void RefreshRoster();                                  // session roster -> list
+    
+    // ui bits
+    TranscriptView* m_chatDisplay;   // chat log
+    wxListBox*  m_rosterList;        // who is online
+    wxTextCtrl* m_messageInput;      // where we type
+    wxButton*   m_sendButton;        // send btn
+    wxTextCtrl* m_hostInput;         // server ip
+    wxTextCtrl* m_portInput;         // server port
+    wxButton*   m_connectButton;     // connect
+    wxButton*   m_disconnectButton;  // disconnect
+    
+    // net state
+    wxString        m_name;          //who we are (title only)
+    wxSocketClient* m_socket;        //active socket
+    AsyncConnector  m_connector;     //dns + connect in the background
+    ClientSession   m_session;       //protocol state, survives reconnects
+    wxString        m_host;
+    int             m_port;
+    wxTimer         m_reconnectTimer;
+    wxTimer         m_typingTimer;   //clears the typing note
+    wxTimer         m_heartbeatTimer;//ticks the session every second
+    
+    wxDECLARE_EVENT_TABLE();
+};
+
+enum {
+    ID_Quit = 1,
+    ID_About,
+    ID_Connect,
+    ID_Disconnect,
+    ID_Send,
+    ID_Reconnect,
+    ID_TypingQuiet,
+    ID_Heartbeat,
+    SOCKET_ID
+};
+
+wxBEGIN_EVENT_TABLE(ClientFrame, wxFrame)
+    EVT_MENU(ID_Quit,         ClientFrame::OnQuit)
+    EVT_MENU(ID_About,        ClientFrame::OnAbout)
+    EVT_BUTTON(ID_Connect,    ClientFrame::OnConnect)
+    EVT_BUTTON(ID_Disconnect, ClientFrame::OnDisconnect)
+    EVT_BUTTON(ID_Send,       ClientFrame::OnSendMessage)
+    EVT_SOCKET(SOCKET_ID,     ClientFrame::OnSocketEvent)
+    EVT_TIMER(ID_Reconnect,   ClientFrame::OnReconnectTimer)
+    EVT_TIMER(ID_TypingQuiet, ClientFrame::OnTypingTimer)
+    EVT_TIMER(ID_Heartbeat,   ClientFrame::OnHeartbeatTimer)
+wxEND_EVENT_TABLE()
+
+ClientFrame::ClientFrame(const wxString& name, const wxString& host, int port)
+    : wxFrame(nullptr, wxID_ANY, name + " Chat Client", wxDefaultPosition, wxSize(700, 500)),
+      m_name(name),
+      m_socket(nullptr),
+      m_connector(this),
+      m_session(this),
+      m_port(0),
+      m_reconnectTimer(this, ID_Reconnect),
+      m_typingTimer(this, ID_TypingQuiet),
+      m_heartbeatTimer(this, ID_Heartbeat)
+{
+    //menu bar
+    wxMenu* menuFile = new wxMenu;
+    menuFile->Append(ID_About, "&About\tF1", "what is this thing");
+    menuFile->AppendSeparator();
+    menuFile->Append(ID_Quit, "E&xit\tAlt-X", "quit app");
+    
+    wxMenuBar* menuBar = new wxMenuBar();
+    menuBar->Append(menuFile, "&File");
+    SetMenuBar(menuBar);
+    
+    CreateStatusBar(2);
+    SetStatusText("not connected");
+    
+    //gui layout
+    wxPanel*    panel     = new wxPanel(this, wxID_ANY);
+    wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
+    
+    //the row to connect and disconnect
+    wxStaticBoxSizer* connectionBox =
+        new wxStaticBoxSizer(wxHORIZONTAL, panel, "connection");
+    
+    connectionBox->Add(new wxStaticText(panel, wxID_ANY, "host:"),
+                       0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    m_hostInput = new wxTextCtrl(panel, wxID_ANY, host,
+                                 wxDefaultPosition, wxSize(120, -1));
+    connectionBox->Add(m_hostInput, 0, wxALL, 5);
+    
+    connectionBox->Add(new wxStaticText(panel, wxID_ANY, "port:"),
+                       0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    m_portInput = new wxTextCtrl(panel, wxID_ANY, wxString::Format("%d", port),
+                                 wxDefaultPosition, wxSize(60, -1));
+    connectionBox->Add(m_portInput, 0, wxALL, 5);
+    
+    m_connectButton = new wxButton(panel, ID_Connect, "connect");
+    connectionBox->Add(m_connectButton, 0, wxALL, 5);
+    
+    m_disconnectButton = new wxButton(panel, ID_Disconnect, "disconnect");
+    m_disconnectButton->Enable(false);
+    connectionBox->Add(m_disconnectButton, 0, wxALL, 5);
+    
+    mainSizer->Add(connectionBox, 0, wxALL | wxEXPAND, 5);
+    
+    //this is the chat box, who is online on the right
+    wxBoxSizer* chatSizer = new wxBoxSizer(wxHORIZONTAL);
+    m_chatDisplay = new TranscriptView(panel, wxID_ANY);
+    chatSizer->Add(m_chatDisplay, 1, wxALL | wxEXPAND, 5);
+    m_rosterList = new wxListBox(panel, wxID_ANY, wxDefaultPosition, wxSize(140, -1));
+    chatSizer->Add(m_rosterList, 0, wxALL | wxEXPAND, 5);
+    mainSizer->Add(chatSizer, 1, wxEXPAND);
+    
+    //input to type messages 
+    wxBoxSizer* inputSizer = new wxBoxSizer(wxHORIZONTAL);
+    
+    inputSizer->Add(new wxStaticText(panel, wxID_ANY, "msg:"),
+                    0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+    
+    m_messageInput = new wxTextCtrl(
+        panel,
+        wxID_ANY,
+        "",
+        wxDefaultPosition,
+        wxDefaultSize,
+        wxTE_PROCESS_ENTER
+    );
+    m_messageInput->Bind(wxEVT_TEXT_ENTER, &ClientFrame::OnSendMessage, this);
+    m_messageInput->Bind(wxEVT_TEXT, &ClientFrame::OnInputChanged, this);
+    m_messageInput->Enable(false);
+    inputSizer->Add(m_messageInput, 1, wxALL, 5);
+    
+    m_sendButton = new wxButton(panel, ID_Send, "send");
+    m_sendButton->Enable(false);
+    inputSizer->Add(m_sendButton, 0, wxALL, 5);
+    
+    mainSizer->Add(inputSizer, 0, wxEXPAND);
+    
+    panel->SetSizer(mainSizer);
+    
+    m_heartbeatTimer.Start(1000);
+    
+    LogMessage(m_name + " chat client ready");
+    LogMessage("set host/port and hit connect");
+}
+
+ClientFrame::~ClientFrame() {
+    if (m_socket) {
+        m_socket->Destroy();
+        m_socket = nullptr;
+    }
+}
+
+void ClientFrame::OnQuit(wxCommandEvent& WXUNUSED(event)) {
+    Close(true);   //this closes the app
+}
+
+void ClientFrame::OnAbout(wxCommandEvent& WXUNUSED(event)) {
+    wxMessageBox(
+        "multi-user chat client (" + m_name + ")\n\n"
+        "connects to the user1 / chat_server server.",
+        "about " + m_name,
+        wxOK | wxICON_INFORMATION,
+        this
+    );
+}
+
+void ClientFrame::OnConnect(wxCommandEvent& WXUNUSED(event)) {
+    wxString host = m_hostInput->GetValue().Trim();
+    long port;
+    
+    if (host.IsEmpty()) {
+        wxMessageBox("need a host", "Error", wxICON_ERROR);
+        return;
+    }
+    
+    if (!m_portInput->GetValue().ToLong(&port) || port <= 0 || port > 65535) {
+        wxMessageBox("bad port (1-65535)", "Error", wxICON_ERROR);
+        return;
+    }
+    
+    ConnectToServer(host, static_cast<int>(port));
+}
+
+void ClientFrame::OnDisconnect(wxCommandEvent& WXUNUSED(event)) {
+    DisconnectFromServer();
+}
+
+void ClientFrame::OnSendMessage(wxCommandEvent& WXUNUSED(event)) {
+    if (!m_session.Active()) {
+        LogMessage("not connected to server");
+        return;
+    }
+    
+    wxString message = m_messageInput->GetValue().Trim();
+    if (message.IsEmpty()) {
+        return;   //no empty messages
+    }
+    
+    // send the message to the server.
+    // if it's "Exit", the server will send "Exit" back,
+    // and the session tells us in OnSessionExit.
+    // utf-8 bytes (not wx chars) so nothing gets cut
+    bool live = m_session.Live();
+    if (!m_session.Send(std::string(message.ToUTF8()))) {
+        LogMessage("(outbox full, oldest unsent message dropped)");
+    }
+    if (!live) {
+        LogMessage("(not connected, will send when back)");
+    }
+    FlushOutput();
+    m_messageInput->Clear();
+}
+
+void ClientFrame::OnInputChanged(wxCommandEvent& WXUNUSED(event)) {
+    // Clear() after a send fires this too, an empty box isnt typing.
+    // the session throttles, most keys send nothing
+    if (!m_messageInput->IsEmpty() && m_session.Typing(SteadyMs())) {
+        FlushOutput();
+    }
+}
+
+void ClientFrame::OnSocketEvent(wxSocketEvent& event) {
+    switch (event.GetSocketEvent()) {
+        case wxSOCKET_INPUT: {
+            // one Read per event (a second Read with nothing waiting would
+            // block the gui), wx fires again if theres more.
+            // bytes land straight in the session's decoder, which may hold
+            // several frames or just part of one
+            char* dst = m_session.ReadPtr(4096);
+            m_socket->Read(dst, static_cast<wxUint32>(m_session.ReadSpace()));
+            m_session.Commit(m_socket->LastCount());
+
+            if (!m_session.Process()) {
+                LogMessage("bad data from server: " + wxString(m_session.ErrorText()));
+                DisconnectFromServer();
+                break;
+            }
+            FlushOutput();
+            break;
+        }
+        
+        case wxSOCKET_LOST:
+            // no popup, just keep trying. whatever gets typed meanwhile
+            // waits in the outbox
+            LogMessage("connection lost :(");
+            DropSocket();
+            m_session.Lost();
+            ScheduleReconnect();
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void ClientFrame::ConnectToServer(const wxString& host, int port) {
+    if (m_session.Active()) {
+        wxMessageBox("already connected", "Warning", wxICON_WARNING);
+        return;
+    }
+    
+    m_host = host;
+    m_port = port;
+    m_session.Begin();
+    
+    //connect btn off, disconnect doubles as cancel while we wait
+    m_connectButton->Enable(false);
+    m_disconnectButton->Enable(true);
+    m_hostInput->Enable(false);
+    m_portInput->Enable(false);
+    
+    StartConnect();
+}
+
+void ClientFrame::StartConnect() {
+    LogMessage("connecting to " + m_host + ":" + wxString::Format("%d", m_port) + "...");
+    SetStatusText(m_session.Reconnecting() ? "reconnecting..." : "connecting...", 1);
+    
+    //returns right away, answer comes back in OnConnectDone/OnConnectFailed
+    m_connector.Start(m_host, m_port);
+}
+
+void ClientFrame::ScheduleReconnect() {
+    uint32_t delay = m_session.RetryDelayMs();
+    LogMessage(wxString::Format("retrying in %.1fs", delay / 1000.0));
+    SetStatusText("offline", 1);
+    m_reconnectTimer.StartOnce(static_cast<int>(delay));
+}
+
+void ClientFrame::OnReconnectTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (m_session.Active() && !m_socket) {
+        StartConnect();
+    }
+}
+
+void ClientFrame::OnHeartbeatTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (!m_socket) {
+        return;
+    }
+    // a server that lost power never sends us wxSOCKET_LOST
+    if (!m_session.Tick(SteadyMs())) {
+        LogMessage("server stopped answering");
+        DropSocket();
+        m_session.Lost();
+        ScheduleReconnect();
+        return;
+    }
+    FlushOutput();
+}
+
+void ClientFrame::OnConnectDone(wxSocketClient* socket, const wxString& address) {
+    //socket is ours now, send its events here
+    m_socket = socket;
+    m_socket->SetEventHandler(*this, SOCKET_ID);
+    m_socket->SetNotify(wxSOCKET_INPUT_FLAG | wxSOCKET_LOST_FLAG);
+    m_socket->Notify(true);
+    m_session.Connected();
+    
+    LogMessage("connected to server (" + address + ")");
+    SetStatusText("connected", 1);
+    
+    m_messageInput->Enable(true);
+    m_sendButton->Enable(true);
+}
+
+void ClientFrame::OnConnectFailed(const wxString& reason) {
+    LogMessage("connect failed: " + reason);
+    if (m_session.Reconnecting()) {
+        //server is probably still restarting, back off and go again
+        ScheduleReconnect();
+        return;
+    }
+    m_session.End();
+    SetStatusText("not connected", 1);
+    
+    m_connectButton->Enable(true);
+    m_disconnectButton->Enable(false);
+    m_hostInput->Enable(true);
+    m_portInput->Enable(true);
+    
+    wxMessageBox("failed to reach server", "Connection Error", wxICON_ERROR);
+}
+
+void ClientFrame::DisconnectFromServer() {
+    //also stops a connect thats still going, or a reconnect thats waiting
+    m_session.End();
+    m_reconnectTimer.Stop();
+    m_connector.Cancel();
+    
+    DropSocket();
+    SetStatusText("not connected", 1);
+    RefreshRoster();   //End() emptied it
+    
+    m_connectButton->Enable(true);
+    m_disconnectButton->Enable(false);
+    m_hostInput->Enable(true);
+    m_portInput->Enable(true);
+    m_messageInput->Enable(false);
+    m_sendButton->Enable(false);
+    
+    LogMessage("disconnected from server");
+}
+
+void ClientFrame::DropSocket() {
+    if (m_socket) {
+        m_socket->Close();
+        m_socket->Destroy();
+        m_socket = nullptr;
+    }
+}
+
+void ClientFrame::FlushOutput() {
+    const std::string& out = m_session.Output();
+    if (!m_socket || out.empty()) {
+        return;
+    }
+    m_socket->Write(out.data(), static_cast<wxUint32>(out.size()));
+    m_session.Consumed(m_socket->LastCount());
+}
+
+// session callbacks ---------------------------------------------------------
+void ClientFrame::OnSessionText(FrameType WXUNUSED(type), uint32_t WXUNUSED(sender),
+                                const std::string& text) {
+    LogMessage(wxString::FromUTF8(text.data(), text.size()));
+}
+
+void ClientFrame::OnSessionNotice(const std::string& line) {
+    LogMessage(wxString::FromUTF8(line.c_str()));
+}
+
+void ClientFrame::OnSessionExit() {
+    // server said bye after we sent Exit
+    LogMessage("server sent Exit - closing connection");
+    // not from inside the session's frame loop
+    CallAfter([this]() { DisconnectFromServer(); });
+}
+
+void ClientFrame::OnSessionRoster() {
+    RefreshRoster();
+}
+
+void ClientFrame::OnSessionTyping(uint32_t WXUNUSED(id), const std::string& name) {
+    // one line is enough, whoever typed last. a few seconds of quiet clears it
+    SetStatusText(wxString::FromUTF8(name.c_str()) + " is typing...", 0);
+    m_typingTimer.StartOnce(4000);
+}
+
+void ClientFrame::OnTypingTimer(wxTimerEvent& WXUNUSED(event)) {
+    SetStatusText("", 0);
+}
+
+void ClientFrame::RefreshRoster() {
+    // a few hundred names at most, just redo the list
+    wxArrayString names;
+    for (const auto& who : m_session.Roster()) {
+        names.Add(wxString::FromUTF8(who.second.c_str()));
+    }
+    m_rosterList->Set(names);
+}
+
+void ClientFrame::LogMessage(const wxString& message) {
+    m_chatDisplay->AppendLine(message);
+}
+
+//app bootstrap
+class ClientApp : public wxApp {
+public:
+    virtual bool OnInit();
+    virtual int  OnExit();
+};
+
+bool ClientApp::OnInit() {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        wxMessageBox("winsock init failed", "Error", wxICON_ERROR);
+        return false;
+    }
+#endif
+
+    // chat_client_gui [name] [host] [port]
+    wxString name = "User2";
+    wxString host = "127.0.0.1";
+    int      port = 8888;
+    if (argc > 1) {
+        name = argv[1];
+    }
+    if (argc > 2) {
+        host = argv[2];
+    }
+    if (argc > 3) {
+        long p;
+        if (wxString(argv[3]).ToLong(&p) && p > 0 && p < 65536) {
+            port = static_cast<int>(p);
+        }
+    }
+
+    ClientFrame* frame = new ClientFrame(name, host, port);
+    frame->Show(true);
+    return true;
+}
+
+int ClientApp::OnExit() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
+
+wxIMPLEMENT_APP(ClientApp);
@@ -0,0 +1,217 @@
+// chat_compress.cpp
+// Deflate frames: the dictionary and the two reused zlib streams
+
+#include "chat_compress.h"
+
+#include <cstring>
+
+#ifdef CHAT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+// shorter than this isnt worth a try, the deflate end block and our type
+// byte eat most of what it could save
+const size_t kMinPackPayload = 32;
+
+#ifdef CHAT_HAVE_ZLIB
+
+// raw deflate (no zlib header or checksum, tcp has one) with a 4KB window:
+// frames are small and packed one by one, a bigger window buys nothing
+const int kWindowBits = -12;
+
+// what the frames we pack are made of: the lines the server itself sends
+// (chat_worker.cpp, chat_server.cpp, chat_outqueue.cpp, word for word),
+// then everyday chat, then the "[#room] [UserN] " every chat line starts
+// with. deflate finds matches in here before the frame has said anything
+// itself, which is where the win on short lines comes from. most likely
+// stuff last, it's the cheapest to point at
+const char kDictionary[] =
+    "(some messages from while you were away are gone)"
+    "(too many rooms on this server, cant make #"
+    "(you're not in any room, /join one first)"
+    "(slow down, you're sending too fast. messages dropped)"
+    "(nobody called  is on)(you're  now)(left #, talking in #lobby)"
+    "( messages skipped, connection too slow)"
+    "Welcome, User(talking in #, 1 here)"
+    "http://https://www.youtube.com/watch?v=.com/ :) :( :D ;) <3 xD "
+    "lol lmao haha yeah yep nope okay ok sorry please thanks thank you "
+    "does anyone know how to I think it's I don't I'm what's that's can't "
+    "did you have you seen let me know if when they have time tonight "
+    "tomorrow today yesterday later after before morning work the server "
+    " would could should about there their they them then than these those "
+    " what when where which while who why how well will with from have has "
+    " just like know think going want need good great really right now here "
+    " this that the and for are but not you your can get got was were been "
+    " one all out some more time people make see look way use first said "
+    "[Server -> User[Server] [#random] [#general] [#lobby] [#"
+    "] [User1] [User2] [User3] [User";
+
+#endif
+
+}  // namespace
+
+uint8_t SupportedCodecs() {
+#ifdef CHAT_HAVE_ZLIB
+    return kCodecDeflate;
+#else
+    return 0;
+#endif
+}
+
+#ifdef CHAT_HAVE_ZLIB
+
+struct FrameCodec::Streams {
+    z_stream deflate;
+    z_stream inflate;
+    bool     deflateOk = false;
+    bool     inflateOk = false;
+};
+
+FrameCodec::FrameCodec() : m_streams(new Streams()) {
+    std::memset(&m_streams->deflate, 0, sizeof(z_stream));
+    std::memset(&m_streams->inflate, 0, sizeof(z_stream));
+    // set up on first use, a client that never gets a Deflate frame
+    // shouldnt pay for the window
+}
+
+FrameCodec::~FrameCodec() {
+    if (m_streams->deflateOk) {
+        deflateEnd(&m_streams->deflate);
+    }
+    if (m_streams->inflateOk) {
+        inflateEnd(&m_streams->inflate);
+    }
+}
+
+size_t FrameCodec::Deflate(const char* payload, size_t length) {
+    z_stream& z = m_streams->deflate;
+    if (!m_streams->deflateOk) {
+        if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, kWindowBits, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            return 0;
+        }
+        m_streams->deflateOk = true;
+    } else if (deflateReset(&z) != Z_OK) {
+        return 0;
+    }
+    deflateSetDictionary(&z, reinterpret_cast<const Bytef*>(kDictionary),
+                         sizeof(kDictionary) - 1);
+
+    // room for two bytes less than it was (one goes to our type byte): if
+    // it doesnt finish in there it didnt shrink, no point going on
+    if (m_packed.size() < length) {
+        m_packed.resize(length);
+    }
+    z.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(payload));
+    z.avail_in  = static_cast<uInt>(length);
+    z.next_out  = reinterpret_cast<Bytef*>(m_packed.data());
+    z.avail_out = static_cast<uInt>(length - 2);
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+        return 0;
+    }
+    return length - 2 - z.avail_out;
+}
+
+bool FrameCodec::Unpack(const FrameView& frame, FrameView* out, std::string* error) {
+    if (frame.header.length < 2) {
+        *error = "empty Deflate frame";
+        return false;
+    }
+    FrameType type = static_cast<FrameType>(static_cast<uint8_t>(frame.payload[0]));
+    if (type == FrameType::Deflate) {
+        *error = "Deflate inside Deflate";
+        return false;
+    }
+
+    z_stream& z = m_streams->inflate;
+    if (!m_streams->inflateOk) {
+        if (inflateInit2(&z, kWindowBits) != Z_OK) {
+            *error = "out of memory";
+            return false;
+        }
+        m_streams->inflateOk = true;
+    } else {
+        inflateReset(&z);
+    }
+    inflateSetDictionary(&z, reinterpret_cast<const Bytef*>(kDictionary),
+                         sizeof(kDictionary) - 1);
+
+    // what comes out is held to the same limit as a plain frame
+    if (m_unpacked.empty()) {
+        m_unpacked.resize(kMaxFramePayload);
+    }
+    z.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(frame.payload + 1));
+    z.avail_in  = frame.header.length - 1;
+    z.next_out  = reinterpret_cast<Bytef*>(m_unpacked.data());
+    z.avail_out = static_cast<uInt>(m_unpacked.size());
+    int result  = inflate(&z, Z_FINISH);
+    if (result != Z_STREAM_END || z.avail_in != 0) {
+        *error = result == Z_BUF_ERROR && z.avail_out == 0 ? "Deflate frame unpacks too big"
+                                                           : "corrupt Deflate frame";
+        return false;
+    }
+
+    out->header        = frame.header;
+    out->header.type   = type;
+    out->header.length = static_cast<uint32_t>(m_unpacked.size() - z.avail_out);
+    out->payload       = m_unpacked.data();
+    return true;
+}
+
+#else
+
+struct FrameCodec::Streams {};
+
+FrameCodec::FrameCodec() {}
+FrameCodec::~FrameCodec() {}
+
+size_t FrameCodec::Deflate(const char*, size_t) {
+    return 0;
+}
+
+bool FrameCodec::Unpack(const FrameView&, FrameView*, std::string* error) {
+    *error = "Deflate frame, but built without zlib";
+    return false;
+}
+
+#endif
+
+bool FrameCodec::Pack(const char* frame, size_t length, std::string* out) {
+    FrameHeader header;
+    DecodeFrameHeader(frame, &header);
+    size_t packed = 0;
+    if (length < kFrameHeaderSize + kMinPackPayload || header.type == FrameType::Deflate ||
+        (packed = Deflate(frame + kFrameHeaderSize, header.length)) == 0) {
+        return false;
+    }
+    size_t at = out->size();
+    out->resize(at + kFrameHeaderSize + 1 + packed);
+    WrapHeader(header, packed, &(*out)[at]);
+    std::memcpy(&(*out)[at + kFrameHeaderSize + 1], m_packed.data(), packed);
+    return true;
+}
+
+BufferRef FrameCodec::PackShared(const BufferRef& frame) {
+    FrameHeader header;
+    DecodeFrameHeader(frame.Data(), &header);
+    size_t packed = 0;
+    if (frame.Size() < kFrameHeaderSize + kMinPackPayload || header.type == FrameType::Deflate ||
+        (packed = Deflate(frame.Data() + kFrameHeaderSize, header.length)) == 0) {
+        return BufferRef();
+    }
+    BufferRef out = BufferRef::Allocate(kFrameHeaderSize + 1 + packed);
+    WrapHeader(header, packed, out.MutableData());
+    std::memcpy(out.MutableData() + kFrameHeaderSize + 1, m_packed.data(), packed);
+    return out;
+}
+
+// header of the Deflate frame around inner, and the type byte after it
+void FrameCodec::WrapHeader(const FrameHeader& inner, size_t packed, char* out) {
+    FrameHeader header = inner;
+    header.type   = FrameType::Deflate;
+    header.length = static_cast<uint32_t>(1 + packed);
+    EncodeFrameHeader(header, out);
+    out[kFrameHeaderSize] = static_cast<char>(inner.type);
+}
@@ -0,0 +1,70 @@
+// chat_compress.h
+// optional compressed frames (deflate, zlib) for clients on slow links.
+//
+// a client that wants it says so in its Hello (see chat_protocol.h), after
+// that either side may send any frame wrapped in a Deflate frame instead:
+//
+//   header   same room, sender and seq as the frame inside
+//   payload  u8 type of the frame inside, then its payload as raw deflate
+//
+// every Deflate frame is compressed on its own, against a preset
+// dictionary of what chat looks like (the server's own lines, common
+// words, "[#lobby] [User").
+// a stream that keeps its window across frames would squeeze a bit
+// harder, but then every client's bytes are different: a broadcast is
+// deflated once here and the same buffer goes to everyone who asked for
+// deflate, and the server keeps no per connection window (~40KB each).
+// the streams themselves are kept and reset per frame, so packing costs
+// no allocation, just the deflate.
+//
+// frames that are short, or dont get smaller, go out as they are; a
+// client that asked for deflate takes both. one FrameCodec per thread.
+// without zlib (CHAT_HAVE_ZLIB unset) this builds, offers nothing and
+// packs nothing.
+
+#pragma once
+
+#include "chat_buffer.h"
+#include "chat_protocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// codec bits, in the Hello (offered by the server, picked by the client)
+const uint8_t kCodecDeflate = 1;
+
+// what this build can do, 0 = nothing (no zlib)
+uint8_t SupportedCodecs();
+
+class FrameCodec {
+public:
+    FrameCodec();
+    ~FrameCodec();
+
+    // frame (header + payload) -> the same frame deflated, appended to
+    // *out. false = not worth it (too short, didnt shrink), nothing added
+    bool Pack(const char* frame, size_t length, std::string* out);
+    // same for a shared frame, null = not worth it
+    BufferRef PackShared(const BufferRef& frame);
+
+    // a Deflate frame -> the frame inside. out->payload points in here,
+    // good until the next Unpack. false = corrupt (*error says how)
+    bool Unpack(const FrameView& frame, FrameView* out, std::string* error);
+
+private:
+    FrameCodec(const FrameCodec&) = delete;
+    FrameCodec& operator=(const FrameCodec&) = delete;
+
+    // payload -> m_packed, how many bytes it came to. 0 = no smaller
+    // than it was (or no zlib)
+    size_t Deflate(const char* payload, size_t length);
+    static void WrapHeader(const FrameHeader& inner, size_t packed, char* out);
+
+    struct Streams;   // the z_streams, zlib.h stays in the .cpp
+    std::unique_ptr<Streams> m_streams;
+    std::vector<char>        m_packed;
+    std::vector<char>        m_unpacked;
+};
@@ -0,0 +1,278 @@
+// chat_connector.cpp
+// resolver thread + staggered parallel connects for AsyncConnector
+
+#include "chat_connector.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#endif
+
+// the resolver thread and the connector meet here. the connector can go
+// away (or move on to another Start) while dns is still running, so the
+// thread only talks to it through this, under the lock
+struct AsyncConnector::ResolveJob {
+    std::mutex      lock;
+    AsyncConnector* owner;        // null once the connector gave up on it
+    unsigned        generation;
+};
+
+AsyncConnector::AsyncConnector(ConnectListener* listener)
+    : m_listener(listener),
+      m_generation(0),
+      m_busy(false),
+      m_port(0),
+      m_nextTarget(0),
+      m_staggerTimer(this),
+      m_timeoutTimer(this)
+{
+    Bind(wxEVT_SOCKET, &AsyncConnector::OnSocketEvent, this);
+    Bind(wxEVT_TIMER, &AsyncConnector::OnStaggerTimer, this, m_staggerTimer.GetId());
+    Bind(wxEVT_TIMER, &AsyncConnector::OnTimeoutTimer, this, m_timeoutTimer.GetId());
+}
+
+AsyncConnector::~AsyncConnector() {
+    Cancel();
+}
+
+void AsyncConnector::Start(const wxString& host, int port, int timeoutMs) {
+    Cancel();
+
+    m_busy = true;
+    m_port = port;
+    m_lastError.clear();
+    m_timeoutTimer.StartOnce(timeoutMs);
+
+    m_job = std::make_shared<ResolveJob>();
+    m_job->owner      = this;
+    m_job->generation = ++m_generation;
+
+    std::shared_ptr<ResolveJob> job     = m_job;
+    std::string                 hostStr = std::string(host.ToUTF8());
+    std::string                 portStr = std::to_string(port);
+    std::thread([job, hostStr, portStr]() {
+        addrinfo hints = {};
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        std::vector<Target> targets;
+        wxString            error;
+        addrinfo*           result = nullptr;
+        int rc = getaddrinfo(hostStr.c_str(), portStr.c_str(), &hints, &result);
+        if (rc != 0) {
+            error = "cant resolve " + wxString::FromUTF8(hostStr.c_str()) + ": " +
+                    wxString(gai_strerror(rc));
+        } else {
+            for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+                char numeric[NI_MAXHOST];
+                if (getnameinfo(ai->ai_addr, static_cast<socklen_t>(ai->ai_addrlen),
+                                numeric, sizeof(numeric), nullptr, 0, NI_NUMERICHOST) != 0) {
+                    continue;
+                }
+                Target target;
+                target.host = wxString::FromUTF8(numeric);
+                target.ipv6 = ai->ai_family == AF_INET6;
+#if !wxUSE_IPV6
+                if (target.ipv6) {
+                    continue;   // this wx cant connect to those
+                }
+#endif
+                targets.push_back(target);
+            }
+            freeaddrinfo(result);
+            Interleave(&targets);
+        }
+
+        // hand back to the gui thread, if anyone still cares
+        std::lock_guard<std::mutex> lock(job->lock);
+        if (job->owner) {
+            AsyncConnector* owner      = job->owner;
+            unsigned        generation = job->generation;
+            owner->CallAfter([owner, generation, targets, error]() {
+                owner->OnResolved(generation, targets, error);
+            });
+        }
+    }).detach();
+}
+
+void AsyncConnector::Cancel() {
+    m_generation++;
+    DetachJob();
+    DropAttempts();
+    m_staggerTimer.Stop();
+    m_timeoutTimer.Stop();
+    m_targets.clear();
+    m_nextTarget = 0;
+    m_busy       = false;
+}
+
+void AsyncConnector::OnResolved(unsigned generation, const std::vector<Target>& targets,
+                                const wxString& error) {
+    if (!m_busy || generation != m_generation) {
+        return;   // stale, Cancel/Start happened since
+    }
+    DetachJob();
+
+    if (targets.empty()) {
+        Fail(error.IsEmpty() ? wxString("no usable address for that host") : error);
+        return;
+    }
+
+    m_targets    = targets;
+    m_nextTarget = 0;
+    if (!StartNextAttempt() && m_attempts.empty()) {
+        Fail(m_lastError);
+    }
+}
+
+// one more target in flight (and the timer for the one after that).
+// false if there was nothing left to start
+bool AsyncConnector::StartNextAttempt() {
+    while (m_nextTarget < m_targets.size()) {
+        const Target& target = m_targets[m_nextTarget++];
+
+        Attempt attempt;
+        attempt.address = target.host + ":" + wxString::Format("%d", m_port);
+        attempt.socket  = new wxSocketClient();
+        attempt.socket->SetEventHandler(*this);
+        attempt.socket->SetNotify(wxSOCKET_CONNECTION_FLAG | wxSOCKET_LOST_FLAG);
+        attempt.socket->Notify(true);
+
+        bool connected;
+#if wxUSE_IPV6
+        if (target.ipv6) {
+            wxIPV6address addr;
+            addr.Hostname(target.host);
+            addr.Service(m_port);
+            connected = attempt.socket->Connect(addr, false);
+        } else
+#endif
+        {
+            wxIPV4address addr;
+            addr.Hostname(target.host);
+            addr.Service(m_port);
+            connected = attempt.socket->Connect(addr, false);
+        }
+
+        if (connected) {
+            // loopback can finish on the spot, and then no event comes
+            Win(attempt);
+            return true;
+        }
+        if (attempt.socket->LastError() != wxSOCKET_WOULDBLOCK) {
+            // refused on the spot (no route etc), straight on to the next one
+            m_lastError = "cant reach " + attempt.address;
+            attempt.socket->Destroy();
+            continue;
+        }
+
+        m_attempts.push_back(attempt);
+        if (m_nextTarget < m_targets.size()) {
+            m_staggerTimer.StartOnce(kStaggerMs);
+        }
+        return true;
+    }
+    return false;
+}
+
+void AsyncConnector::OnSocketEvent(wxSocketEvent& event) {
+    wxSocketBase* socket = event.GetSocket();
+
+    size_t index = 0;
+    while (index < m_attempts.size() && m_attempts[index].socket != socket) {
+        index++;
+    }
+    if (index == m_attempts.size()) {
+        return;   // from an attempt we already dropped
+    }
+
+    if (event.GetSocketEvent() == wxSOCKET_CONNECTION) {
+        Attempt winner = m_attempts[index];
+        m_attempts.erase(m_attempts.begin() + index);
+        Win(winner);
+        return;
+    }
+
+    // wxSOCKET_LOST while connecting = this address didnt work out
+    m_lastError = "cant reach " + m_attempts[index].address;
+    m_attempts[index].socket->Notify(false);
+    m_attempts[index].socket->Destroy();
+    m_attempts.erase(m_attempts.begin() + index);
+
+    // dont sit out the stagger delay, try the next one now
+    m_staggerTimer.Stop();
+    if (!StartNextAttempt() && m_attempts.empty()) {
+        Fail(m_lastError);
+    }
+}
+
+void AsyncConnector::OnStaggerTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (m_busy && !StartNextAttempt() && m_attempts.empty()) {
+        Fail(m_lastError);
+    }
+}
+
+void AsyncConnector::OnTimeoutTimer(wxTimerEvent& WXUNUSED(event)) {
+    if (m_busy) {
+        Fail("timed out" + (m_lastError.IsEmpty() ? wxString() : " (" + m_lastError + ")"));
+    }
+}
+
+// everyone else gets dropped, this one goes to the listener
+void AsyncConnector::Win(const Attempt& winner) {
+    winner.socket->Notify(false);
+    Cancel();
+    m_listener->OnConnectDone(winner.socket, winner.address);
+}
+
+void AsyncConnector::DropAttempts() {
+    for (Attempt& attempt : m_attempts) {
+        attempt.socket->Notify(false);
+        attempt.socket->Destroy();
+    }
+    m_attempts.clear();
+}
+
+void AsyncConnector::Fail(const wxString& reason) {
+    Cancel();
+    m_listener->OnConnectFailed(reason);
+}
+
+void AsyncConnector::DetachJob() {
+    if (m_job) {
+        std::lock_guard<std::mutex> lock(m_job->lock);
+        m_job->owner = nullptr;
+    }
+    m_job.reset();
+}
+
+// v6/v4 alternating, starting with whatever family the resolver put first
+// (RFC 8305 section 4)
+void AsyncConnector::Interleave(std::vector<Target>* targets) {
+    if (targets->empty()) {
+        return;
+    }
+
+    bool firstIpv6 = targets->front().ipv6;
+    std::vector<Target> first, second;
+    for (const Target& target : *targets) {
+        (target.ipv6 == firstIpv6 ? first : second).push_back(target);
+    }
+
+    targets->clear();
+    for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+        if (i < first.size()) {
+            targets->push_back(first[i]);
+        }
+        if (i < second.size()) {
+            targets->push_back(second[i]);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+// chat_connector.h
+// non-blocking connect for the gui clients.
+//
+// the old ConnectToServer did Connect + WaitOnConnect(10), so an
+// unreachable server froze the window for 10 seconds. this does the whole
+// thing off the event loop instead:
+//
+//   1. getaddrinfo runs on a throwaway thread (dns can take ages on a pi)
+//   2. the addresses get tried happy-eyeballs style: first one right away,
+//      another one every kStaggerMs (or as soon as one fails), v6 and v4
+//      interleaved. first wxSOCKET_CONNECTION wins, the rest are dropped
+//   3. a timeout (or Cancel) ends the lot
+//
+// the winner comes back through ConnectListener, still notifying this
+// object. the listener points it at its own handler.
+
+#pragma once
+
+#include <wx/wx.h>
+#include <wx/socket.h>
+
+#include <memory>
+#include <vector>
+
+class ConnectListener {
+public:
+    virtual ~ConnectListener() {}
+
+    // socket is connected and now belongs to the listener. point it at
+    // your own handler with SetEventHandler/SetNotify before returning
+    virtual void OnConnectDone(wxSocketClient* socket, const wxString& address) = 0;
+    virtual void OnConnectFailed(const wxString& reason) = 0;
+};
+
+class AsyncConnector : public wxEvtHandler {
+public:
+    static const int kStaggerMs        = 250;     // between parallel attempts
+    static const int kDefaultTimeoutMs = 10000;
+
+    explicit AsyncConnector(ConnectListener* listener);
+    ~AsyncConnector();
+
+    // any connect already running is cancelled first
+    void Start(const wxString& host, int port, int timeoutMs = kDefaultTimeoutMs);
+    // quietly drops everything, the listener hears nothing
+    void Cancel();
+    bool Busy() const { return m_busy; }
+
+private:
+    struct Target {
+        wxString host;     // numeric, so wx doesnt resolve it again
+        bool     ipv6;
+    };
+    struct Attempt {
+        wxSocketClient* socket;
+        wxString        address;
+    };
+    struct ResolveJob;
+
+    void OnResolved(unsigned generation, const std::vector<Target>& targets, const wxString& error);
+    void OnSocketEvent(wxSocketEvent& event);
+    void OnStaggerTimer(wxTimerEvent& event);
+    void OnTimeoutTimer(wxTimerEvent& event);
+
+    bool StartNextAttempt();
+    void Win(const Attempt& winner);
+    void DropAttempts();
+    void Fail(const wxString& reason);
+    void DetachJob();
+
+    static void Interleave(std::vector<Target>* targets);
+
+    ConnectListener*            m_listener;
+    std::shared_ptr<ResolveJob> m_job;          // shared with the resolver thread
+    unsigned                    m_generation;   // bumped per Start/Cancel
+    bool                        m_busy;
+    int                         m_port;
+    std::vector<Target>         m_targets;
+    size_t                      m_nextTarget;
+    std::vector<Attempt>        m_attempts;     // in flight
+    wxString                    m_lastError;
+    wxTimer                     m_staggerTimer;
+    wxTimer                     m_timeoutTimer;
+};
@@ -0,0 +1,58 @@
+// chat_conntable.cpp
+// slot allocation for ConnectionTable
+
+#include "chat_conntable.h"
+
+ConnHandle ConnectionTable::Add(socket_t sock, int clientId) {
+    uint32_t slot;
+    if (!m_free.empty()) {
+        slot = m_free.back();
+        m_free.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(state.size());
+        state.push_back(ConnState::Free);
+        fd.push_back(CHAT_INVALID_SOCKET);
+        outq.emplace_back();
+        dirty.push_back(0);
+        codec.push_back(0);
+        generation.push_back(0);
+        id.push_back(0);
+        name.emplace_back();
+        prefix.emplace_back();
+        address.emplace_back();
+        decoder.emplace_back(0);   // no buffer until it has something to read
+        rate.emplace_back();
+        connectedMs.push_back(0);
+        heardMs.push_back(0);
+        pingedMs.push_back(0);
+    }
+
+    state[slot] = ConnState::Joining;
+    fd[slot]    = sock;
+    id[slot]    = clientId;
+    m_count++;
+    return HandleOf(slot);
+}
+
+void ConnectionTable::Remove(ConnHandle handle) {
+    if (!Valid(handle)) {
+        return;
+    }
+
+    uint32_t slot = SlotOf(handle);
+    state[slot] = ConnState::Free;
+    fd[slot]    = CHAT_INVALID_SOCKET;
+    outq[slot].Clear();
+    dirty[slot] = 0;
+    codec[slot] = 0;
+    decoder[slot].Reset();
+    name[slot].clear();
+    prefix[slot].clear();
+    address[slot].clear();
+    rate[slot] = ConnRate();   // the worker Detach()ed it already
+    pingedMs[slot] = 0;
+    generation[slot]++;   // old handles to this slot are dead now
+
+    m_free.push_back(slot);
+    m_count--;
+}
@@ -0,0 +1,81 @@
+// chat_conntable.h
+// dense slot table of a worker's connections, struct-of-arrays style.
+//
+// every client gets a slot index; each per-client field is its own
+// contiguous column indexed by that slot. the hot columns (state, fd,
+// outbound queue) are what broadcast touches, so a fan-out is a straight
+// linear walk over a few packed arrays instead of chasing map nodes.
+//
+// callers hold a ConnHandle = (generation << 32) | slot. freeing a slot
+// bumps its generation, so an old handle (a stale poller event, a late
+// mail) for a reused slot simply fails Valid() instead of hitting the new
+// client.
+
+#pragma once
+
+#include "chat_net.h"
+#include "chat_outqueue.h"
+#include "chat_protocol.h"
+#include "chat_ratelimit.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef uint64_t ConnHandle;
+
+enum class ConnState : uint8_t {
+    Free,      // slot is on the free list
+    Joining,   // connected, no Hello yet (gets no broadcasts)
+    Open,
+    Closing    // said goodbye, drop once the queue drains
+};
+
+class ConnectionTable {
+public:
+    ConnectionTable() : m_count(0) {}
+
+    // takes a free slot (or grows every column by one), in Joining state.
+    // NOTE: growing may move the columns, dont hold references across Add()
+    ConnHandle Add(socket_t sock, int clientId);
+    void       Remove(ConnHandle handle);
+
+    bool Valid(ConnHandle handle) const {
+        uint32_t slot = SlotOf(handle);
+        return slot < state.size() && state[slot] != ConnState::Free &&
+               generation[slot] == GenerationOf(handle);
+    }
+
+    ConnHandle HandleOf(uint32_t slot) const {
+        return (static_cast<uint64_t>(generation[slot]) << 32) | slot;
+    }
+    static uint32_t SlotOf(ConnHandle handle) { return static_cast<uint32_t>(handle); }
+    static uint32_t GenerationOf(ConnHandle handle) { return static_cast<uint32_t>(handle >> 32); }
+
+    uint32_t Slots() const { return static_cast<uint32_t>(state.size()); }   // incl. free ones
+    size_t   Count() const { return m_count; }                               // live ones
+
+    // hot columns
+    std::vector<ConnState>     state;
+    std::vector<socket_t>      fd;
+    std::vector<OutboundQueue> outq;        // frames the kernel hasnt taken yet
+    std::vector<uint8_t>       dirty;       // queued to since the last flush (on the worker's list)
+    std::vector<uint8_t>       codec;       // picked in their Hello (kCodec*), 0 = plain
+
+    // cold columns
+    std::vector<uint32_t>      generation;
+    std::vector<int>           id;
+    std::vector<std::string>   name;
+    std::vector<std::string>   prefix;      // "[name] ", made once when they join
+    std::vector<std::string>   address;
+    std::vector<FrameDecoder>  decoder;     // reads land straight in here
+    std::vector<ConnRate>      rate;        // flood buckets, see RateLimiter
+    // liveness, steady clock ms (see ChatWorker::OnTimer)
+    std::vector<int64_t>       connectedMs;
+    std::vector<int64_t>       heardMs;     // last read anything from them
+    std::vector<int64_t>       pingedMs;    // our Ping is out since, 0 = none
+
+private:
+    std::vector<uint32_t> m_free;
+    size_t                m_count;
+};
@@ -0,0 +1,94 @@
+// chat_history.cpp
+// HistoryRing
+
+#include "chat_history.h"
+
+#include "chat_protocol.h"
+
+HistoryRing::HistoryRing(size_t capacity, uint32_t maxAgeMs, uint32_t lastSeq)
+    : m_frames(capacity),
+      m_packed(capacity),
+      m_stamps(capacity, 0),
+      m_head(0),
+      m_count(0),
+      m_maxAgeMs(maxAgeMs),
+      m_lastSeq(lastSeq)
+{
+}
+
+void HistoryRing::Push(const BufferRef& frame, int64_t nowMs, const BufferRef& packed) {
+    m_lastSeq = FrameSeq(frame);
+    if (m_frames.empty()) {
+        return;   // history turned off, the seq still counts
+    }
+
+    size_t slot;
+    if (m_count == m_frames.size()) {
+        // full: the oldest makes room
+        slot   = m_head;
+        m_head = (m_head + 1) % m_frames.size();
+    } else {
+        slot = (m_head + m_count) % m_frames.size();
+        m_count++;
+    }
+    m_frames[slot] = frame;
+    m_packed[slot] = packed;
+    m_stamps[slot] = nowMs;
+
+    Expire(nowMs);
+}
+
+void HistoryRing::Expire(int64_t nowMs) {
+    if (m_maxAgeMs == 0) {
+        return;
+    }
+    while (m_count > 0 && nowMs - m_stamps[m_head] > m_maxAgeMs) {
+        m_frames[m_head] = BufferRef();   // let the bytes go now, not on overwrite
+        m_packed[m_head] = BufferRef();
+        m_head = (m_head + 1) % m_frames.size();
+        m_count--;
+    }
+}
+
+uint32_t HistoryRing::FirstSeq() const {
+    return m_count > 0 ? FrameSeq(At(0)) : m_lastSeq + 1;
+}
+
+size_t HistoryRing::FirstAfter(uint32_t seq) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    uint32_t oldest = FrameSeq(At(0));
+    if (seq < oldest) {
+        return 0;
+    }
+    uint64_t index = uint64_t(seq - oldest) + 1;
+    if (index >= m_count) {
+        return m_count;
+    }
+    if (FrameSeq(At(index)) == seq + 1) {
+        return static_cast<size_t>(index);
+    }
+
+    // seqs had a gap after all, fall back to looking
+    for (size_t i = 0; i < m_count; i++) {
+        if (FrameSeq(At(i)) > seq) {
+            return i;
+        }
+    }
+    return m_count;
+}
+
+size_t HistoryRing::FirstAt(int64_t ms) const {
+    // stamps only go up, oldest first
+    size_t lo = 0, hi = m_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m_stamps[(m_head + mid) % m_frames.size()] < ms) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,64 @@
+// chat_history.h
+// a worker's recent broadcasts, for clients that join or come back.
+//
+// fixed ring of the serialized frames themselves (the same shared buffers
+// the fan-out sends), allocated once up front, oldest first. nothing gets
+// re-encoded for a catch-up: handing history to a client is just queueing
+// refs to bytes that already exist. every worker sees every broadcast and
+// seqs are handed out one by one (ChatServer::Publish), so the frames in
+// here have consecutive seqs and "everything after seq X" is an index
+// calculation, not a search.
+//
+// a frame can come with its deflated twin (chat_compress.h), kept next to
+// it so a client that asked for deflate gets its catch-up deflated too.
+//
+// optional age limit on top of the count limit: frames older than
+// maxAgeMs are dropped (0 = keep until the count pushes them out).
+
+#pragma once
+
+#include "chat_buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class HistoryRing {
+public:
+    // lastSeq = newest broadcast so far (non zero when the server carries
+    // on from its persistent log)
+    HistoryRing(size_t capacity, uint32_t maxAgeMs, uint32_t lastSeq = 0);
+
+    // frame must carry its seq already (packed too, if there is one).
+    // nowMs = any steady clock in ms
+    void Push(const BufferRef& frame, int64_t nowMs, const BufferRef& packed = BufferRef());
+    // drops whatever is past the age limit
+    void Expire(int64_t nowMs);
+
+    bool   Empty() const { return m_count == 0; }
+    size_t Size() const { return m_count; }
+    // i = 0 is the oldest
+    const BufferRef& At(size_t i) const { return m_frames[(m_head + i) % m_frames.size()]; }
+    // its deflated twin, null if it had none
+    const BufferRef& PackedAt(size_t i) const { return m_packed[(m_head + i) % m_frames.size()]; }
+
+    // seq of the newest broadcast ever pushed (even if it has expired since)
+    uint32_t LastSeq() const { return m_lastSeq; }
+    // seq of At(0), or the one the next Push will have when empty
+    uint32_t FirstSeq() const;
+    // index of the first frame newer than seq (Size() = none).
+    // 0 and anything before the oldest frame mean "all of it"
+    size_t   FirstAfter(uint32_t seq) const;
+    // index of the first frame pushed at or after ms (same clock as Push),
+    // Size() = none
+    size_t   FirstAt(int64_t ms) const;
+
+private:
+    std::vector<BufferRef> m_frames;   // capacity slots, never resized
+    std::vector<BufferRef> m_packed;   // same slots
+    std::vector<int64_t>   m_stamps;   // when each one came in
+    size_t                 m_head;     // oldest
+    size_t                 m_count;
+    uint32_t               m_maxAgeMs;
+    uint32_t               m_lastSeq;
+};
@@ -0,0 +1,159 @@
+// chat_http.cpp
+// GET /metrics, nothing else
+
+#include "chat_http.h"
+
+#include <chrono>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+typedef WSAPOLLFD chat_pollfd;
+#define chat_poll WSAPoll
+#else
+typedef pollfd chat_pollfd;
+#define chat_poll poll
+#endif
+
+const uint64_t kListenToken = 1;
+const uint64_t kWakeToken   = 2;
+
+// a scraper that stalls doesnt get to hold the thread for long
+const int    kRequestTimeoutMs = 1000;
+const size_t kMaxRequest       = 8 * 1024;
+
+// false = timed out or the socket broke
+bool WaitFor(socket_t sock, bool write, int timeoutMs) {
+    chat_pollfd pfd;
+    pfd.fd      = sock;
+    pfd.events  = write ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    return chat_poll(&pfd, 1, timeoutMs) > 0;
+}
+
+std::string Response(const char* status, const std::string& body) {
+    return std::string("HTTP/1.1 ") + status + "\r\n"
+           "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+}  // namespace
+
+MetricsEndpoint::MetricsEndpoint()
+    : m_listener(CHAT_INVALID_SOCKET),
+      m_running(false)
+{
+}
+
+MetricsEndpoint::~MetricsEndpoint() {
+    Stop();
+}
+
+bool MetricsEndpoint::Start(int port, std::function<std::string()> render, std::string* error) {
+    if (!m_poller.Ok() || !m_wakeup.Ok()) {
+        if (error) *error = "cant create poller";
+        return false;
+    }
+    // localhost only: whoever scrapes runs on the box (or tunnels in)
+    m_listener = OpenListener(port, false, error, true);
+    if (m_listener == CHAT_INVALID_SOCKET) {
+        return false;
+    }
+    m_poller.Add(m_listener, kListenToken);
+    m_poller.Add(m_wakeup.Fd(), kWakeToken);
+
+    m_render  = render;
+    m_running = true;
+    m_thread  = std::thread(&MetricsEndpoint::Run, this);
+    return true;
+}
+
+void MetricsEndpoint::Stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_running = false;
+    m_wakeup.Signal();
+    m_thread.join();
+
+    m_poller.Remove(m_listener);
+    m_poller.Remove(m_wakeup.Fd());
+    CloseSocket(m_listener);
+    m_listener = CHAT_INVALID_SOCKET;
+}
+
+void MetricsEndpoint::Run() {
+    PollEvent events[4];
+    while (m_running) {
+        int n = m_poller.Wait(events, 4, 1000);
+        for (int i = 0; i < n; i++) {
+            if (events[i].token == kWakeToken) {
+                m_wakeup.Drain();
+                continue;
+            }
+            // edge triggered, take everyone waiting
+            for (;;) {
+                socket_t sock = accept(m_listener, nullptr, nullptr);
+                if (sock == CHAT_INVALID_SOCKET) {
+                    break;
+                }
+                Answer(sock);
+                CloseSocket(sock);
+            }
+        }
+    }
+}
+
+void MetricsEndpoint::Answer(socket_t sock) {
+    if (!SetNonBlocking(sock)) {
+        return;
+    }
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(kRequestTimeoutMs);
+    auto left = [&deadline]() {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      deadline - std::chrono::steady_clock::now()).count();
+        return ms > 0 ? static_cast<int>(ms) : 0;
+    };
+
+    // just the request line matters, read until the headers end
+    std::string request;
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequest) {
+        char buf[1024];
+        int  n = recv(sock, buf, sizeof(buf), 0);
+        if (n > 0) {
+            request.append(buf, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0 || !IsWouldBlock(SocketError()) || !WaitFor(sock, false, left())) {
+            return;
+        }
+    }
+
+    std::string reply;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        reply = Response("200 OK", m_render());
+    } else {
+        reply = Response("404 Not Found", "try GET /metrics\n");
+    }
+
+    size_t sent = 0;
+    while (sent < reply.size()) {
+        int n = send(sock, reply.data() + sent, static_cast<int>(reply.size() - sent),
+                     CHAT_SEND_FLAGS);
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && IsWouldBlock(SocketError()) && WaitFor(sock, true, left())) {
+            continue;
+        }
+        return;
+    }
+}
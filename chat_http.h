@@ -0,0 +1,42 @@
+// chat_http.h
+// the metrics endpoint: a very small http server on 127.0.0.1 that
+// answers GET /metrics with whatever the render callback returns
+// (prometheus text, see chat_metrics.h).
+//
+// one thread, one request at a time, the connection is closed after every
+// answer. plenty for a scraper every few seconds and a curl now and then,
+// and it never touches the workers: render only reads their counters.
+
+#pragma once
+
+#include "chat_net.h"
+#include "chat_poller.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+class MetricsEndpoint {
+public:
+    MetricsEndpoint();
+    ~MetricsEndpoint();
+
+    // render runs on the endpoint's thread
+    bool Start(int port, std::function<std::string()> render, std::string* error);
+    void Stop();
+
+private:
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    void Run();
+    void Answer(socket_t sock);
+
+    socket_t                     m_listener;
+    Poller                       m_poller;
+    Wakeup                       m_wakeup;
+    std::function<std::string()> m_render;
+    std::atomic<bool>            m_running;
+    std::thread                  m_thread;
+};
@@ -0,0 +1,644 @@
+// chat_log.cpp
+// ChatLog: segmented append-only broadcast log with group commit
+
+#include "chat_log.h"
+
+#include "chat_protocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct ChatLog::Segment {
+    uint32_t                baseSeq = 0;
+    uint32_t                lastSeq = 0;    // 0 = nothing in it yet
+    size_t                  size    = 0;    // bytes written (readable)
+    int                     fd      = -1;
+    std::vector<IndexEntry> index;          // seq order, first one at offset 0
+
+    ~Segment() {
+#ifndef _WIN32
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+};
+
+ChatLog::ChatLog()
+    : m_epoch(0),
+      m_openSeq(0),
+      m_stopping(false),
+      m_activeIdx(-1),
+      m_sinceIndex(0),
+      m_lastIndexTime(0),
+      m_failed(false)
+{
+}
+
+ChatLog::~ChatLog() {
+    Close();
+}
+
+int64_t ChatLog::NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+
+// no mmap/sendfile/fdatasync story there yet, the server runs without a log
+bool ChatLog::Open(const ChatLogOptions&, std::string* error) {
+    if (error) *error = "persistent log isnt supported on windows";
+    return false;
+}
+
+void ChatLog::Close() {}
+void ChatLog::Append(const BufferRef&, int64_t) {}
+uint32_t ChatLog::SeqAtTime(int64_t) const { return 0; }
+uint32_t ChatLog::Spans(uint32_t, uint32_t, std::vector<FileSpan>*, uint32_t*,
+                        const RoomFilter&) const {
+    return 0;
+}
+
+ChatLogStats ChatLog::Stats() const {
+    return ChatLogStats();
+}
+
+#else
+
+bool ChatLog::Open(const ChatLogOptions& options, std::string* error) {
+    m_options = options;
+    if (m_options.segmentBytes < 4096) {
+        m_options.segmentBytes = 4096;
+    }
+
+    if (mkdir(m_options.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        if (error) *error = "cant create log dir " + m_options.dir + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!LoadEpoch(error) || !LoadSegments(error)) {
+        m_segments.clear();
+        return false;
+    }
+
+    // carry on in the newest segment
+    if (!m_segments.empty()) {
+        m_active    = m_segments.back();
+        m_activeIdx = open(PathFor(m_active->baseSeq, "idx").c_str(),
+                           O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_activeIdx < 0) {
+            if (error) *error = "cant open " + PathFor(m_active->baseSeq, "idx");
+            m_active.reset();
+            m_segments.clear();
+            return false;
+        }
+        m_sinceIndex = kIndexStride;   // next frame gets an entry
+    }
+
+    m_stopping = false;
+    m_failed   = false;
+    m_thread   = std::thread(&ChatLog::Run, this);
+    return true;
+}
+
+void ChatLog::Close() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_batchLock);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+    if (m_active) {
+        Seal();
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_segments.clear();
+}
+
+void ChatLog::Append(const BufferRef& frame, int64_t nowMs) {
+    if (m_failed) {
+        return;
+    }
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_batchLock);
+        wake = m_batch.empty();
+        m_batch.append(frame.Data(), frame.Size());
+        m_batchTimes.push_back(nowMs);
+    }
+    // the flusher only ever sleeps on an empty batch, so one wakeup per
+    // batch is enough (not one per message)
+    if (wake) {
+        m_wake.notify_one();
+    }
+}
+
+uint32_t ChatLog::SeqAtTime(int64_t timeMs) const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    uint32_t found = 0;
+    for (const auto& segment : m_segments) {
+        if (segment->lastSeq == 0) {
+            continue;
+        }
+        if (found == 0) {
+            found = segment->baseSeq;   // older than everything = all of it
+        }
+        for (const IndexEntry& entry : segment->index) {
+            if (entry.timeMs > timeMs) {
+                return found;
+            }
+            found = entry.seq;
+        }
+    }
+    return found;
+}
+
+uint32_t ChatLog::Spans(uint32_t fromSeq, uint32_t toSeq,
+                        std::vector<FileSpan>* out, uint32_t* firstSeq,
+                        const RoomFilter& keep) const {
+    // what we need from each segment, copied out so the lock isnt held
+    // over the mmap and header walk
+    struct Pick {
+        std::shared_ptr<Segment> segment;
+        size_t                   size;
+        uint32_t                 lastSeq;
+        size_t                   startFrom;   // index offsets to walk from
+        size_t                   endFrom;
+        bool                     cutStart;
+        bool                     cutEnd;
+    };
+    std::vector<Pick> picks;
+    uint32_t          first = 0;
+
+    auto entryFor = [](const Segment& segment, uint32_t seq) -> size_t {
+        // last entry at or before seq (the first one is always at 0)
+        size_t offset = 0;
+        for (auto it = segment.index.rbegin(); it != segment.index.rend(); ++it) {
+            if (it->seq <= seq) {
+                offset = it->offset;
+                break;
+            }
+        }
+        return offset;
+    };
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (const auto& segment : m_segments) {
+            if (segment->lastSeq == 0 || segment->lastSeq < fromSeq || segment->baseSeq > toSeq) {
+                continue;
+            }
+            Pick pick;
+            pick.segment   = segment;
+            pick.size      = segment->size;
+            pick.lastSeq   = segment->lastSeq;
+            pick.cutStart  = fromSeq > segment->baseSeq;
+            pick.cutEnd    = toSeq < segment->lastSeq;
+            pick.startFrom = pick.cutStart ? entryFor(*segment, fromSeq) : 0;
+            pick.endFrom   = pick.cutEnd ? entryFor(*segment, toSeq + 1) : 0;
+            if (first == 0) {
+                first = std::max(fromSeq, segment->baseSeq);
+            }
+            picks.push_back(pick);
+        }
+    }
+    if (picks.empty()) {
+        return 0;
+    }
+
+    uint32_t last = 0;
+    for (const Pick& pick : picks) {
+        size_t start = 0;
+        size_t end   = pick.size;
+        bool   ok    = true;
+        auto   add   = [&](size_t offset, size_t size) {
+            FileSpan span;
+            span.owner  = pick.segment;
+            span.fd     = pick.segment->fd;
+            span.offset = offset;
+            span.size   = size;
+            out->push_back(span);
+        };
+
+        if (pick.cutStart || pick.cutEnd || keep) {
+            // only the headers between an index entry and the seq we
+            // want get touched, the kernel pages in just those
+            void* map = mmap(nullptr, pick.size, PROT_READ, MAP_SHARED, pick.segment->fd, 0);
+            if (map == MAP_FAILED) {
+                break;
+            }
+            const char* bytes = static_cast<const char*>(map);
+            if (pick.cutStart) {
+                start = Locate(bytes, pick.size, pick.startFrom, fromSeq);
+            }
+            if (pick.cutEnd) {
+                end = Locate(bytes, pick.size, pick.endFrom, toSeq + 1);
+            }
+            ok = end > start;
+            if (ok && keep) {
+                // runs of wanted frames, each one span
+                size_t runStart = end;
+                size_t offset   = start;
+                while (offset < end) {
+                    FrameHeader header;
+                    DecodeFrameHeader(bytes + offset, &header);
+                    size_t next = offset + kFrameHeaderSize + header.length;
+                    if (keep(header.room, header.seq)) {
+                        runStart = std::min(runStart, offset);
+                    } else if (runStart < offset) {
+                        add(runStart, offset - runStart);
+                        runStart = end;
+                    }
+                    offset = next;
+                }
+                if (runStart < end) {
+                    add(runStart, end - runStart);
+                }
+            }
+            munmap(map, pick.size);
+        }
+        if (!ok || end <= start) {
+            break;
+        }
+
+        if (!keep) {
+            add(start, end - start);
+        }
+        last = pick.cutEnd ? toSeq : pick.lastSeq;
+    }
+
+    if (last != 0 && firstSeq) {
+        *firstSeq = first;
+    }
+    return last;
+}
+
+ChatLogStats ChatLog::Stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+// flusher -------------------------------------------------------------------
+
+void ChatLog::Run() {
+    std::string          writing;
+    std::vector<int64_t> times;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_batchLock);
+            m_wake.wait(lock, [this]() { return m_stopping || !m_batch.empty(); });
+            if (m_batch.empty()) {
+                return;   // stopping and nothing left
+            }
+            writing.swap(m_batch);
+            times.swap(m_batchTimes);
+        }
+
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        if (!m_failed) {
+            WriteBatch(writing, times);
+        }
+        writing.clear();
+        times.clear();
+
+        // group commit: give the next batch at least commitMs to fill up,
+        // so a busy room costs a few fsyncs a second, not one per message
+        std::unique_lock<std::mutex> lock(m_batchLock);
+        m_wake.wait_until(lock, started + std::chrono::milliseconds(m_options.commitMs),
+                          [this]() { return m_stopping; });
+    }
+}
+
+void ChatLog::WriteBatch(const std::string& data, const std::vector<int64_t>& times) {
+    std::vector<IndexEntry> entries;
+    size_t                  runStart = 0;   // where the current segment's bytes start in data
+    size_t                  offset   = 0;
+    size_t                  frame    = 0;
+    uint32_t                runLast  = 0;
+
+    while (offset + kFrameHeaderSize <= data.size()) {
+        FrameHeader header;
+        DecodeFrameHeader(data.data() + offset, &header);
+        size_t length = kFrameHeaderSize + header.length;
+
+        // full segment: finish it, next one starts with this frame
+        if (m_active) {
+            size_t used = m_active->size + (offset - runStart);
+            if (used > 0 && used + length > m_options.segmentBytes) {
+                if (!WriteRun(data.data() + runStart, offset - runStart, entries, runLast)) {
+                    return;
+                }
+                entries.clear();
+                runStart = offset;
+                Seal();
+            }
+        }
+        if (!m_active && !Roll(header.seq)) {
+            return;
+        }
+
+        size_t  inSegment = m_active->size + (offset - runStart);
+        int64_t when      = times[frame];
+        if (inSegment == 0 || m_sinceIndex >= kIndexStride ||
+            when - m_lastIndexTime >= kIndexIntervalMs) {
+            entries.push_back(IndexEntry{header.seq, static_cast<uint32_t>(inSegment), when});
+            m_sinceIndex    = 0;
+            m_lastIndexTime = when;
+        }
+        m_sinceIndex++;
+
+        runLast = header.seq;
+        offset += length;
+        frame++;
+    }
+
+    if (!WriteRun(data.data() + runStart, offset - runStart, entries, runLast)) {
+        return;
+    }
+    if (fdatasync(m_active->fd) != 0) {
+        Fail("fdatasync");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.frames += frame;
+    m_stats.bytes  += offset;
+    m_stats.batches++;
+}
+
+bool ChatLog::WriteRun(const char* data, size_t length, const std::vector<IndexEntry>& entries,
+                       uint32_t lastSeq) {
+    if (length == 0) {
+        return true;
+    }
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(m_active->fd, data + done, length - done,
+                           static_cast<off_t>(m_active->size + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            Fail("write " + PathFor(m_active->baseSeq, "log"));
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    if (!entries.empty()) {
+        size_t bytes = entries.size() * sizeof(IndexEntry);
+        if (write(m_activeIdx, entries.data(), bytes) != static_cast<ssize_t>(bytes)) {
+            Fail("write " + PathFor(m_active->baseSeq, "idx"));
+            return false;
+        }
+    }
+
+    // readers may use it from here on (the page cache has it, synced or not)
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_active->size   += length;
+    m_active->lastSeq = lastSeq;
+    m_active->index.insert(m_active->index.end(), entries.begin(), entries.end());
+    return true;
+}
+
+bool ChatLog::Roll(uint32_t baseSeq) {
+    std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+    segment->baseSeq = baseSeq;
+    segment->fd      = open(PathFor(baseSeq, "log").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    m_activeIdx      = open(PathFor(baseSeq, "idx").c_str(),
+                            O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (segment->fd < 0 || m_activeIdx < 0) {
+        Fail("create " + PathFor(baseSeq, "log"));
+        return false;
+    }
+
+    // the new names have to survive a crash too
+    int dir = open(m_options.dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+
+    m_active     = segment;
+    m_sinceIndex = 0;
+
+    std::vector<std::shared_ptr<Segment>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_segments.push_back(segment);
+        while (m_options.keepSegments > 0 && m_segments.size() > m_options.keepSegments) {
+            dropped.push_back(m_segments.front());
+            m_segments.erase(m_segments.begin());
+        }
+    }
+    // a client still being sent one of these keeps its fd, unlink is fine
+    for (const auto& old : dropped) {
+        unlink(PathFor(old->baseSeq, "log").c_str());
+        unlink(PathFor(old->baseSeq, "idx").c_str());
+    }
+    return true;
+}
+
+void ChatLog::Seal() {
+    fdatasync(m_active->fd);
+    if (m_activeIdx >= 0) {
+        fsync(m_activeIdx);
+        close(m_activeIdx);
+        m_activeIdx = -1;
+    }
+    m_active.reset();   // the fd stays open in m_segments for readers
+}
+
+void ChatLog::Fail(const std::string& what) {
+    std::string line = "log: " + what + " failed (" + std::strerror(errno) + "), logging stopped";
+    m_failed = true;
+    if (m_onError) {
+        m_onError(line);
+    }
+}
+
+// opening -------------------------------------------------------------------
+
+bool ChatLog::LoadEpoch(std::string* error) {
+    std::string path = m_options.dir + "/epoch";
+    m_epoch = 0;
+
+    if (FILE* file = std::fopen(path.c_str(), "r")) {
+        unsigned long value = 0;
+        if (std::fscanf(file, "%lu", &value) == 1) {
+            m_epoch = static_cast<uint32_t>(value);
+        }
+        std::fclose(file);
+    }
+    if (m_epoch != 0) {
+        return true;
+    }
+
+    std::random_device random;
+    do {
+        m_epoch = random();
+    } while (m_epoch == 0);
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        if (error) *error = "cant write " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    std::fprintf(file, "%lu\n", static_cast<unsigned long>(m_epoch));
+    std::fflush(file);
+    fsync(fileno(file));
+    std::fclose(file);
+    return true;
+}
+
+bool ChatLog::LoadSegments(std::string* error) {
+    DIR* dir = opendir(m_options.dir.c_str());
+    if (!dir) {
+        if (error) *error = "cant read log dir " + m_options.dir;
+        return false;
+    }
+    std::vector<uint32_t> bases;
+    while (dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        char*       end  = nullptr;
+        unsigned long base = std::strtoul(name, &end, 10);
+        if (end != name && std::strcmp(end, ".log") == 0 && base > 0) {
+            bases.push_back(static_cast<uint32_t>(base));
+        }
+    }
+    closedir(dir);
+    std::sort(bases.begin(), bases.end());
+
+    for (size_t i = 0; i < bases.size(); i++) {
+        bool newest = i + 1 == bases.size();
+
+        std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+        segment->baseSeq = bases[i];
+        segment->fd      = open(PathFor(bases[i], "log").c_str(),
+                                (newest ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+        struct stat st;
+        if (segment->fd < 0 || fstat(segment->fd, &st) != 0) {
+            if (error) *error = "cant open " + PathFor(bases[i], "log");
+            return false;
+        }
+        segment->size = static_cast<size_t>(st.st_size);
+
+        // index, whatever made it to disk of it
+        int idx = open(PathFor(bases[i], "idx").c_str(), O_RDONLY | O_CLOEXEC);
+        if (idx >= 0) {
+            IndexEntry entry;
+            while (read(idx, &entry, sizeof(entry)) == static_cast<ssize_t>(sizeof(entry))) {
+                segment->index.push_back(entry);
+            }
+            close(idx);
+        }
+
+        if (newest) {
+            // the only one a crash can have left half written
+            if (!Recover(*segment, error)) {
+                return false;
+            }
+        } else {
+            segment->lastSeq = segment->size > 0 ? bases[i + 1] - 1 : 0;
+        }
+        m_segments.push_back(segment);
+    }
+
+    m_openSeq = 0;
+    for (const auto& segment : m_segments) {
+        if (segment->lastSeq != 0) {
+            m_openSeq = segment->lastSeq;
+        }
+    }
+    return true;
+}
+
+// walks every frame of the newest segment, keeps the run of whole frames
+// with consecutive seqs and cuts the file (and its index) after it
+bool ChatLog::Recover(Segment& segment, std::string* error) {
+    size_t valid = 0;
+    uint32_t next = segment.baseSeq;
+
+    if (segment.size > 0) {
+        void* map = mmap(nullptr, segment.size, PROT_READ, MAP_SHARED, segment.fd, 0);
+        if (map == MAP_FAILED) {
+            if (error) *error = "cant map " + PathFor(segment.baseSeq, "log");
+            return false;
+        }
+        const char* bytes = static_cast<const char*>(map);
+        while (valid + kFrameHeaderSize <= segment.size) {
+            FrameHeader header;
+            DecodeFrameHeader(bytes + valid, &header);
+            size_t length = kFrameHeaderSize + header.length;
+            if (header.version != kProtocolVersion || header.seq != next ||
+                valid + length > segment.size) {
+                break;
+            }
+            valid += length;
+            next++;
+        }
+        munmap(map, segment.size);
+    }
+
+    if (valid < segment.size) {
+        if (ftruncate(segment.fd, static_cast<off_t>(valid)) != 0) {
+            if (error) *error = "cant truncate " + PathFor(segment.baseSeq, "log");
+            return false;
+        }
+        segment.size = valid;
+    }
+    segment.lastSeq = next > segment.baseSeq ? next - 1 : 0;
+
+    // index entries for frames that didnt survive
+    size_t keep = 0;
+    while (keep < segment.index.size() && segment.index[keep].offset < valid &&
+           segment.index[keep].seq < next) {
+        keep++;
+    }
+    if (keep < segment.index.size()) {
+        segment.index.resize(keep);
+        truncate(PathFor(segment.baseSeq, "idx").c_str(), static_cast<off_t>(keep * sizeof(IndexEntry)));
+    }
+    return true;
+}
+
+std::string ChatLog::PathFor(uint32_t baseSeq, const char* ext) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%010lu.%s", static_cast<unsigned long>(baseSeq), ext);
+    return m_options.dir + "/" + name;
+}
+
+// offset of the frame with this seq, walking headers from `from`
+// (or of the first one after it, size if it isnt there)
+size_t ChatLog::Locate(const char* map, size_t size, size_t from, uint32_t seq) {
+    size_t offset = from;
+    while (offset + kFrameHeaderSize <= size) {
+        FrameHeader header;
+        DecodeFrameHeader(map + offset, &header);
+        if (header.seq >= seq) {
+            return offset;
+        }
+        offset += kFrameHeaderSize + header.length;
+    }
+    return size;
+}
+
+#endif
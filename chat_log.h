@@ -0,0 +1,147 @@
+// chat_log.h
+// persistent, append-only log of every broadcast (server side, no wx).
+//
+// layout on disk, one directory:
+//   epoch                 the server epoch, kept across restarts so
+//                         clients can resume straight through one
+//   0000000001.log        segment: wire frames back to back, exactly the
+//                         bytes clients get. named after its first seq
+//   0000000001.idx        sparse index for it: {seq, offset, time} every
+//                         kIndexStride frames or kIndexIntervalMs, whichever
+//                         comes first
+//
+// writing is group commit: Append() only copies the frame into the
+// pending batch (no syscall, it runs under the publish lock), and one
+// flusher thread writes whatever piled up with a single write() and one
+// fdatasync. while that fsync runs the next batch collects, so the disk
+// sees a few syncs per second however busy the room is. a segment is
+// sealed (and synced with its index) once it reaches segmentBytes.
+//
+// reading: Spans() turns a seq range into (file, offset, length) pieces.
+// the index narrows it down to a stride, the rest is a header walk over an
+// mmap of the segment, and the bytes themselves go to the socket with
+// sendfile, never through user space (see FileSpan in chat_outqueue.h).
+//
+// posix only. Open() fails on windows and the server runs without it.
+
+#pragma once
+
+#include "chat_buffer.h"
+#include "chat_outqueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ChatLogOptions {
+    std::string dir;
+    size_t      segmentBytes = 64 * 1024 * 1024;
+    unsigned    keepSegments = 16;   // oldest get deleted past this, 0 = keep all
+    unsigned    commitMs     = 5;    // min gap between two fsyncs
+};
+
+struct ChatLogStats {
+    uint64_t frames  = 0;   // written to disk
+    uint64_t bytes   = 0;
+    uint64_t batches = 0;   // = fdatasync calls
+};
+
+class ChatLog {
+public:
+    static const uint32_t kIndexStride     = 64;
+    static const int64_t  kIndexIntervalMs = 1000;
+
+    ChatLog();
+    ~ChatLog();
+
+    // opens (or creates) the directory, cuts off a torn write at the end
+    // of the newest segment and starts the flusher thread
+    bool Open(const ChatLogOptions& options, std::string* error);
+    // writes out and syncs what's pending, then stops the thread
+    void Close();
+
+    // write problems, from the flusher thread
+    void SetErrorHandler(std::function<void(const std::string&)> handler) { m_onError = handler; }
+
+    uint32_t Epoch() const { return m_epoch; }
+    // newest seq on disk when Open() ran (the server carries on from here)
+    uint32_t LastSeq() const { return m_openSeq; }
+
+    // frame must be stamped with its seq. nowMs = wall clock (ms since 1970).
+    // publish path: a memcpy under a short lock
+    void Append(const BufferRef& frame, int64_t nowMs);
+
+    // oldest seq logged at or after timeMs, to index precision (so maybe up
+    // to a stride earlier). 0 = nothing that new
+    uint32_t SeqAtTime(int64_t timeMs) const;
+    // the frames fromSeq..toSeq that are already written, in order.
+    // *firstSeq = where the returned bytes start (later than fromSeq if
+    // older ones were deleted), return = last seq covered, 0 = none.
+    // with a room filter the header walk covers the whole range and only
+    // runs of frames it keeps (by room and seq) come back (more, smaller spans)
+    typedef std::function<bool(uint16_t room, uint32_t seq)> RoomFilter;
+    uint32_t Spans(uint32_t fromSeq, uint32_t toSeq,
+                   std::vector<FileSpan>* out, uint32_t* firstSeq,
+                   const RoomFilter& keep = RoomFilter()) const;
+
+    ChatLogStats Stats() const;
+
+    // wall clock, ms since 1970 (what Append and SeqAtTime want)
+    static int64_t NowMs();
+
+private:
+    struct IndexEntry {
+        uint32_t seq;
+        uint32_t offset;
+        int64_t  timeMs;
+    };
+    struct Segment;
+
+    void Run();
+    void WriteBatch(const std::string& data, const std::vector<int64_t>& times);
+    bool WriteRun(const char* data, size_t length, const std::vector<IndexEntry>& entries,
+                  uint32_t lastSeq);
+    bool Roll(uint32_t baseSeq);
+    void Seal();
+    void Fail(const std::string& what);
+
+    bool LoadSegments(std::string* error);
+    bool Recover(Segment& segment, std::string* error);
+    bool LoadEpoch(std::string* error);
+    std::string PathFor(uint32_t baseSeq, const char* ext) const;
+
+    static size_t Locate(const char* map, size_t size, size_t from, uint32_t seq);
+
+    ChatLogOptions m_options;
+    uint32_t       m_epoch;
+    uint32_t       m_openSeq;
+
+    // shared with readers: m_segments and what's in them
+    mutable std::mutex                    m_lock;
+    std::vector<std::shared_ptr<Segment>> m_segments;   // oldest first
+    ChatLogStats                          m_stats;
+
+    // pending batch (Append side), swapped out by the flusher
+    std::mutex              m_batchLock;
+    std::condition_variable m_wake;
+    std::string             m_batch;
+    std::vector<int64_t>    m_batchTimes;
+    bool                    m_stopping;
+
+    // flusher thread only
+    std::shared_ptr<Segment> m_active;
+    int                      m_activeIdx;          // .idx fd
+    uint32_t                 m_sinceIndex;         // frames since last entry
+    int64_t                  m_lastIndexTime;
+    std::atomic<bool>        m_failed;   // Append checks it
+
+    std::function<void(const std::string&)> m_onError;
+    std::thread                             m_thread;
+};
@@ -0,0 +1,87 @@
+// chat_mailbox.h
+// bounded lock-free multi-producer / single-consumer queue.
+// every worker owns one, any thread may push into it, only the owner pops.
+// (the classic sequence-numbered ring, slots are preallocated so pushing
+// never allocates)
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+template <typename T>
+class Mailbox {
+public:
+    // capacity gets rounded up to a power of two
+    explicit Mailbox(size_t capacity = 4096) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask  = size - 1;
+        m_slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_enqueue.store(0, std::memory_order_relaxed);
+        m_dequeue = 0;
+    }
+
+    // any thread. false = full, try again later
+    bool TryPush(T&& value) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        Slot*  slot;
+        for (;;) {
+            slot = &m_slots[pos & m_mask];
+            size_t   seq  = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->value = std::move(value);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // owner thread only. false = empty
+    bool TryPop(T& out) {
+        Slot*  slot = &m_slots[m_dequeue & m_mask];
+        size_t seq  = slot->seq.load(std::memory_order_acquire);
+        if (seq != m_dequeue + 1) {
+            return false;
+        }
+
+        out         = std::move(slot->value);
+        slot->value = T();   // drop refs held by the slot now, not on wrap-around
+        slot->seq.store(m_dequeue + m_mask + 1, std::memory_order_release);
+        m_dequeue++;
+        return true;
+    }
+
+private:
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        T                   value;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t                  m_mask;
+
+    // producers and the consumer on separate cache lines
+    alignas(64) std::atomic<size_t> m_enqueue;
+    alignas(64) size_t              m_dequeue;
+};
@@ -0,0 +1,304 @@
+// chat_metrics.cpp
+// histograms, snapshots and the two ways of printing them
+
+#include "chat_metrics.h"
+
+#include <cstdio>
+
+// histogram -------------------------------------------------------------------
+
+Histogram::Histogram()
+    : m_count(0),
+      m_sum(0),
+      m_max(0)
+{
+    for (auto& count : m_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t Histogram::BucketOf(uint64_t value) {
+    const uint64_t sub = uint64_t(1) << kSubBits;
+    if (value < sub) {
+        return static_cast<size_t>(value);   // small ones are exact
+    }
+    int msb   = 63;
+    while (!(value >> msb)) {
+        msb--;
+    }
+    int shift = msb - kSubBits;
+    return (size_t(shift + 1) << kSubBits) | size_t((value >> shift) & (sub - 1));
+}
+
+uint64_t Histogram::ValueOf(size_t bucket) {
+    const uint64_t sub = uint64_t(1) << kSubBits;
+    if (bucket < sub) {
+        return bucket;
+    }
+    int      shift = int(bucket >> kSubBits) - 1;
+    uint64_t low   = ((bucket & (sub - 1)) | sub) << shift;
+    return low + ((uint64_t(1) << shift) >> 1);
+}
+
+void Histogram::Record(uint64_t value) {
+    Bump(m_counts[BucketOf(value)], 1);
+    Bump(m_count, 1);
+    Bump(m_sum, value);
+    if (value > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(value, std::memory_order_relaxed);
+    }
+}
+
+void HistogramSnapshot::Merge(const Histogram& histogram) {
+    if (counts.empty()) {
+        counts.assign(Histogram::kBuckets, 0);
+    }
+    for (size_t i = 0; i < Histogram::kBuckets; i++) {
+        counts[i] += histogram.m_counts[i].load(std::memory_order_relaxed);
+    }
+    count += histogram.m_count.load(std::memory_order_relaxed);
+    sum   += histogram.m_sum.load(std::memory_order_relaxed);
+    uint64_t m = histogram.m_max.load(std::memory_order_relaxed);
+    max = m > max ? m : max;
+}
+
+uint64_t HistogramSnapshot::Quantile(double q) const {
+    // the bucket counts are read one by one, so their total can be a bit
+    // off from count. go by the buckets
+    uint64_t total = 0;
+    for (uint64_t c : counts) {
+        total += c;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * double(total) + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t value = Histogram::ValueOf(i);
+            return value < max ? value : max;
+        }
+    }
+    return max;
+}
+
+// snapshot --------------------------------------------------------------------
+
+void CounterValues::Add(const CounterValues& other) {
+    accepts          += other.accepts;
+    bytesIn          += other.bytesIn;
+    bytesOut         += other.bytesOut;
+    framesIn         += other.framesIn;
+    framesOut        += other.framesOut;
+    writes           += other.writes;
+    broadcasts       += other.broadcasts;
+    directs          += other.directs;
+    framesDropped    += other.framesDropped;
+    framesCoalesced  += other.framesCoalesced;
+    slowDisconnects  += other.slowDisconnects;
+    throttled        += other.throttled;
+    floodDisconnects += other.floodDisconnects;
+    pings            += other.pings;
+    timeouts         += other.timeouts;
+    packed           += other.packed;
+    unpacked         += other.unpacked;
+}
+
+void MetricsSnapshot::Add(const WorkerMetrics& metrics) {
+    CounterValues values;
+    values.accepts          = metrics.accepts.Get();
+    values.bytesIn          = metrics.bytesIn.Get();
+    values.bytesOut         = metrics.bytesOut.Get();
+    values.framesIn         = metrics.framesIn.Get();
+    values.framesOut        = metrics.framesOut.Get();
+    values.writes           = metrics.writes.Get();
+    values.broadcasts       = metrics.broadcasts.Get();
+    values.directs          = metrics.directs.Get();
+    values.framesDropped    = metrics.framesDropped.Get();
+    values.framesCoalesced  = metrics.framesCoalesced.Get();
+    values.slowDisconnects  = metrics.slowDisconnects.Get();
+    values.throttled        = metrics.throttled.Get();
+    values.floodDisconnects = metrics.floodDisconnects.Get();
+    values.pings            = metrics.pings.Get();
+    values.timeouts         = metrics.timeouts.Get();
+    values.packed           = metrics.packed.Get();
+    values.unpacked         = metrics.unpacked.Get();
+    workers.push_back(values);
+    total.Add(values);
+
+    readNs.Merge(metrics.readNs);
+    publishNs.Merge(metrics.publishNs);
+    mailboxNs.Merge(metrics.mailboxNs);
+    fanOutNs.Merge(metrics.fanOutNs);
+    queueBytes.Merge(metrics.queueBytes);
+}
+
+// printing --------------------------------------------------------------------
+
+namespace {
+
+void Metric(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void Sample(std::string& out, const std::string& name, double value) {
+    char num[64];
+    std::snprintf(num, sizeof(num), "%.9g", value);
+    out += name;
+    out += ' ';
+    out += num;
+    out += '\n';
+}
+
+// one counter, per worker
+void PerWorker(std::string& out, const MetricsSnapshot& snapshot, const char* name,
+               const char* help, uint64_t CounterValues::*field) {
+    Metric(out, name, "counter", help);
+    for (size_t i = 0; i < snapshot.workers.size(); i++) {
+        Sample(out, std::string(name) + "{worker=\"" + std::to_string(i) + "\"}",
+               double(snapshot.workers[i].*field));
+    }
+}
+
+// histograms go out as summaries: the quantiles are worked out here,
+// prometheus doesnt need our ~1000 buckets. scale turns ns into seconds
+void Summary(std::string& out, const char* name, const char* help,
+             const HistogramSnapshot& histogram, double scale) {
+    static const double kQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    Metric(out, name, "summary", help);
+    for (double q : kQuantiles) {
+        char label[32];
+        std::snprintf(label, sizeof(label), "{quantile=\"%g\"}", q);
+        Sample(out, name + std::string(label), double(histogram.Quantile(q)) * scale);
+    }
+    Sample(out, name + std::string("_sum"), double(histogram.sum) * scale);
+    Sample(out, name + std::string("_count"), double(histogram.count));
+}
+
+std::string Micros(uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.1fus", double(ns) / 1000.0);
+    return buf;
+}
+
+}  // namespace
+
+std::string PrometheusText(const MetricsSnapshot& snapshot) {
+    std::string out;
+    out.reserve(8 * 1024);
+
+    Metric(out, "chat_clients", "gauge", "Connected clients.");
+    Sample(out, "chat_clients", snapshot.clients);
+    Metric(out, "chat_rooms", "gauge", "Rooms with anybody in them (lobby included).");
+    Sample(out, "chat_rooms", double(snapshot.rooms));
+
+    PerWorker(out, snapshot, "chat_accepts_total", "Connections accepted.",
+              &CounterValues::accepts);
+    PerWorker(out, snapshot, "chat_bytes_in_total", "Bytes read from clients.",
+              &CounterValues::bytesIn);
+    PerWorker(out, snapshot, "chat_bytes_out_total", "Bytes written to clients.",
+              &CounterValues::bytesOut);
+    PerWorker(out, snapshot, "chat_frames_in_total", "Frames received from clients.",
+              &CounterValues::framesIn);
+    PerWorker(out, snapshot, "chat_frames_out_total", "Frames queued to clients.",
+              &CounterValues::framesOut);
+    PerWorker(out, snapshot, "chat_writes_total", "Write syscalls to clients.",
+              &CounterValues::writes);
+    PerWorker(out, snapshot, "chat_broadcasts_total", "Broadcasts fanned out.",
+              &CounterValues::broadcasts);
+    PerWorker(out, snapshot, "chat_directs_total", "Direct messages delivered.",
+              &CounterValues::directs);
+    PerWorker(out, snapshot, "chat_frames_dropped_total",
+              "Frames thrown away by the drop-oldest policy.", &CounterValues::framesDropped);
+    PerWorker(out, snapshot, "chat_frames_coalesced_total",
+              "Frames squashed by the coalesce policy.", &CounterValues::framesCoalesced);
+    PerWorker(out, snapshot, "chat_slow_disconnects_total",
+              "Clients dropped for not keeping up.", &CounterValues::slowDisconnects);
+    PerWorker(out, snapshot, "chat_throttled_total",
+              "Frames over a client's rate limit (delayed, dropped or kicked for).",
+              &CounterValues::throttled);
+    PerWorker(out, snapshot, "chat_flood_disconnects_total",
+              "Clients dropped for flooding.", &CounterValues::floodDisconnects);
+    PerWorker(out, snapshot, "chat_pings_total", "Pings sent to quiet clients.",
+              &CounterValues::pings);
+    PerWorker(out, snapshot, "chat_timeouts_total",
+              "Clients dropped for not saying Hello or not answering a Ping.",
+              &CounterValues::timeouts);
+    PerWorker(out, snapshot, "chat_packed_total",
+              "Broadcasts deflated for clients that asked for it.", &CounterValues::packed);
+    PerWorker(out, snapshot, "chat_unpacked_total", "Deflate frames from clients.",
+              &CounterValues::unpacked);
+
+    Metric(out, "chat_log_frames_total", "counter", "Frames written to the persistent log.");
+    Sample(out, "chat_log_frames_total", double(snapshot.logFrames));
+    Metric(out, "chat_log_fsyncs_total", "counter", "fdatasync calls by the persistent log.");
+    Sample(out, "chat_log_fsyncs_total", double(snapshot.logBatches));
+
+    Summary(out, "chat_read_seconds", "One readable event: recv plus handling its frames.",
+            snapshot.readNs, 1e-9);
+    Summary(out, "chat_publish_seconds", "Stamping and posting one broadcast to all workers.",
+            snapshot.publishNs, 1e-9);
+    Summary(out, "chat_mailbox_seconds", "Publish until a worker picks the broadcast up.",
+            snapshot.mailboxNs, 1e-9);
+    Summary(out, "chat_fanout_seconds", "One broadcast to one worker's members of the room.",
+            snapshot.fanOutNs, 1e-9);
+    Summary(out, "chat_queue_bytes", "A client's outbound backlog after queueing to it.",
+            snapshot.queueBytes, 1.0);
+    return out;
+}
+
+std::string MetricsSummary(const MetricsSnapshot& now, const MetricsSnapshot& before) {
+    double seconds = double(now.takenMs - before.takenMs) / 1000.0;
+    if (seconds <= 0) {
+        seconds = 1;
+    }
+    auto rate = [&](uint64_t CounterValues::*field) {
+        return double(now.total.*field - before.total.*field) / seconds;
+    };
+
+    char line[256];
+    std::string out;
+    std::snprintf(line, sizeof(line), "%d clients, %zu rooms\n", now.clients, now.rooms);
+    out += line;
+    std::snprintf(line, sizeof(line), "in  %.0f msg/s  %.1f KB/s\n",
+                  rate(&CounterValues::framesIn), rate(&CounterValues::bytesIn) / 1024.0);
+    out += line;
+    std::snprintf(line, sizeof(line), "out %.0f frames/s in %.0f writes/s  %.1f KB/s\n",
+                  rate(&CounterValues::framesOut), rate(&CounterValues::writes),
+                  rate(&CounterValues::bytesOut) / 1024.0);
+    out += line;
+    out += "fan-out p50 " + Micros(now.fanOutNs.Quantile(0.5)) +
+           "  p99 " + Micros(now.fanOutNs.Quantile(0.99)) + "\n";
+    out += "read    p50 " + Micros(now.readNs.Quantile(0.5)) +
+           "  p99 " + Micros(now.readNs.Quantile(0.99)) + "\n";
+    out += "mailbox p50 " + Micros(now.mailboxNs.Quantile(0.5)) +
+           "  p99 " + Micros(now.mailboxNs.Quantile(0.99)) + "\n";
+    std::snprintf(line, sizeof(line), "queue p99 %llu bytes, %llu dropped, %llu coalesced, %llu kicked",
+                  (unsigned long long)now.queueBytes.Quantile(0.99),
+                  (unsigned long long)now.total.framesDropped,
+                  (unsigned long long)now.total.framesCoalesced,
+                  (unsigned long long)now.total.slowDisconnects);
+    out += line;
+    std::snprintf(line, sizeof(line), "\nflood %llu throttled, %llu kicked; %llu pings, %llu timed out; "
+                  "%llu deflated, %llu inflated",
+                  (unsigned long long)now.total.throttled,
+                  (unsigned long long)now.total.floodDisconnects,
+                  (unsigned long long)now.total.pings,
+                  (unsigned long long)now.total.timeouts,
+                  (unsigned long long)now.total.packed,
+                  (unsigned long long)now.total.unpacked);
+    out += line;
+    return out;
+}
@@ -0,0 +1,165 @@
+// chat_metrics.h
+// hot path counters and latency histograms for the server (no wx).
+//
+// every worker owns one WorkerMetrics and is the only thread writing it,
+// so bumping a counter is a plain load + store on a cache line nobody
+// else writes (no locked add, no sharing). readers (the metrics endpoint,
+// the gui, /stats) load whatever is there, a snapshot can be a count or
+// two behind and thats fine.
+//
+// Histogram is HDR style: log-linear buckets, each power of two split
+// into 2^kSubBits linear steps, so any value lands within ~6% of its true
+// size and recording is a shift and an add. merging snapshots is adding
+// bucket counts, so per-worker histograms sum up to server-wide quantiles.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// single writer, any number of readers
+class Counter {
+public:
+    void Add(uint64_t n = 1) {
+        m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    uint64_t Get() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+class Histogram {
+public:
+    static const int    kSubBits = 4;
+    static const size_t kBuckets = (64 - kSubBits + 1) << kSubBits;
+
+    Histogram();
+
+    // single writer
+    void Record(uint64_t value);
+
+    static size_t   BucketOf(uint64_t value);
+    // middle of the values that land in bucket i
+    static uint64_t ValueOf(size_t bucket);
+
+private:
+    friend struct HistogramSnapshot;
+
+    static void Bump(std::atomic<uint64_t>& a, uint64_t n) {
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> m_counts[kBuckets];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;
+    uint64_t              count = 0;
+    uint64_t              sum   = 0;
+    uint64_t              max   = 0;
+
+    void     Merge(const Histogram& histogram);
+    // q in 0..1, 0 when empty
+    uint64_t Quantile(double q) const;
+    double   Mean() const { return count ? double(sum) / double(count) : 0.0; }
+};
+
+// one worker's numbers
+struct WorkerMetrics {
+    Counter accepts;
+    Counter bytesIn;
+    Counter bytesOut;
+    Counter framesIn;      // whole frames clients sent us
+    Counter framesOut;     // frames queued to clients (1 broadcast to 100 = 100)
+    Counter writes;        // send/sendmsg/sendfile calls it took to write them
+    Counter broadcasts;    // broadcasts fanned out here
+    Counter directs;       // direct messages delivered here
+
+    // slow consumer policies (see SlowConsumerPolicy)
+    Counter framesDropped;
+    Counter framesCoalesced;
+    Counter slowDisconnects;
+
+    // flood protection (see RateLimiter)
+    Counter throttled;          // frames over a limit, whatever the policy did
+    Counter floodDisconnects;
+
+    // dead peer detection
+    Counter pings;
+    Counter timeouts;           // no Hello, or no answer to a Ping
+
+    // compression (see chat_compress.h)
+    Counter packed;             // broadcasts deflated, once each however many got it
+    Counter unpacked;           // Deflate frames from clients
+
+    Histogram readNs;       // one readable event: recvs + every frame in them
+    Histogram publishNs;    // ChatServer::Publish for a line one of ours said
+    Histogram mailboxNs;    // published -> this worker picked it up
+    Histogram fanOutNs;     // one broadcast to all our members of the room
+    Histogram queueBytes;   // a client's backlog right after queueing to it
+};
+
+// plain copy of the counters (one worker, or the sum)
+struct CounterValues {
+    uint64_t accepts          = 0;
+    uint64_t bytesIn          = 0;
+    uint64_t bytesOut         = 0;
+    uint64_t framesIn         = 0;
+    uint64_t framesOut        = 0;
+    uint64_t writes           = 0;
+    uint64_t broadcasts       = 0;
+    uint64_t directs          = 0;
+    uint64_t framesDropped    = 0;
+    uint64_t framesCoalesced  = 0;
+    uint64_t slowDisconnects  = 0;
+    uint64_t throttled        = 0;
+    uint64_t floodDisconnects = 0;
+    uint64_t pings            = 0;
+    uint64_t timeouts         = 0;
+    uint64_t packed           = 0;
+    uint64_t unpacked         = 0;
+
+    void Add(const CounterValues& other);
+};
+
+// everything at one point in time, see ChatServer::Metrics()
+struct MetricsSnapshot {
+    int64_t takenMs = 0;   // steady clock
+
+    int      clients    = 0;
+    size_t   rooms      = 0;
+    uint64_t logFrames  = 0;
+    uint64_t logBatches = 0;
+
+    std::vector<CounterValues> workers;
+    CounterValues              total;
+
+    // all workers merged
+    HistogramSnapshot readNs;
+    HistogramSnapshot publishNs;
+    HistogramSnapshot mailboxNs;
+    HistogramSnapshot fanOutNs;
+    HistogramSnapshot queueBytes;
+
+    // adds one worker's share
+    void Add(const WorkerMetrics& metrics);
+};
+
+// prometheus text exposition format (what GET /metrics returns)
+std::string PrometheusText(const MetricsSnapshot& snapshot);
+// a few lines for people: rates since `before`, quantiles since start
+std::string MetricsSummary(const MetricsSnapshot& now, const MetricsSnapshot& before);
+
+// the clock the timings use
+inline int64_t MetricsNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,267 @@
+// chat_net.cpp
+// socket shim implementation
+
+#include "chat_net.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#endif
+
+bool SetNonBlocking(socket_t sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool SetNoDelay(socket_t sock) {
+    int on = 1;
+    return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+                      reinterpret_cast<const char*>(&on), sizeof(on)) == 0;
+}
+
+void SetCork(socket_t sock, bool on) {
+#ifdef TCP_CORK
+    int value = on ? 1 : 0;
+    setsockopt(sock, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#else
+    (void)sock;
+    (void)on;
+#endif
+}
+
+void CloseSocket(socket_t sock) {
+    if (sock == CHAT_INVALID_SOCKET) {
+        return;
+    }
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+int SocketError() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool IsWouldBlock(int err) {
+#ifdef _WIN32
+    return err == WSAEWOULDBLOCK;
+#else
+    return err == EAGAIN || err == EWOULDBLOCK;
+#endif
+}
+
+long SendGather(socket_t sock, const IoSlice* slices, size_t count) {
+    if (count == 1) {
+        // the usual live case, plain send is the cheaper syscall
+        return static_cast<long>(send(sock, slices[0].data, static_cast<int>(slices[0].size),
+                                      CHAT_SEND_FLAGS));
+    }
+#ifdef _WIN32
+    std::vector<WSABUF> bufs(count);
+    for (size_t i = 0; i < count; i++) {
+        bufs[i].buf = const_cast<CHAR*>(slices[i].data);
+        bufs[i].len = static_cast<ULONG>(slices[i].size);
+    }
+    DWORD sent = 0;
+    if (WSASend(sock, bufs.data(), static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) != 0) {
+        return -1;
+    }
+    return static_cast<long>(sent);
+#else
+    // on the stack, sendmsg refuses more than IOV_MAX anyway
+    iovec iov[kMaxIoSlices];
+    if (count > kMaxIoSlices) {
+        count = kMaxIoSlices;
+    }
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<char*>(slices[i].data);
+        iov[i].iov_len  = slices[i].size;
+    }
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = count;
+    return static_cast<long>(sendmsg(sock, &msg, CHAT_SEND_FLAGS));
+#endif
+}
+
+long SendFileRange(socket_t sock, int fd, uint64_t offset, size_t size) {
+#if defined(__linux__)
+    // page cache -> socket, the bytes never come up to us
+    off_t off = static_cast<off_t>(offset);
+    return static_cast<long>(sendfile(sock, fd, &off, size));
+#elif !defined(_WIN32)
+    char    buf[64 * 1024];
+    ssize_t got = pread(fd, buf, size < sizeof(buf) ? size : sizeof(buf), static_cast<off_t>(offset));
+    if (got <= 0) {
+        errno = got == 0 ? EIO : errno;
+        return -1;
+    }
+    return static_cast<long>(send(sock, buf, static_cast<size_t>(got), CHAT_SEND_FLAGS));
+#else
+    (void)sock;
+    (void)fd;
+    (void)offset;
+    (void)size;
+    WSASetLastError(WSAEOPNOTSUPP);
+    return -1;
+#endif
+}
+
+bool HaveReusePort() {
+#ifdef SO_REUSEPORT
+    return true;
+#else
+    return false;
+#endif
+}
+
+socket_t OpenListener(int port, bool reusePort, std::string* error, bool loopbackOnly) {
+    socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == CHAT_INVALID_SOCKET) {
+        if (error) *error = "socket() failed";
+        return CHAT_INVALID_SOCKET;
+    }
+
+    // so a restarted server can grab the port right away
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+               reinterpret_cast<const char*>(&on), sizeof(on));
+#ifdef SO_REUSEPORT
+    if (reusePort) {
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT,
+                   reinterpret_cast<const char*>(&on), sizeof(on));
+    }
+#else
+    (void)reusePort;
+#endif
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    addr.sin_port        = htons(static_cast<unsigned short>(port));
+
+    if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        if (error) *error = "cant bind port " + std::to_string(port) + " (busy?)";
+        CloseSocket(sock);
+        return CHAT_INVALID_SOCKET;
+    }
+
+    if (listen(sock, SOMAXCONN) != 0 || !SetNonBlocking(sock)) {
+        if (error) *error = "listen() failed";
+        CloseSocket(sock);
+        return CHAT_INVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+std::string PeerAddress(socket_t sock) {
+    sockaddr_in addr;
+    socklen_t   len = sizeof(addr);
+    std::memset(&addr, 0, sizeof(addr));
+    if (getpeername(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+        return "?";
+    }
+
+    char ip[INET_ADDRSTRLEN] = "?";
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+// wakeup ------------------------------------------------------------------
+
+#ifdef __linux__
+
+Wakeup::Wakeup()
+    : m_readFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+}
+
+Wakeup::~Wakeup() {
+    CloseSocket(m_readFd);
+}
+
+void Wakeup::Signal() {
+    uint64_t one = 1;
+    ssize_t  n   = write(m_readFd, &one, sizeof(one));
+    (void)n;  // counter already non-zero is fine too
+}
+
+void Wakeup::Drain() {
+    uint64_t count;
+    ssize_t  n = read(m_readFd, &count, sizeof(count));
+    (void)n;
+}
+
+#else
+
+// udp socket bound to loopback and connected to itself, so sending a byte
+// makes it readable. works with WSAPoll where pipes dont
+Wakeup::Wakeup()
+    : m_readFd(socket(AF_INET, SOCK_DGRAM, 0))
+{
+    if (m_readFd == CHAT_INVALID_SOCKET) {
+        return;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+
+    socklen_t len = sizeof(addr);
+    if (bind(m_readFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        getsockname(m_readFd, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+        connect(m_readFd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+        !SetNonBlocking(m_readFd)) {
+        CloseSocket(m_readFd);
+        m_readFd = CHAT_INVALID_SOCKET;
+    }
+}
+
+Wakeup::~Wakeup() {
+    CloseSocket(m_readFd);
+}
+
+void Wakeup::Signal() {
+    char one = 1;
+    send(m_readFd, &one, 1, 0);
+}
+
+void Wakeup::Drain() {
+    char buf[64];
+    while (recv(m_readFd, buf, sizeof(buf), 0) > 0) {
+    }
+}
+
+#endif
@@ -0,0 +1,99 @@
+// chat_net.h
+// tiny socket shim so the server core builds on windows and linux
+// (no wx in here, the headless server uses it too)
+
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define CHAT_INVALID_SOCKET INVALID_SOCKET
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define CHAT_INVALID_SOCKET (-1)
+#endif
+
+// dont let a dead peer kill us with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define CHAT_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define CHAT_SEND_FLAGS 0
+#endif
+
+// socket helpers ----------------------------------------------------------
+bool SetNonBlocking(socket_t sock);
+void CloseSocket(socket_t sock);
+int  SocketError();               // errno / WSAGetLastError
+bool IsWouldBlock(int err);       // EAGAIN/EWOULDBLOCK/WSAEWOULDBLOCK
+
+// Nagle off: we batch in user space already, whatever we write should go
+// out now, not wait for the last segment's ack
+bool SetNoDelay(socket_t sock);
+// TCP_CORK (linux only, no-op elsewhere): hold partial segments while a
+// flush takes several syscalls, off = send what's left right away
+void SetCork(socket_t sock, bool on);
+
+// one piece of a gathered write
+struct IoSlice {
+    const char* data;
+    size_t      size;
+};
+
+// most slices one SendGather takes, the kernel's IOV_MAX (1024 on linux).
+// more than that are left for the next call
+#ifdef IOV_MAX
+const size_t kMaxIoSlices = IOV_MAX;
+#else
+const size_t kMaxIoSlices = 1024;
+#endif
+
+// several buffers in one syscall (sendmsg / WSASend), otherwise like send():
+// bytes taken, or -1 with SocketError() set
+long SendGather(socket_t sock, const IoSlice* slices, size_t count);
+
+// size bytes of an open file, from offset, straight to the socket
+// (sendfile on linux, pread + send on other unixes, not on windows).
+// like send(): bytes taken, or -1 with SocketError() set
+long SendFileRange(socket_t sock, int fd, uint64_t offset, size_t size);
+
+// opens a non-blocking tcp listener on every interface (ipv4), or only
+// on 127.0.0.1 with loopbackOnly.
+// reusePort = SO_REUSEPORT so several listeners can share the port and the
+// kernel load balances between them (ignored where it doesnt exist)
+socket_t OpenListener(int port, bool reusePort, std::string* error, bool loopbackOnly = false);
+
+// true if OpenListener(..., true, ...) really shares the port here
+bool HaveReusePort();
+
+// "ip:port" of the other end
+std::string PeerAddress(socket_t sock);
+
+// used to poke a loop that is sleeping in Poller::Wait from another thread.
+// eventfd on linux, a udp socket talking to itself everywhere else
+class Wakeup {
+public:
+    Wakeup();
+    ~Wakeup();
+
+    bool     Ok() const { return m_readFd != CHAT_INVALID_SOCKET; }
+    socket_t Fd() const { return m_readFd; }
+
+    void Signal();   // safe from any thread
+    void Drain();    // call from the loop when the fd is readable
+
+private:
+    Wakeup(const Wakeup&) = delete;
+    Wakeup& operator=(const Wakeup&) = delete;
+
+    socket_t m_readFd;
+};
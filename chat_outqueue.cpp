@@ -0,0 +1,197 @@
+// chat_outqueue.cpp
+// OutboundQueue + the slow consumer policies
+
+#include "chat_outqueue.h"
+
+#include "chat_protocol.h"
+
+#include <string>
+#include <utility>
+
+namespace {
+
+const size_t kFirstRing = 16;
+// a ring bigger than this is let go on Clear (a slow client's backlog)
+const size_t kKeepRing  = 1024;
+
+}  // namespace
+
+OutboundQueue::PushResult OutboundQueue::Push(const BufferRef& frame, size_t highWater,
+                                              SlowConsumerPolicy policy, size_t* affected) {
+    if (affected) *affected = 0;
+
+    if (m_bytes + frame.Size() <= highWater) {
+        PushBack(Chunk{frame, 0, nullptr});
+        m_bytes += frame.Size();
+        return Queued;
+    }
+
+    if (policy == SlowConsumerPolicy::Disconnect) {
+        return Overflow;
+    }
+
+    size_t first = FirstDroppable();
+    size_t count = 0;
+
+    if (policy == SlowConsumerPolicy::DropOldest) {
+        // oldest first until the new one fits (file spans stay, they
+        // arent what's eating the memory, kept frames stay too)
+        size_t i = first;
+        for (; i < m_count && m_bytes + frame.Size() > highWater; i++) {
+            if (At(i).Droppable()) {
+                m_bytes -= At(i).buf.Size();
+                At(i) = Chunk();
+                count++;
+            }
+        }
+        Squeeze(i);
+    } else {
+        // swap every untouched frame for one short notice
+        for (size_t i = first; i < m_count; i++) {
+            if (At(i).Droppable()) {
+                m_bytes -= At(i).buf.Size();
+                At(i) = Chunk();
+                count++;
+            }
+        }
+        Squeeze(m_count);
+
+        if (count > 0) {
+            std::string note = "(" + std::to_string(count) +
+                               " messages skipped, connection too slow)";
+            BufferRef notice = EncodeSharedFrame(FrameType::System, 0, note);
+            m_bytes += notice.Size();
+            PushBack(Chunk{notice, 0, nullptr});
+        }
+    }
+
+    if (affected) *affected = count;
+
+    // a single frame bigger than the whole limit still goes out, alone,
+    // otherwise that client could never receive it
+    PushBack(Chunk{frame, 0, nullptr});
+    m_bytes += frame.Size();
+
+    if (count == 0) {
+        return Queued;
+    }
+    return policy == SlowConsumerPolicy::DropOldest ? DroppedOldest : Coalesced;
+}
+
+void OutboundQueue::PushFile(const FileSpan& span) {
+    if (span.size == 0) {
+        return;
+    }
+    PushBack(Chunk{BufferRef(), 0, std::make_shared<const FileSpan>(span)});
+}
+
+void OutboundQueue::PushKept(const BufferRef& frame) {
+    Chunk chunk{frame, 0, nullptr};
+    chunk.kept = true;
+    PushBack(std::move(chunk));
+    m_bytes += frame.Size();
+}
+
+size_t OutboundQueue::Gather(IoSlice* out, size_t max) const {
+    size_t count = 0;
+    for (size_t i = 0; i < m_count && count < max; i++) {
+        const Chunk& chunk = At(i);
+        if (chunk.file) {
+            break;
+        }
+        out[count].data = chunk.buf.Data() + chunk.offset;
+        out[count].size = chunk.buf.Size() - chunk.offset;
+        count++;
+    }
+    return count;
+}
+
+const FileSpan* OutboundQueue::HeadFile(uint64_t* offset, size_t* size) const {
+    const Chunk& head = At(0);
+    if (!head.file) {
+        return nullptr;
+    }
+    *offset = head.file->offset + head.offset;
+    *size   = head.file->size - head.offset;
+    return head.file.get();
+}
+
+void OutboundQueue::Consume(size_t n) {
+    while (n > 0) {
+        Chunk& head = At(0);
+        size_t left = head.Size() - head.offset;
+        size_t used = n < left ? n : left;
+        if (!head.file) {
+            m_bytes -= used;
+        }
+        if (n < left) {
+            head.offset += n;
+            return;
+        }
+        n -= left;
+        PopFront();
+    }
+}
+
+void OutboundQueue::Clear() {
+    if (m_ring.size() > kKeepRing) {
+        std::vector<Chunk>().swap(m_ring);
+    } else {
+        Truncate(0);
+    }
+    m_head  = 0;
+    m_count = 0;
+    m_bytes = 0;
+}
+
+size_t OutboundQueue::FirstDroppable() const {
+    if (m_count > 0 && At(0).offset > 0) {
+        return 1;
+    }
+    return 0;
+}
+
+void OutboundQueue::PushBack(Chunk&& chunk) {
+    if (m_count == m_ring.size()) {
+        // full: unroll into one twice the size
+        std::vector<Chunk> bigger(m_ring.empty() ? kFirstRing : m_ring.size() * 2);
+        for (size_t i = 0; i < m_count; i++) {
+            bigger[i] = std::move(At(i));
+        }
+        m_ring.swap(bigger);
+        m_head = 0;
+    }
+    At(m_count) = std::move(chunk);
+    m_count++;
+}
+
+void OutboundQueue::PopFront() {
+    At(0) = Chunk();   // drops the buffer ref now, not when the slot comes round again
+    m_head = (m_head + 1) & (m_ring.size() - 1);
+    m_count--;
+}
+
+void OutboundQueue::Squeeze(size_t end) {
+    // keepers slide up against end, the holes end up in front of them and
+    // the head just skips past. costs what was looked at, not the queue
+    size_t to = end;
+    for (size_t from = end; from-- > 0;) {
+        Chunk& chunk = At(from);
+        if (!chunk.buf && !chunk.file) {
+            continue;
+        }
+        to--;
+        if (to != from) {
+            At(to) = std::move(chunk);
+        }
+    }
+    m_head   = (m_head + to) & (m_ring.size() - 1);
+    m_count -= to;
+}
+
+void OutboundQueue::Truncate(size_t n) {
+    for (size_t i = n; i < m_count; i++) {
+        At(i) = Chunk();
+    }
+    m_count = n;
+}
@@ -0,0 +1,104 @@
+// chat_outqueue.h
+// bounded per-connection queue of frames waiting to be written.
+//
+// the server never blocks on a client socket: frames go in here and get
+// drained whenever the socket is writable. if a client cant keep up (think
+// a pi on bad wifi) the queue hits its high-water mark and a policy decides
+// what gives, instead of the whole room waiting on that one client.
+//
+// the frames sit in a ring that only ever grows (doubling), so once a
+// client has seen its busiest moment queueing and writing allocate
+// nothing. Clear() hands a big ring back, idle slots dont hoard it.
+
+#pragma once
+
+#include "chat_buffer.h"
+#include "chat_net.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class SlowConsumerPolicy {
+    DropOldest,   // throw away the oldest queued frames to make room
+    Coalesce,     // squash everything queued into one "you missed N" notice
+    Disconnect    // kick the client
+};
+
+// bytes that sit in a file (the persistent log, see chat_log.h) and go to
+// the socket with sendfile instead of through a buffer. owner keeps the
+// file open while a span still points into it
+struct FileSpan {
+    std::shared_ptr<const void> owner;
+    int                         fd;
+    uint64_t                    offset;
+    size_t                      size;
+};
+
+class OutboundQueue {
+public:
+    enum PushResult {
+        Queued,          // fit under the limit
+        DroppedOldest,   // fit after dropping *affected old frames
+        Coalesced,       // fit after squashing *affected frames into a notice
+        Overflow         // Disconnect policy and no room, nothing was queued
+    };
+
+    OutboundQueue() : m_head(0), m_count(0), m_bytes(0) {}
+
+    PushResult Push(const BufferRef& frame, size_t highWater,
+                    SlowConsumerPolicy policy, size_t* affected);
+    // file bytes cost no memory, so they dont count against highWater
+    // and the slow consumer policies never drop them
+    void PushFile(const FileSpan& span);
+    // a frame the client is waiting on (the end of a /history answer).
+    // counts in Bytes(), but the policies never drop or squash it
+    void PushKept(const BufferRef& frame);
+
+    bool   Empty() const { return m_count == 0; }
+    size_t Bytes() const { return m_bytes; }    // in memory, not yet written
+    size_t Count() const { return m_count; }
+
+    // the next (up to max) queued frames as slices, for one SendGather.
+    // returns how many were filled in, stops at a file span (0 if the
+    // head is one, send that with HeadFile() instead)
+    size_t Gather(IoSlice* out, size_t max) const;
+    // the unsent rest of the head chunk, if its a file span
+    const FileSpan* HeadFile(uint64_t* offset, size_t* size) const;
+    // n bytes from the front made it to the kernel (may span frames)
+    void Consume(size_t n);
+
+    void Clear();
+
+private:
+    // a queued frame (or file span) and how much of it is already written
+    struct Chunk {
+        BufferRef                 buf;
+        size_t                    offset;
+        std::shared_ptr<const FileSpan> file;   // set = file chunk, buf is empty
+        bool                      kept = false;   // PushKept, policies skip it
+
+        size_t Size() const { return file ? file->size : buf.Size(); }
+        bool   Droppable() const { return !file && !kept; }
+    };
+
+    // frames past a partly written head are fair game, the head isnt
+    // (cutting it would corrupt the stream)
+    size_t FirstDroppable() const;
+
+    // ring plumbing, i counts from the head
+    Chunk&       At(size_t i) { return m_ring[(m_head + i) & (m_ring.size() - 1)]; }
+    const Chunk& At(size_t i) const { return m_ring[(m_head + i) & (m_ring.size() - 1)]; }
+    void         PushBack(Chunk&& chunk);
+    void         PopFront();
+    // keeps the first n, releases the rest
+    void         Truncate(size_t n);
+    // drops the emptied chunks (policy victims) among the first end
+    void         Squeeze(size_t end);
+
+    std::vector<Chunk> m_ring;    // size is 0 or a power of two
+    size_t             m_head;
+    size_t             m_count;
+    size_t             m_bytes;
+};
@@ -0,0 +1,152 @@
+// chat_poller.cpp
+// epoll / poll backends for Poller
+
+#include "chat_poller.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+
+Poller::Poller()
+    : m_epollFd(epoll_create1(EPOLL_CLOEXEC))
+{
+}
+
+Poller::~Poller() {
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+    }
+}
+
+bool Poller::Ok() const {
+    return m_epollFd >= 0;
+}
+
+bool Poller::Add(socket_t sock, uint64_t token, bool) {
+    epoll_event ev;
+    ev.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.u64 = token;
+    return epoll_ctl(m_epollFd, EPOLL_CTL_ADD, sock, &ev) == 0;
+}
+
+bool Poller::Modify(socket_t, uint64_t, bool, bool) {
+    // nothing to do, EPOLLIN and EPOLLOUT are always armed (see header)
+    return true;
+}
+
+void Poller::Remove(socket_t sock) {
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, sock, nullptr);
+}
+
+int Poller::Wait(PollEvent* out, int maxEvents, int timeoutMs) {
+    const int kBatch = 256;
+    epoll_event events[kBatch];
+    if (maxEvents > kBatch) {
+        maxEvents = kBatch;
+    }
+
+    int n = epoll_wait(m_epollFd, events, maxEvents, timeoutMs);
+    if (n < 0) {
+        return 0;   // EINTR, just go around again
+    }
+
+    for (int i = 0; i < n; i++) {
+        uint32_t e = events[i].events;
+        out[i].token    = events[i].data.u64;
+        out[i].readable = (e & (EPOLLIN | EPOLLRDHUP)) != 0;
+        out[i].writable = (e & EPOLLOUT) != 0;
+        out[i].hangup   = (e & (EPOLLERR | EPOLLHUP)) != 0;
+    }
+    return n;
+}
+
+#else
+
+#ifdef _WIN32
+typedef WSAPOLLFD chat_pollfd;
+#define chat_poll WSAPoll
+#else
+typedef pollfd chat_pollfd;
+#define chat_poll poll
+#endif
+
+Poller::Poller() {
+}
+
+Poller::~Poller() {
+}
+
+bool Poller::Ok() const {
+    return true;
+}
+
+bool Poller::Add(socket_t sock, uint64_t token, bool wantWrite) {
+    if (m_index.count(sock)) {
+        return false;
+    }
+    m_index[sock] = m_entries.size();
+    m_entries.push_back(Entry{sock, token, wantWrite, true});
+    return true;
+}
+
+bool Poller::Modify(socket_t sock, uint64_t token, bool wantWrite, bool wantRead) {
+    auto it = m_index.find(sock);
+    if (it == m_index.end()) {
+        return false;
+    }
+    m_entries[it->second].token     = token;
+    m_entries[it->second].wantWrite = wantWrite;
+    m_entries[it->second].wantRead  = wantRead;
+    return true;
+}
+
+void Poller::Remove(socket_t sock) {
+    auto it = m_index.find(sock);
+    if (it == m_index.end()) {
+        return;
+    }
+
+    // swap the last entry into the hole
+    size_t slot = it->second;
+    m_index.erase(it);
+    if (slot != m_entries.size() - 1) {
+        m_entries[slot] = m_entries.back();
+        m_index[m_entries[slot].sock] = slot;
+    }
+    m_entries.pop_back();
+}
+
+int Poller::Wait(PollEvent* out, int maxEvents, int timeoutMs) {
+    std::vector<chat_pollfd> fds(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        fds[i].fd      = m_entries[i].sock;
+        fds[i].events  = static_cast<short>((m_entries[i].wantRead ? POLLIN : 0) |
+                                            (m_entries[i].wantWrite ? POLLOUT : 0));
+        fds[i].revents = 0;
+    }
+
+    int n = chat_poll(fds.data(), static_cast<unsigned long>(fds.size()), timeoutMs);
+    if (n <= 0) {
+        return 0;
+    }
+
+    int count = 0;
+    for (size_t i = 0; i < fds.size() && count < maxEvents; i++) {
+        short e = fds[i].revents;
+        if (e == 0) {
+            continue;
+        }
+        out[count].token    = m_entries[i].token;
+        out[count].readable = (e & POLLIN) != 0;
+        out[count].writable = (e & POLLOUT) != 0;
+        out[count].hangup   = (e & (POLLERR | POLLHUP)) != 0;
+        count++;
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,58 @@
+// chat_poller.h
+// readiness poller for the server loop
+// linux = edge-triggered epoll, everything else = poll()/WSAPoll
+
+#pragma once
+
+#include "chat_net.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// one ready socket. token is whatever was passed to Add()
+struct PollEvent {
+    uint64_t token;
+    bool     readable;
+    bool     writable;
+    bool     hangup;    // error or peer closed
+};
+
+class Poller {
+public:
+    Poller();
+    ~Poller();
+
+    bool Ok() const;
+
+    // edge-triggered on epoll: after a readable/writable event the caller has
+    // to keep going until it hits would-block, or it wont hear about it again.
+    // wantWrite and wantRead only matter for the poll() fallback, epoll
+    // always watches both since an edge only fires when something changes.
+    // poll() is level triggered: a socket with unread bytes the caller
+    // isnt going to read yet (a paused flooder) has to say !wantRead, or
+    // Wait never sleeps
+    bool Add(socket_t sock, uint64_t token, bool wantWrite = false);
+    bool Modify(socket_t sock, uint64_t token, bool wantWrite, bool wantRead = true);
+    void Remove(socket_t sock);
+
+    // returns how many events were written to out (0 on timeout)
+    int Wait(PollEvent* out, int maxEvents, int timeoutMs);
+
+private:
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+#ifdef __linux__
+    int m_epollFd;
+#else
+    struct Entry {
+        socket_t sock;
+        uint64_t token;
+        bool     wantWrite;
+        bool     wantRead;
+    };
+    std::vector<Entry>                  m_entries;
+    std::unordered_map<socket_t, size_t> m_index;   // sock -> m_entries slot
+#endif
+};
@@ -0,0 +1,224 @@
+// chat_presence.cpp
+// batching presence changes into deltas, and the snapshot for joiners
+
+#include "chat_presence.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// room to spare under kMaxFramePayload
+const size_t kMaxPresencePayload = 60 * 1024;
+
+// packs records into as many Presence frames as it takes
+class PresenceFrames {
+public:
+    PresenceFrames(std::vector<BufferRef>* out, uint16_t room, uint32_t version, uint8_t flags)
+        : m_out(out), m_room(room), m_version(version), m_flags(flags)
+    {
+        m_payload += static_cast<char>(m_flags);
+    }
+
+    void Add(PresenceKind kind, uint32_t id, const std::string& name) {
+        if (m_payload.size() > 1 && m_payload.size() + 6 + name.size() > kMaxPresencePayload) {
+            Finish();
+        }
+        AppendPresenceRecord(&m_payload, kind, id, name);
+    }
+
+    // a reset goes out even with nobody in it, the client has to hear it
+    void Finish() {
+        if (m_payload.size() > 1 || (m_flags & kPresenceReset)) {
+            BufferRef frame = EncodeSharedFrame(FrameType::Presence, 0, m_payload);
+            SetFrameRoom(frame, m_room);
+            SetFrameSeq(frame, m_version);
+            m_out->push_back(frame);
+        }
+        m_flags &= static_cast<uint8_t>(~kPresenceReset);
+        m_payload.assign(1, static_cast<char>(m_flags));
+    }
+
+private:
+    std::vector<BufferRef>* m_out;
+    uint16_t                m_room;
+    uint32_t                m_version;
+    uint8_t                 m_flags;
+    std::string             m_payload;
+};
+
+}  // namespace
+
+PresenceHub::PresenceHub()
+    : m_intervalMs(100),
+      m_running(false),
+      m_version(0),
+      m_snapshotStale(true)
+{
+}
+
+PresenceHub::~PresenceHub() {
+    Stop();
+}
+
+void PresenceHub::Start(uint32_t intervalMs, Publish publish) {
+    Stop();
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_intervalMs = intervalMs;
+    m_publish    = publish;
+    m_changes.clear();
+    m_typing.clear();
+    m_typingSeen.clear();
+    m_roster.clear();
+    m_snapshotStale = true;
+    m_running       = true;
+    m_thread        = std::thread(&PresenceHub::Run, this);
+}
+
+void PresenceHub::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_running = false;
+    }
+    m_wake.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void PresenceHub::Joined(uint32_t id, const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_running) {
+        return;
+    }
+    bool wake = m_changes.empty() && m_typing.empty();
+    m_changes[id] = Change{PresenceKind::Join, name};
+    if (wake) {
+        m_wake.notify_one();
+    }
+}
+
+void PresenceHub::Left(uint32_t id) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_running) {
+        return;
+    }
+    bool wake = m_changes.empty() && m_typing.empty();
+    auto it   = m_changes.find(id);
+    if (it != m_changes.end() && it->second.kind == PresenceKind::Join) {
+        m_changes.erase(it);   // came and went inside one batch, nobody saw them
+        return;
+    }
+    m_changes[id] = Change{PresenceKind::Leave, std::string()};
+    if (wake) {
+        m_wake.notify_one();
+    }
+}
+
+void PresenceHub::Renamed(uint32_t id, const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_running) {
+        return;
+    }
+    bool wake = m_changes.empty() && m_typing.empty();
+    auto it   = m_changes.find(id);
+    if (it != m_changes.end() && it->second.kind == PresenceKind::Join) {
+        it->second.name = name;   // still a join, just with the new name
+        return;
+    }
+    m_changes[id] = Change{PresenceKind::Rename, name};
+    if (wake) {
+        m_wake.notify_one();
+    }
+}
+
+void PresenceHub::Typing(uint32_t id, uint16_t room) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_running) {
+        return;
+    }
+    uint64_t key = (uint64_t(room) << 32) | id;
+    if (!m_typingSeen.insert(key).second) {
+        return;   // already in this batch
+    }
+    bool wake = m_changes.empty() && m_typing.empty();
+    m_typing.push_back(key);
+    if (wake) {
+        m_wake.notify_one();
+    }
+}
+
+std::vector<BufferRef> PresenceHub::Snapshot() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_running) {
+        return std::vector<BufferRef>();
+    }
+    if (m_snapshotStale) {
+        m_snapshot.clear();
+        PresenceFrames frames(&m_snapshot, kAllRooms, m_version,
+                              kPresenceSnapshot | kPresenceReset);
+        for (const auto& entry : m_roster) {
+            frames.Add(PresenceKind::Join, entry.first, entry.second);
+        }
+        frames.Finish();
+        m_snapshotStale = false;
+    }
+    return m_snapshot;
+}
+
+void PresenceHub::Run() {
+    std::unique_lock<std::mutex> lock(m_lock);
+    for (;;) {
+        m_wake.wait(lock, [this]() {
+            return !m_running || !m_changes.empty() || !m_typing.empty();
+        });
+        if (!m_running) {
+            return;
+        }
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+        // the roster moves on and the delta gets built in one go, under
+        // the lock, so a snapshot is always exactly "up to version N"
+        std::vector<BufferRef> frames;
+        uint32_t               version = ++m_version;
+        if (!m_changes.empty()) {
+            PresenceFrames delta(&frames, kAllRooms, version, 0);
+            for (const auto& change : m_changes) {
+                if (change.second.kind == PresenceKind::Leave) {
+                    m_roster.erase(change.first);
+                } else {
+                    m_roster[change.first] = change.second.name;
+                }
+                delta.Add(change.second.kind, change.first, change.second.name);
+            }
+            delta.Finish();
+            m_changes.clear();
+            m_snapshotStale = true;
+        }
+
+        // typing goes to its room only, one run of frames per room
+        std::sort(m_typing.begin(), m_typing.end());
+        for (size_t i = 0; i < m_typing.size();) {
+            uint16_t       room = static_cast<uint16_t>(m_typing[i] >> 32);
+            PresenceFrames typing(&frames, room, version, 0);
+            for (; i < m_typing.size() && static_cast<uint16_t>(m_typing[i] >> 32) == room; i++) {
+                typing.Add(PresenceKind::Typing, static_cast<uint32_t>(m_typing[i]), std::string());
+            }
+            typing.Finish();
+        }
+        m_typing.clear();
+        m_typingSeen.clear();
+
+        // posting can wait on a full mailbox, and that worker may be
+        // asking us for a snapshot right now. not under the lock
+        lock.unlock();
+        for (const BufferRef& frame : frames) {
+            m_publish(frame);
+        }
+        lock.lock();
+
+        // give the next batch the rest of the interval to fill up
+        m_wake.wait_until(lock, started + std::chrono::milliseconds(m_intervalMs),
+                          [this]() { return !m_running; });
+    }
+}
@@ -0,0 +1,82 @@
+// chat_presence.h
+// who is online and who is typing, for the clients. (server side, no wx)
+//
+// workers report joins, leaves, renames and typing here as they happen,
+// and that only notes them down. a thread wakes on the first one, sends
+// everything that changed as one delta (Presence frames, see
+// chat_protocol.h) to every worker, then waits out the interval before
+// the next batch, the same group commit the log does with fsyncs. so a
+// mass reconnect of 5000 clients is a few deltas per client, not 5000
+// frames per client. inside a batch the changes are squashed per client
+// (join then rename = one join, join then leave = nothing at all).
+//
+// a client that finishes its Hello gets Snapshot(): the whole roster,
+// tagged with the version it is current to. deltas carry their version
+// too, so it can throw away any that the snapshot already had.
+
+#pragma once
+
+#include "chat_buffer.h"
+#include "chat_protocol.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class PresenceHub {
+public:
+    // hands a delta frame to every worker, from the hub's thread
+    typedef std::function<void(const BufferRef&)> Publish;
+
+    PresenceHub();
+    ~PresenceHub();
+
+    void Start(uint32_t intervalMs, Publish publish);
+    void Stop();
+
+    // any thread, no-ops while stopped
+    void Joined(uint32_t id, const std::string& name);
+    void Left(uint32_t id);
+    void Renamed(uint32_t id, const std::string& name);
+    void Typing(uint32_t id, uint16_t room);
+
+    // the whole roster as Presence frames, any thread. built at most once
+    // per batch however many clients ask. empty while stopped
+    std::vector<BufferRef> Snapshot();
+
+private:
+    PresenceHub(const PresenceHub&) = delete;
+    PresenceHub& operator=(const PresenceHub&) = delete;
+
+    struct Change {
+        PresenceKind kind;
+        std::string  name;
+    };
+
+    void Run();
+
+    uint32_t                m_intervalMs;
+    Publish                 m_publish;
+    std::thread             m_thread;
+    bool                    m_running;    // guarded by m_lock
+    std::mutex              m_lock;
+    std::condition_variable m_wake;
+
+    // the batch being collected
+    std::unordered_map<uint32_t, Change> m_changes;    // id -> where it ended up
+    std::vector<uint64_t>                m_typing;     // room << 32 | id
+    std::unordered_set<uint64_t>         m_typingSeen;
+
+    // everything sent so far
+    std::map<uint32_t, std::string> m_roster;   // id -> name, in id order
+    uint32_t                        m_version;  // batches sent
+    std::vector<BufferRef>          m_snapshot;
+    bool                            m_snapshotStale;
+};
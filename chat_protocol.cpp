@@ -0,0 +1,264 @@
+// chat_protocol.cpp
+// frame encode + the incremental decoder
+
+#include "chat_protocol.h"
+
+#include <cstring>
+#include <utility>
+
+namespace {
+
+void Put32(char* p, uint32_t v) {
+    p[0] = static_cast<char>(v >> 24);
+    p[1] = static_cast<char>(v >> 16);
+    p[2] = static_cast<char>(v >> 8);
+    p[3] = static_cast<char>(v);
+}
+
+void Put16(char* p, uint16_t v) {
+    p[0] = static_cast<char>(v >> 8);
+    p[1] = static_cast<char>(v);
+}
+
+uint32_t Get32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) |
+           (uint32_t(u[2]) << 8)  |  uint32_t(u[3]);
+}
+
+uint16_t Get16(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>((u[0] << 8) | u[1]);
+}
+
+}  // namespace
+
+void EncodeFrameHeader(const FrameHeader& header, char* out) {
+    Put32(out, header.length);
+    out[4] = static_cast<char>(header.version);
+    out[5] = static_cast<char>(header.type);
+    Put16(out + 6, header.room);
+    Put32(out + 8, header.sender);
+    Put32(out + 12, header.seq);
+}
+
+void DecodeFrameHeader(const char* in, FrameHeader* header) {
+    header->length  = Get32(in);
+    header->version = static_cast<uint8_t>(in[4]);
+    header->type    = static_cast<FrameType>(static_cast<uint8_t>(in[5]));
+    header->room    = Get16(in + 6);
+    header->sender  = Get32(in + 8);
+    header->seq     = Get32(in + 12);
+}
+
+std::string EncodeFrame(FrameType type, uint32_t sender,
+                        const char* payload, size_t length) {
+    FrameHeader header;
+    header.length  = static_cast<uint32_t>(length);
+    header.version = kProtocolVersion;
+    header.type    = type;
+    header.room    = kLobbyRoom;
+    header.sender  = sender;
+    header.seq     = 0;
+
+    std::string out(kFrameHeaderSize + length, '\0');
+    EncodeFrameHeader(header, &out[0]);
+    if (length > 0) {
+        std::memcpy(&out[kFrameHeaderSize], payload, length);
+    }
+    return out;
+}
+
+std::string EncodeHello(uint32_t seq, uint32_t epoch, uint8_t codecs) {
+    char payload[5];
+    Put32(payload, epoch);
+    payload[4] = static_cast<char>(codecs);
+    std::string out = EncodeFrame(FrameType::Hello, 0, payload, codecs ? 5 : 4);
+    Put32(&out[12], seq);
+    return out;
+}
+
+BufferRef EncodeSharedHello(uint32_t seq, uint32_t epoch, uint8_t codecs) {
+    char payload[5];
+    Put32(payload, epoch);
+    payload[4] = static_cast<char>(codecs);
+    BufferRef frame = EncodeSharedFrame(FrameType::Hello, 0, payload, codecs ? 5 : 4);
+    SetFrameSeq(frame, seq);
+    return frame;
+}
+
+uint32_t HelloEpoch(const FrameView& frame) {
+    if (frame.header.length < 4) {
+        return 0;
+    }
+    return Get32(frame.payload);
+}
+
+uint8_t HelloCodecs(const FrameView& frame) {
+    if (frame.header.length < 5) {
+        return 0;
+    }
+    return static_cast<uint8_t>(frame.payload[4]);
+}
+
+void AppendPresenceRecord(std::string* payload, PresenceKind kind, uint32_t id,
+                          const std::string& name) {
+    size_t length = name.size() < 255 ? name.size() : 255;
+    char   head[6];
+    head[0] = static_cast<char>(kind);
+    Put32(head + 1, id);
+    head[5] = static_cast<char>(length);
+    payload->append(head, sizeof(head));
+    payload->append(name, 0, length);
+}
+
+bool DecodePresence(const FrameView& frame, uint8_t* flags,
+                    std::vector<PresenceRecord>* records) {
+    if (frame.header.length < 1) {
+        return false;
+    }
+    const char* p   = frame.payload;
+    const char* end = p + frame.header.length;
+    *flags = static_cast<uint8_t>(*p++);
+    while (p < end) {
+        if (end - p < 6) {
+            return false;
+        }
+        PresenceRecord record;
+        record.kind   = static_cast<PresenceKind>(p[0]);
+        record.id     = Get32(p + 1);
+        size_t length = static_cast<uint8_t>(p[5]);
+        p += 6;
+        if (static_cast<size_t>(end - p) < length) {
+            return false;
+        }
+        record.name.assign(p, length);
+        p += length;
+        records->push_back(std::move(record));
+    }
+    return true;
+}
+
+BufferRef EncodeSharedFrame(FrameType type, uint32_t sender,
+                            const char* head, size_t headLength,
+                            const char* tail, size_t tailLength) {
+    size_t length = headLength + tailLength;
+
+    FrameHeader header;
+    header.length  = static_cast<uint32_t>(length);
+    header.version = kProtocolVersion;
+    header.type    = type;
+    header.room    = kLobbyRoom;
+    header.sender  = sender;
+    header.seq     = 0;
+
+    BufferRef buf = BufferRef::Allocate(kFrameHeaderSize + length);
+    char*     out = buf.MutableData();
+    EncodeFrameHeader(header, out);
+    if (headLength > 0) {
+        std::memcpy(out + kFrameHeaderSize, head, headLength);
+    }
+    if (tailLength > 0) {
+        std::memcpy(out + kFrameHeaderSize + headLength, tail, tailLength);
+    }
+    return buf;
+}
+
+uint32_t FrameSeq(const BufferRef& frame) {
+    return Get32(frame.Data() + 12);
+}
+
+void SetFrameSeq(BufferRef& frame, uint32_t seq) {
+    Put32(frame.MutableData() + 12, seq);
+}
+
+uint16_t FrameRoom(const BufferRef& frame) {
+    return Get16(frame.Data() + 6);
+}
+
+void SetFrameRoom(BufferRef& frame, uint16_t room) {
+    Put16(frame.MutableData() + 6, room);
+}
+
+// decoder -----------------------------------------------------------------
+
+FrameDecoder::FrameDecoder(size_t initialCapacity)
+    : m_buf(initialCapacity),
+      m_head(0),
+      m_tail(0),
+      m_last(0)
+{
+}
+
+char* FrameDecoder::WritePtr(size_t minSpace) {
+    if (m_buf.size() - m_tail >= minSpace) {
+        return m_buf.data() + m_tail;
+    }
+
+    // slide the leftover partial frame down to the front first, usually
+    // thats only a few bytes and it saves growing
+    if (m_head > 0) {
+        size_t left = m_tail - m_head;
+        if (left > 0) {
+            std::memmove(m_buf.data(), m_buf.data() + m_head, left);
+        }
+        m_head = 0;
+        m_tail = left;
+    }
+
+    if (m_buf.size() - m_tail < minSpace) {
+        m_buf.resize(m_tail + minSpace);
+    }
+    return m_buf.data() + m_tail;
+}
+
+void FrameDecoder::Commit(size_t n) {
+    m_tail += n;
+}
+
+FrameDecoder::Result FrameDecoder::Next(FrameView* out) {
+    size_t avail = m_tail - m_head;
+    if (avail < kFrameHeaderSize) {
+        if (avail == 0) {
+            // empty, rewind for free
+            m_head = m_tail = 0;
+        }
+        return NeedMore;
+    }
+
+    const char* p = m_buf.data() + m_head;
+    DecodeFrameHeader(p, &out->header);
+
+    if (out->header.version != kProtocolVersion) {
+        m_error = "bad protocol version " + std::to_string(out->header.version);
+        return Bad;
+    }
+    if (out->header.length > kMaxFramePayload) {
+        m_error = "frame too big (" + std::to_string(out->header.length) + " bytes)";
+        return Bad;
+    }
+
+    size_t total = kFrameHeaderSize + out->header.length;
+    if (avail < total) {
+        // make sure the rest of this frame will fit in one go
+        if (m_buf.size() - m_head < total) {
+            WritePtr(total - avail);
+        }
+        return NeedMore;
+    }
+
+    out->payload = m_buf.data() + m_head + kFrameHeaderSize;
+    m_head += total;
+    m_last  = total;
+    return Ready;
+}
+
+void FrameDecoder::Reset() {
+    m_head = m_tail = m_last = 0;
+    m_error.clear();
+}
+
+void FrameDecoder::SwapBuffer(std::vector<char>& buf) {
+    m_buf.swap(buf);
+    m_head = m_tail = m_last = 0;
+}
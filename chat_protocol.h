@@ -0,0 +1,232 @@
+// chat_protocol.h
+// wire format shared by the server and every client.
+//
+// every message is one frame: a fixed 16 byte header then the payload.
+// all numbers are big endian (network order).
+//
+//   0      4        5      6       8        12    16
+//   +------+--------+------+-------+--------+-----+---------------+
+//   |length|version | type | room  | sender | seq | payload ...   |
+//   +------+--------+------+-------+--------+-----+---------------+
+//
+//   length  = payload bytes (header not counted)
+//   room    = room a broadcast went to (kLobbyRoom, kAllRooms, or one a
+//             client made with /join). the server picks it, clients can
+//             ignore it: the room name is in the text too
+//   sender  = client id that said it, 0 = the server
+//   seq     = server sequence number of a broadcast, 0 = not sequenced
+//
+// sequence numbers let a client that lost its connection pick up where it
+// left off. the handshake right after connect:
+//
+//   server -> client  Hello  seq = newest broadcast, payload = epoch
+//   client -> server  Hello  seq = last one it saw,  payload = epoch
+//
+// the server's Hello may carry one more byte, the codecs it can do, and
+// the client's one more, the codec it picked (kCodec* in chat_compress.h,
+// none = plain frames only). after that either side may wrap any frame
+// in a Deflate frame, see chat_compress.h.
+//
+// the epoch is random per server start. a new client, or one coming back
+// to a restarted server (epoch changed), hasnt seen anything there yet and
+// answers with seq 0, which gets it the server's recent history as a
+// catch-up. answering with the seq from the server's Hello skips that
+// (chat_bench does, it only wants live traffic). the server holds
+// broadcasts back until the client's Hello, then replays whatever came
+// after that seq and carries on live, all in seq order.
+//
+// a client can ask for more later with a "/history ..." chat line (see
+// README). the answer is the frames again, seqs and all, then a System
+// frame that has a seq (newest + 1): only that one ends it, so until then
+// repeats are what the client asked for, not something to drop.
+//
+// direct (private) messages skip the rooms, the seqs and the history:
+//
+//   client -> server  Direct  sender = who it's for (client id), or 0 and
+//                             the payload starts with their name or id
+//                             and a space ("User12 hi there")
+//   server -> client  Direct  sender = who it's from (0 = the server),
+//                             payload = "[from -> to] text"
+//
+// the sender gets the same frame back as its receipt. nobody else sees
+// it, and if it doesnt arrive (the other side is gone) its gone.
+//
+// presence (who is online, who is typing) goes out in batches, never a
+// frame per event:
+//
+//   client -> server  Typing    empty payload, "i'm typing" (in the room
+//                               they talk in)
+//   server -> client  Presence  seq = presence version, payload = a flags
+//                               byte, then records: u8 kind, u32 id,
+//                               u8 name length, name
+//
+// the server collects joins, leaves, renames and typing for ~100 ms and
+// sends what changed as one delta (typing ones only to that room, header
+// room says which). right after its Hello a client gets a snapshot of
+// everyone (kPresenceSnapshot, the first frame also kPresenceReset =
+// forget what you had), then only deltas newer than the snapshot count.
+//
+// heartbeats: whoever hasnt heard from the other side for a while sends a
+// Ping and the other side answers with a Pong (both empty). no answer in
+// time = the peer is gone (power cut, wifi dropped) even if tcp hasnt
+// noticed, so the connection is dropped. anything received counts as
+// proof of life, not just a Pong.
+//
+// tcp doesnt keep message boundaries, so the reader side feeds raw bytes
+// into a FrameDecoder and gets whole frames back out, however the bytes
+// were split or glued together on the way.
+
+#pragma once
+
+#include "chat_buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const uint8_t  kProtocolVersion = 2;
+const size_t   kFrameHeaderSize = 16;
+const uint32_t kMaxFramePayload = 64 * 1024;   // anything bigger is a bad peer
+
+// room ids. every client starts in the lobby, server announcements go
+// to everyone whatever room they're in
+const uint16_t kLobbyRoom = 0;
+const uint16_t kAllRooms  = 0xffff;
+
+enum class FrameType : uint8_t {
+    Chat     = 1,   // chat text (utf-8)
+    System   = 2,   // server notice, e.g. the welcome line
+    Exit     = 3,   // server -> client: you asked to leave, bye
+    Hello    = 4,   // resume handshake, both ways (see above)
+    Direct   = 5,   // private line, see below
+    Presence = 6,   // server -> client: who is online / typing, see below
+    Typing   = 7,   // client -> server: user is typing
+    Ping     = 8,   // either way: still there? (see below)
+    Pong     = 9,   // the answer, same seq as the Ping
+    Deflate  = 10,  // another frame, compressed (chat_compress.h)
+};
+
+enum class PresenceKind : uint8_t {
+    Join   = 1,   // online now, with their name
+    Leave  = 2,
+    Rename = 3,   // new name
+    Typing = 4,   // no name, look them up
+};
+
+// Presence frame flags (first payload byte)
+const uint8_t kPresenceSnapshot = 1;   // part of a full roster
+const uint8_t kPresenceReset    = 2;   // first frame of one, start over
+
+struct PresenceRecord {
+    PresenceKind kind;
+    uint32_t     id;
+    std::string  name;
+};
+
+struct FrameHeader {
+    uint32_t  length;
+    uint8_t   version;
+    FrameType type;
+    uint16_t  room;
+    uint32_t  sender;
+    uint32_t  seq;
+};
+
+// a decoded frame. payload points into the decoder's buffer (no copy), so
+// its only good until the next WritePtr() on that decoder
+struct FrameView {
+    FrameHeader header;
+    const char* payload;
+
+    std::string Text() const { return std::string(payload, header.length); }
+};
+
+// header <-> bytes. out/in must have kFrameHeaderSize bytes
+void EncodeFrameHeader(const FrameHeader& header, char* out);
+void DecodeFrameHeader(const char* in, FrameHeader* header);
+
+// header + payload in one string, ready to write to a socket
+std::string EncodeFrame(FrameType type, uint32_t sender,
+                        const char* payload, size_t length);
+inline std::string EncodeFrame(FrameType type, uint32_t sender, const std::string& payload) {
+    return EncodeFrame(type, sender, payload.data(), payload.size());
+}
+
+// Hello frame for either side of the handshake. codecs 0 = leave the
+// byte off, like a client from before compression
+std::string EncodeHello(uint32_t seq, uint32_t epoch, uint8_t codecs = 0);
+BufferRef   EncodeSharedHello(uint32_t seq, uint32_t epoch, uint8_t codecs = 0);
+// epoch out of a Hello payload, 0 if its malformed
+uint32_t HelloEpoch(const FrameView& frame);
+// the codecs byte, 0 if there is none
+uint8_t  HelloCodecs(const FrameView& frame);
+
+// same frame, but encoded straight into a SharedBuffer so it can be queued
+// to any number of sockets without copying. the payload is head + tail
+// glued together (tail can be empty), so "[name] " + text never has to be
+// built as a temporary string first
+BufferRef EncodeSharedFrame(FrameType type, uint32_t sender,
+                            const char* head, size_t headLength,
+                            const char* tail = nullptr, size_t tailLength = 0);
+inline BufferRef EncodeSharedFrame(FrameType type, uint32_t sender, const std::string& payload) {
+    return EncodeSharedFrame(type, sender, payload.data(), payload.size());
+}
+
+// one record onto a Presence payload (which starts with the flags byte).
+// names get cut at 255 bytes
+void AppendPresenceRecord(std::string* payload, PresenceKind kind, uint32_t id,
+                          const std::string& name);
+// false = malformed
+bool DecodePresence(const FrameView& frame, uint8_t* flags,
+                    std::vector<PresenceRecord>* records);
+
+// the seq of an encoded frame. SetFrameSeq only before the buffer is handed
+// out (the server stamps it just before publishing)
+uint32_t FrameSeq(const BufferRef& frame);
+void     SetFrameSeq(BufferRef& frame, uint32_t seq);
+// same for the room
+uint16_t FrameRoom(const BufferRef& frame);
+void     SetFrameRoom(BufferRef& frame, uint16_t room);
+
+// incremental per-connection frame reader.
+// socket reads go straight into WritePtr(), then Next() hands back every
+// complete frame sitting in the buffer. partial frames just wait for more.
+class FrameDecoder {
+public:
+    enum Result {
+        NeedMore,   // no full frame buffered yet
+        Ready,      // *out is filled in
+        Bad         // garbage on the wire, drop the connection
+    };
+
+    explicit FrameDecoder(size_t initialCapacity = 4096);
+
+    // pointer to at least minSpace free bytes at the end of the buffer.
+    // invalidates any FrameView handed out before
+    char* WritePtr(size_t minSpace);
+    size_t WriteSpace() const { return m_buf.size() - m_tail; }
+    // n bytes were written at WritePtr()
+    void Commit(size_t n);
+
+    Result Next(FrameView* out);
+    // the frame Next() just handed out goes back, the next Next() returns
+    // it again. only before anything else touches the decoder
+    void   PutBack() { m_head -= m_last; m_last = 0; }
+
+    void   Reset();
+    size_t Buffered() const { return m_tail - m_head; }
+    size_t Capacity() const { return m_buf.size(); }
+    // trade storage with buf, only while nothing is buffered. the server
+    // lends connections a pooled read buffer this way and takes it back
+    // once they've been read dry, so idle ones hold no buffer at all
+    void   SwapBuffer(std::vector<char>& buf);
+    const std::string& ErrorText() const { return m_error; }
+
+private:
+    std::vector<char> m_buf;
+    size_t            m_head;   // first unread byte
+    size_t            m_tail;   // one past the last written byte
+    size_t            m_last;   // size of the frame Next() returned last
+    std::string       m_error;
+};
@@ -0,0 +1,135 @@
+// chat_ratelimit.cpp
+// token buckets and the per worker limiter
+
+#include "chat_ratelimit.h"
+
+#include <cstdlib>
+
+bool ParseRateLimit(const char* text, RateLimit* limit) {
+    char* end  = nullptr;
+    long  rate = std::strtol(text, &end, 10);
+    if (end == text || rate < 0 || rate > 0x7fffffffL) {
+        return false;
+    }
+    long burst = rate * 2;
+    if (*end == ':') {
+        const char* start = end + 1;
+        burst = std::strtol(start, &end, 10);
+        if (end == start || burst <= 0 || burst > 0x7fffffffL) {
+            return false;
+        }
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    limit->rate  = static_cast<uint32_t>(rate);
+    limit->burst = static_cast<uint32_t>(burst > 0 ? burst : 1);
+    return true;
+}
+
+// bucket ----------------------------------------------------------------------
+
+void TokenBucket::Fill(const RateLimit& limit, int64_t nowMs) {
+    m_level   = int64_t(limit.burst) * 1000;
+    m_stampMs = nowMs;
+}
+
+void TokenBucket::Refill(const RateLimit& limit, int64_t nowMs) {
+    int64_t elapsed = nowMs - m_stampMs;
+    if (elapsed <= 0) {
+        return;
+    }
+    m_stampMs = nowMs;
+    int64_t full = int64_t(limit.burst) * 1000;
+    // long idle: dont multiply our way into an overflow
+    m_level = elapsed >= full / limit.rate + 1 ? full : m_level + elapsed * limit.rate;
+    if (m_level > full) {
+        m_level = full;
+    }
+}
+
+int64_t TokenBucket::WaitMs(const RateLimit& limit, uint64_t cost) const {
+    int64_t missing = Cost(limit, cost) - m_level;
+    if (missing <= 0) {
+        return 0;
+    }
+    return (missing + limit.rate - 1) / limit.rate;
+}
+
+// limiter ---------------------------------------------------------------------
+
+void RateLimiter::Attach(ConnRate& rate, const std::string& address, int64_t nowMs) {
+    rate = ConnRate();
+    rate.messages.Fill(m_limits.messages, nowMs);
+    rate.bytes.Fill(m_limits.bytes, nowMs);
+    if (!m_limits.addressMessages.On() && !m_limits.addressBytes.On()) {
+        return;
+    }
+
+    std::string ip = address.substr(0, address.rfind(':'));
+    AddressBuckets& buckets = m_addresses[ip];
+    if (buckets.connections++ == 0) {
+        buckets.ip = ip;
+        buckets.messages.Fill(m_limits.addressMessages, nowMs);
+        buckets.bytes.Fill(m_limits.addressBytes, nowMs);
+    }
+    rate.address = &buckets;
+}
+
+void RateLimiter::Detach(ConnRate& rate) {
+    if (rate.address && --rate.address->connections == 0) {
+        // the last one gone, forget the address. a quick reconnect gets a
+        // full bucket again, but reconnecting costs them more than it buys
+        std::string ip = rate.address->ip;
+        m_addresses.erase(ip);
+    }
+    rate = ConnRate();
+}
+
+RateLimiter::Verdict RateLimiter::Admit(ConnRate& rate, size_t frameBytes, int64_t nowMs,
+                                        int64_t* resumeMs) {
+    const RateLimits& l = m_limits;
+    TokenBucket*     buckets[4];
+    const RateLimit* limits[4];
+    uint64_t         costs[4];
+    int              n = 0;
+    auto use = [&](TokenBucket& bucket, const RateLimit& limit, uint64_t cost) {
+        if (limit.On()) {
+            bucket.Refill(limit, nowMs);
+            buckets[n] = &bucket;
+            limits[n]  = &limit;
+            costs[n]   = cost;
+            n++;
+        }
+    };
+    use(rate.messages, l.messages, 1);
+    use(rate.bytes, l.bytes, frameBytes);
+    if (rate.address) {
+        use(rate.address->messages, l.addressMessages, 1);
+        use(rate.address->bytes, l.addressBytes, frameBytes);
+    }
+
+    int64_t wait = 0;
+    for (int i = 0; i < n; i++) {
+        int64_t ms = buckets[i]->WaitMs(*limits[i], costs[i]);
+        wait = ms > wait ? ms : wait;
+    }
+    if (wait == 0) {
+        for (int i = 0; i < n; i++) {
+            buckets[i]->Take(*limits[i], costs[i]);
+        }
+        rate.warned = false;
+        return Pass;
+    }
+
+    switch (l.policy) {
+        case FloodPolicy::Delay:
+            *resumeMs = nowMs + wait;
+            return Pause;
+        case FloodPolicy::Drop:
+            return Drop;
+        case FloodPolicy::Disconnect:
+            break;
+    }
+    return Kick;
+}
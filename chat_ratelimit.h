@@ -0,0 +1,120 @@
+// chat_ratelimit.h
+// flood protection: token buckets on what clients send. (server side, no wx)
+//
+// every connection has a bucket for frames and one for bytes, and every
+// address (ip, whatever the port) has another pair shared by all its
+// connections on the same worker. a frame has to fit in all four or the
+// policy kicks in: Delay stops reading the client until the buckets have
+// refilled (the rest waits in the kernel, so tcp pushes back on them),
+// Drop throws the frame away, Disconnect kicks them.
+//
+// buckets refill lazily: the level and when it was last topped up are
+// stored, and a frame tops it up by (now - then) * rate before taking its
+// share. "now" is the timestamp the worker already takes per read, so this
+// is a few adds per frame, no clock, no timer per client and no lock (each
+// worker has its own RateLimiter, like its RoomMembers). the cost of that:
+// an address with connections on several workers gets the address limit
+// once per worker.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+enum class FloodPolicy {
+    Delay,       // stop reading them until they're back under the limit
+    Drop,        // throw the frame away
+    Disconnect   // kick them
+};
+
+// rate per second, up to burst at once. rate 0 = no limit
+struct RateLimit {
+    uint32_t rate  = 0;
+    uint32_t burst = 0;
+
+    bool On() const { return rate > 0; }
+};
+
+struct RateLimits {
+    RateLimit   messages{20, 40};                  // frames per connection
+    RateLimit   bytes{64 * 1024, 256 * 1024};      // bytes per connection
+    RateLimit   addressMessages{100, 200};         // frames per address
+    RateLimit   addressBytes{512 * 1024, 1024 * 1024};
+    FloodPolicy policy = FloodPolicy::Delay;
+};
+
+// "RATE" or "RATE:BURST" (burst defaults to 2 * rate). false = not a number
+bool ParseRateLimit(const char* text, RateLimit* limit);
+
+class TokenBucket {
+public:
+    // full
+    void Fill(const RateLimit& limit, int64_t nowMs);
+    void Refill(const RateLimit& limit, int64_t nowMs);
+
+    void Take(const RateLimit& limit, uint64_t cost) { m_level -= Cost(limit, cost); }
+    // ms until cost fits (after Refill), 0 = now
+    int64_t WaitMs(const RateLimit& limit, uint64_t cost) const;
+
+private:
+    // in thousandths of a token, so a rate per second is also the refill
+    // per ms. more than a whole burst costs a whole burst, or a frame
+    // bigger than the byte burst would never get through
+    static int64_t Cost(const RateLimit& limit, uint64_t cost) {
+        return int64_t(cost < limit.burst ? cost : limit.burst) * 1000;
+    }
+
+    int64_t m_level   = 0;
+    int64_t m_stampMs = 0;
+};
+
+// one address' share, however many connections it has here
+struct AddressBuckets {
+    TokenBucket messages;
+    TokenBucket bytes;
+    uint32_t    connections = 0;
+    std::string ip;   // our key in the map
+};
+
+// one connection's share (a ConnectionTable column)
+struct ConnRate {
+    TokenBucket     messages;
+    TokenBucket     bytes;
+    AddressBuckets* address  = nullptr;   // owned by the worker's RateLimiter
+    int64_t         resumeMs = 0;         // Delay: paused until then, 0 = not paused
+    bool            warned   = false;     // Drop: told them since their last good frame
+};
+
+class RateLimiter {
+public:
+    enum Verdict {
+        Pass,    // go ahead, its paid for
+        Pause,   // Delay: put it back, dont read them before *resumeMs
+        Drop,    // Drop: forget the frame
+        Kick     // Disconnect
+    };
+
+    explicit RateLimiter(const RateLimits& limits) : m_limits(limits) {}
+
+    // a new connection from address ("ip:port" or just ip)
+    void Attach(ConnRate& rate, const std::string& address, int64_t nowMs);
+    void Detach(ConnRate& rate);
+
+    // one frame of frameBytes from them
+    Verdict Admit(ConnRate& rate, size_t frameBytes, int64_t nowMs, int64_t* resumeMs);
+
+    bool On() const {
+        return m_limits.messages.On() || m_limits.bytes.On() ||
+               m_limits.addressMessages.On() || m_limits.addressBytes.On();
+    }
+
+private:
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    RateLimits m_limits;
+    // node based, so the pointers in ConnRate stay put
+    std::unordered_map<std::string, AddressBuckets> m_addresses;
+};
@@ -0,0 +1,44 @@
+// chat_reconnect.cpp
+// jittered exponential backoff + the offline outbox
+
+#include "chat_reconnect.h"
+
+Backoff::Backoff(uint32_t baseMs, uint32_t capMs)
+    : m_baseMs(baseMs),
+      m_capMs(capMs),
+      m_attempt(0),
+      m_rng(std::random_device()())
+{
+}
+
+uint32_t Backoff::NextDelayMs() {
+    uint64_t delay = m_baseMs;
+    for (unsigned i = 0; i < m_attempt && delay < m_capMs; i++) {
+        delay *= 2;
+    }
+    if (delay > m_capMs) {
+        delay = m_capMs;
+    }
+    m_attempt++;
+
+    // half fixed, half random. all random could mean 0ms retries in a loop
+    uint32_t half = static_cast<uint32_t>(delay / 2);
+    std::uniform_int_distribution<uint32_t> jitter(0, half);
+    return half + jitter(m_rng);
+}
+
+bool Outbox::Push(const std::string& text) {
+    bool fit = true;
+    if (m_messages.size() >= m_capacity) {
+        m_messages.pop_front();
+        fit = false;
+    }
+    m_messages.push_back(text);
+    return fit;
+}
+
+std::string Outbox::Pop() {
+    std::string text = m_messages.front();
+    m_messages.pop_front();
+    return text;
+}
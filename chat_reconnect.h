@@ -0,0 +1,51 @@
+// chat_reconnect.h
+// bits a client needs to ride out a dropped connection (no wx in here).
+//
+// Backoff spaces out reconnect attempts: each failure doubles the wait up
+// to a cap, and every wait is jittered so a server restart doesnt get
+// every client back at the same millisecond. Outbox holds what the user
+// typed while offline, bounded, and hands it back once we're connected.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+
+class Backoff {
+public:
+    Backoff(uint32_t baseMs = 500, uint32_t capMs = 30000);
+
+    // wait before the next attempt: somewhere in [d/2, d], d = base * 2^n
+    uint32_t NextDelayMs();
+    // connected fine, next outage starts from the bottom again
+    void     Reset() { m_attempt = 0; }
+    unsigned Attempts() const { return m_attempt; }
+
+private:
+    uint32_t     m_baseMs;
+    uint32_t     m_capMs;
+    unsigned     m_attempt;
+    std::mt19937 m_rng;
+};
+
+class Outbox {
+public:
+    static const size_t kDefaultMessages = 256;
+
+    explicit Outbox(size_t capacity = kDefaultMessages) : m_capacity(capacity > 0 ? capacity : 1) {}
+
+    // false = full, the oldest message was thrown out to make room
+    bool Push(const std::string& text);
+    bool Empty() const { return m_messages.empty(); }
+    size_t Size() const { return m_messages.size(); }
+    // oldest first
+    std::string Pop();
+    void Clear() { m_messages.clear(); }
+
+private:
+    std::deque<std::string> m_messages;
+    size_t                  m_capacity;
+};
@@ -0,0 +1,205 @@
+// chat_rooms.cpp
+// room directory and per-worker membership lists
+
+#include "chat_rooms.h"
+
+#include <cctype>
+
+// directory ------------------------------------------------------------------
+
+RoomDirectory::RoomDirectory()
+    : m_made(0),
+      m_open(0)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Make("lobby", 0);   // = kLobbyRoom, its history is good from seq 1 on
+}
+
+std::string RoomDirectory::Normalize(const std::string& name) {
+    size_t start = (!name.empty() && name[0] == '#') ? 1 : 0;
+    if (name.size() - start == 0 || name.size() - start > kMaxRoomName) {
+        return "";
+    }
+    std::string out;
+    out.reserve(name.size() - start);
+    for (size_t i = start; i < name.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(name[i]);
+        if (!std::isalnum(c) && c != '-' && c != '_') {
+            return "";
+        }
+        out += static_cast<char>(std::tolower(c));
+    }
+    return out;
+}
+
+uint16_t RoomDirectory::Join(const std::string& name, uint32_t lastSeq) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto     it = m_ids.find(name);
+    uint16_t id = it != m_ids.end() ? it->second : Make(name, lastSeq);
+    if (id != kNoRoom) {
+        Entry(id).members.fetch_add(1, std::memory_order_relaxed);
+    }
+    return id;
+}
+
+uint16_t RoomDirectory::Make(const std::string& name, uint32_t lastSeq) {
+    uint16_t id;
+    if (!m_free.empty()) {
+        id = m_free.front();
+        m_free.pop_front();
+    } else if (m_made < kMaxRooms) {
+        id = static_cast<uint16_t>(m_made++);
+        if (!m_chunks[id / kChunk]) {
+            m_chunks[id / kChunk].reset(new RoomEntry[kChunk]);
+        }
+    } else {
+        return kNoRoom;
+    }
+    RoomEntry& entry = Entry(id);
+    entry.name = name;
+    entry.tag  = id == kLobbyRoom ? "" : "[#" + name + "] ";
+    entry.open = true;
+    // published with the id: whoever gets it from Join sees this too
+    entry.born.store(lastSeq, std::memory_order_release);
+    m_ids.emplace(name, id);
+    m_open.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+void RoomDirectory::DropMember(uint16_t id) {
+    RoomEntry& entry = Entry(id);
+    if (entry.members.fetch_sub(1, std::memory_order_acq_rel) != 1 || id == kLobbyRoom) {
+        return;
+    }
+    // looked like the last one out. someone may have joined (Join counts
+    // under the lock) or even emptied and freed it again since, so check
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!entry.open || entry.members.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+    entry.open = false;
+    m_ids.erase(entry.name);
+    m_free.push_back(id);
+    m_open.fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint16_t RoomDirectory::Find(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_ids.find(name);
+    return it != m_ids.end() ? it->second : kNoRoom;
+}
+
+size_t RoomDirectory::Open(size_t max, std::vector<std::pair<std::string, uint32_t>>* out) const {
+    // under the lock, a name cant be rewritten while we copy it
+    std::lock_guard<std::mutex> lock(m_lock);
+    size_t open = 0;
+    for (size_t i = 0; i < m_made; i++) {
+        const RoomEntry& entry   = Entry(static_cast<uint16_t>(i));
+        uint32_t         members = entry.members.load(std::memory_order_relaxed);
+        if (!entry.open || members == 0) {
+            continue;
+        }
+        if (open++ < max) {
+            out->emplace_back(entry.name, members);
+        }
+    }
+    return open;
+}
+
+// members --------------------------------------------------------------------
+
+std::vector<RoomMembers::Membership>& RoomMembers::Of(uint32_t slot) {
+    if (slot >= m_slots.size()) {
+        m_slots.resize(slot + 1);
+        m_current.resize(slot + 1, kNoRoom);
+    }
+    return m_slots[slot];
+}
+
+bool RoomMembers::Join(uint32_t slot, uint16_t room) {
+    std::vector<Membership>& rooms = Of(slot);
+    for (const Membership& m : rooms) {
+        if (m.room == room) {
+            return false;
+        }
+    }
+    std::vector<uint32_t>& members = m_members[room];
+    rooms.push_back(Membership{room, static_cast<uint32_t>(members.size())});
+    members.push_back(slot);
+    return true;
+}
+
+bool RoomMembers::Leave(uint32_t slot, uint16_t room) {
+    std::vector<Membership>& rooms = Of(slot);
+    for (size_t i = 0; i < rooms.size(); i++) {
+        if (rooms[i].room != room) {
+            continue;
+        }
+        Unlink(room, rooms[i].index);
+        rooms.erase(rooms.begin() + i);   // keeps join order, its a handful
+        if (m_current[slot] == room) {
+            // fall back to the room joined most recently
+            m_current[slot] = rooms.empty() ? kNoRoom : rooms.back().room;
+        }
+        return true;
+    }
+    return false;
+}
+
+// take members[index] out by moving the last one into its place, and
+// tell the moved slot where it lives now
+void RoomMembers::Unlink(uint16_t room, uint32_t index) {
+    auto it = m_members.find(room);
+    if (it == m_members.end()) {
+        return;
+    }
+    std::vector<uint32_t>& members = it->second;
+    uint32_t               moved   = members.back();
+    members[index] = moved;
+    members.pop_back();
+
+    if (members.empty()) {
+        m_members.erase(it);
+        return;
+    }
+    if (index < members.size()) {
+        for (Membership& m : m_slots[moved]) {
+            if (m.room == room) {
+                m.index = index;
+                break;
+            }
+        }
+    }
+}
+
+bool RoomMembers::IsMember(uint32_t slot, uint16_t room) const {
+    if (slot >= m_slots.size()) {
+        return false;
+    }
+    for (const Membership& m : m_slots[slot]) {
+        if (m.room == room) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<uint32_t>* RoomMembers::Members(uint16_t room) const {
+    auto it = m_members.find(room);
+    return it != m_members.end() ? &it->second : nullptr;
+}
+
+std::vector<uint16_t> RoomMembers::RoomsOf(uint32_t slot) const {
+    std::vector<uint16_t> out;
+    if (slot < m_slots.size()) {
+        for (const Membership& m : m_slots[slot]) {
+            out.push_back(m.room);
+        }
+    }
+    return out;
+}
+
+void RoomMembers::SetCurrent(uint32_t slot, uint16_t room) {
+    Of(slot);
+    m_current[slot] = room;
+}
@@ -0,0 +1,156 @@
+// chat_rooms.h
+// named rooms (channels) and who is in them. (server side, no wx)
+//
+// two halves:
+//
+// RoomDirectory, one per server, shared by every worker: room name <-> id
+// (the u16 in the frame header, see chat_protocol.h) plus how many
+// clients are in each. a room is made on the first /join and goes away
+// when the last one leaves (never the lobby), its id is then handed out
+// again. so an id alone doesnt say which room an old frame was for: each
+// room also remembers the last seq from before it was made, frames with
+// that seq or older were for something else (Born(), see Fresh()).
+// making, joining and emptying a room take a lock, everything else is
+// lock free: the names sit in fixed chunks that never move, Name() is an
+// array index, and a room cant be reused while the caller is in it.
+//
+// RoomMembers, one per worker: which of that worker's slots are in which
+// room. each room with anybody in it on this worker has a flat vector of
+// member slots, so a room broadcast only walks the people in that room.
+// every membership also remembers where it sits in that vector, which
+// makes leaving an O(1) swap-and-pop. rooms nobody is in (here) cost
+// nothing, so tens of thousands of small rooms are fine: memory goes with
+// the number of memberships, about 12 bytes each.
+
+#pragma once
+
+#include "chat_protocol.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint16_t kNoRoom        = kAllRooms;   // "not in any room" / "no such room"
+const size_t   kMaxRoomName   = 32;
+const size_t   kMaxRooms      = kAllRooms;   // ids 0 .. kAllRooms - 1
+const size_t   kMaxJoined     = 64;          // rooms one client can be in
+
+class RoomDirectory {
+public:
+    RoomDirectory();
+
+    // "#Rust" -> "rust". empty if its not a usable name (letters, digits,
+    // - and _, up to kMaxRoomName)
+    static std::string Normalize(const std::string& name);
+
+    // counts one more client into a normalized name's room, making it if
+    // its new (lastSeq = the newest seq handed out so far). kNoRoom = out
+    // of ids, nothing counted
+    uint16_t Join(const std::string& name, uint32_t lastSeq);
+    // one out. the last one out of a room (not the lobby) frees its id
+    void     DropMember(uint16_t id);
+    // kNoRoom = no such room (now)
+    uint16_t Find(const std::string& name) const;
+
+    // any thread, no lock, but only for a room the caller is counted in
+    // (or the lobby): nobody else can reuse the id under it
+    const std::string& Name(uint16_t id) const { return Entry(id).name; }
+    // what chat lines from the room start with: "[#name] ", "" for the lobby
+    const std::string& Tag(uint16_t id) const { return Entry(id).tag; }
+    // the lobby only, it never goes away so doesnt need the lock
+    void     AddLobbyMember() { Entry(kLobbyRoom).members.fetch_add(1, std::memory_order_relaxed); }
+
+    // clients in the room across all workers
+    uint32_t Members(uint16_t id) const {
+        return Entry(id).members.load(std::memory_order_relaxed);
+    }
+    // newest seq from before the room with this id was made. any thread
+    uint32_t Born(uint16_t id) const { return Entry(id).born.load(std::memory_order_acquire); }
+    // a frame with this room and seq is for the room that has the id now
+    bool     Fresh(uint16_t id, uint32_t seq) const { return id == kAllRooms || seq > Born(id); }
+
+    // the rooms with anybody in them (by id), at most max of them as
+    // (name, members). return = how many there are
+    size_t   Open(size_t max, std::vector<std::pair<std::string, uint32_t>>* out) const;
+    // rooms there are now, lobby included
+    size_t   Count() const { return m_open.load(std::memory_order_relaxed); }
+
+private:
+    struct RoomEntry {
+        std::string           name;   // written under m_lock, while nobody is in it
+        std::string           tag;
+        std::atomic<uint32_t> members{0};
+        std::atomic<uint32_t> born{0};
+        bool                  open = false;   // m_lock
+    };
+    static const size_t kChunk = 256;
+
+    RoomEntry& Entry(uint16_t id) const { return m_chunks[id / kChunk][id % kChunk]; }
+    // new room for name, kNoRoom = out of ids. m_lock held
+    uint16_t   Make(const std::string& name, uint32_t lastSeq);
+
+    mutable std::mutex                        m_lock;
+    std::unordered_map<std::string, uint16_t> m_ids;    // open rooms only
+    std::unique_ptr<RoomEntry[]>              m_chunks[kMaxRooms / kChunk + 1];
+    size_t                                    m_made;   // ids 0 .. m_made - 1 exist
+    std::deque<uint16_t>                      m_free;   // oldest freed first
+    std::atomic<size_t>                       m_open;
+};
+
+class RoomMembers {
+public:
+    // false = was already in / wasnt in
+    bool Join(uint32_t slot, uint16_t room);
+    bool Leave(uint32_t slot, uint16_t room);
+    // when the slot goes away. calls back for each room it was in
+    template <typename Fn>
+    void LeaveAll(uint32_t slot, Fn onLeft);
+
+    bool IsMember(uint32_t slot, uint16_t room) const;
+    // how many rooms the slot is in
+    size_t Joined(uint32_t slot) const { return slot < m_slots.size() ? m_slots[slot].size() : 0; }
+    // slots in the room on this worker, null = nobody
+    const std::vector<uint32_t>* Members(uint16_t room) const;
+
+    // the slot's rooms, in the order it joined them
+    std::vector<uint16_t> RoomsOf(uint32_t slot) const;
+
+    // where the slot's chat goes (kNoRoom = nowhere)
+    uint16_t Current(uint32_t slot) const {
+        return slot < m_current.size() ? m_current[slot] : kNoRoom;
+    }
+    void     SetCurrent(uint32_t slot, uint16_t room);
+
+private:
+    struct Membership {
+        uint16_t room;
+        uint32_t index;   // position in m_members[room]
+    };
+
+    std::vector<Membership>& Of(uint32_t slot);
+    void Unlink(uint16_t room, uint32_t index);
+
+    std::unordered_map<uint16_t, std::vector<uint32_t>> m_members;   // room -> slots
+    std::vector<std::vector<Membership>>                m_slots;     // slot -> rooms
+    std::vector<uint16_t>                               m_current;   // slot -> room
+};
+
+template <typename Fn>
+void RoomMembers::LeaveAll(uint32_t slot, Fn onLeft) {
+    if (slot >= m_slots.size()) {
+        return;
+    }
+    std::vector<Membership> rooms;
+    rooms.swap(m_slots[slot]);
+    for (const Membership& m : rooms) {
+        Unlink(m.room, m.index);
+        onLeft(m.room);
+    }
+    m_current[slot] = kNoRoom;
+}
@@ -0,0 +1,86 @@
+// chat_roster_view.cpp
+// O(1) roster model behind RosterView
+
+#include "chat_roster_view.h"
+
+RosterView::RosterView(wxWindow* parent, wxWindowID id, const wxSize& size)
+    : wxListCtrl(parent, id, wxDefaultPosition, size,
+                 wxLC_REPORT | wxLC_VIRTUAL),   // several selected = "Send sel" to each
+      m_dirty(false)
+{
+    AppendColumn("ID", wxLIST_FORMAT_LEFT, 50);
+    AppendColumn("Client", wxLIST_FORMAT_LEFT, 140);
+    SetItemCount(0);
+}
+
+bool RosterView::AddClient(const ClientInfo& info) {
+    if (m_index.count(info.id)) {
+        return false;
+    }
+    m_index[info.id] = static_cast<long>(m_rows.size());
+    m_rows.push_back(info);
+    m_dirty = true;
+    return true;
+}
+
+bool RosterView::RemoveClient(int id) {
+    auto it = m_index.find(id);
+    if (it == m_index.end()) {
+        return false;
+    }
+
+    long row  = it->second;
+    long last = static_cast<long>(m_rows.size()) - 1;
+    m_index.erase(it);
+
+    // selection is by row, keep it on the same clients (or drop it if that
+    // client is the one leaving). rows past GetItemCount() arent shown yet
+    long shown        = GetItemCount();
+    bool rowSelected  = row < shown && GetItemState(row, wxLIST_STATE_SELECTED) != 0;
+    bool lastSelected = row != last && last < shown &&
+                        GetItemState(last, wxLIST_STATE_SELECTED) != 0;
+    if (rowSelected) {
+        SetItemState(row, 0, wxLIST_STATE_SELECTED);
+    }
+
+    if (row != last) {
+        m_rows[row] = std::move(m_rows[last]);
+        m_index[m_rows[row].id] = row;
+        if (lastSelected) {
+            SetItemState(last, 0, wxLIST_STATE_SELECTED);
+            SetItemState(row, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+        }
+    }
+    m_rows.pop_back();
+    m_dirty = true;
+    return true;
+}
+
+void RosterView::ClearClients() {
+    m_rows.clear();
+    m_index.clear();
+    m_dirty = true;
+    Sync();
+}
+
+const ClientInfo* RosterView::Find(int id) const {
+    auto it = m_index.find(id);
+    return it == m_index.end() ? nullptr : &m_rows[it->second];
+}
+
+void RosterView::Sync() {
+    if (!m_dirty) {
+        return;
+    }
+    m_dirty = false;
+    SetItemCount(static_cast<long>(m_rows.size()));
+    Refresh();
+}
+
+wxString RosterView::OnGetItemText(long item, long column) const {
+    if (item < 0 || static_cast<size_t>(item) >= m_rows.size()) {
+        return wxString();
+    }
+    const ClientInfo& info = m_rows[item];
+    return column == 0 ? wxString::Format("%d", info.id) : info.name;
+}
@@ -0,0 +1,52 @@
+// chat_roster_view.h
+// the server window's client list, as a virtual list with its own model.
+//
+// rows live in a plain vector and an id -> row hash points into it, so
+// finding, adding and dropping a client are all O(1) (drop = move the last
+// row into the hole). the control is wxLC_VIRTUAL and only asks for the
+// rows it is drawing, so 10k clients scroll like 10.
+//
+// side effect of the swap-remove: rows arent in join order once people
+// start leaving. nobody sorts this list by hand anyway.
+
+#pragma once
+
+#include <wx/wx.h>
+#include <wx/listctrl.h>
+
+#include <unordered_map>
+#include <vector>
+
+// client info that is stored for every client connected
+struct ClientInfo {
+    wxString      address; // they ip:port
+    wxString      name;
+    int           id;      //#id
+};
+
+class RosterView : public wxListCtrl {
+public:
+    RosterView(wxWindow* parent, wxWindowID id, const wxSize& size);
+
+    // false if the id is already in there
+    bool AddClient(const ClientInfo& info);
+    // false if it wasnt
+    bool RemoveClient(int id);
+    void ClearClients();
+
+    const ClientInfo* Find(int id) const;
+    const ClientInfo& At(long row) const { return m_rows[row]; }
+    size_t            Count() const { return m_rows.size(); }
+
+    // after a batch of Add/Remove calls, tells the control the new size
+    // and repaints once
+    void Sync();
+
+protected:
+    wxString OnGetItemText(long item, long column) const override;
+
+private:
+    std::vector<ClientInfo>       m_rows;
+    std::unordered_map<int, long> m_index;   // client id -> row in m_rows
+    bool                          m_dirty;
+};
@@ -0,0 +1,564 @@
+// chat_server.cpp
+// starts/stops the workers and holds the little bit of state they share
+
+#include "chat_server.h"
+
+#include "chat_worker.h"
+
+#include <cctype>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+
+ChatServer::ChatServer(const ChatServerConfig& config, ChatServerObserver* observer)
+    : m_config(config),
+      m_observer(observer),
+      m_sharedListener(false),
+      m_nextHandoff(0),
+      m_lastSeq(0),
+      m_epoch(0),
+      m_deflateClients(0),
+      m_nextClientId(1),
+      m_clientCount(0),
+      m_running(false)
+{
+}
+
+ChatServer::~ChatServer() {
+    Stop();
+}
+
+bool ChatServer::Start(std::string* error) {
+    if (m_running) {
+        return true;
+    }
+
+    int count = m_config.workers;
+    if (count <= 0) {
+        count = static_cast<int>(std::thread::hardware_concurrency());
+        if (count <= 0) {
+            count = 1;
+        }
+    }
+
+    // with SO_REUSEPORT every worker gets its own listener on the port,
+    // otherwise worker 0 listens and deals the clients out
+    m_sharedListener = count > 1 && !HaveReusePort();
+
+    // new epoch = old seq numbers mean nothing here. with a log the old
+    // ones are still good, carry on from its epoch and last seq
+    if (!m_config.logDir.empty()) {
+        ChatLogOptions options;
+        options.dir          = m_config.logDir;
+        options.segmentBytes = m_config.logSegmentBytes;
+        options.keepSegments = m_config.logKeepSegments;
+
+        m_log.reset(new ChatLog());
+        m_log->SetErrorHandler([this](const std::string& line) { NotifyLog("ERR: " + line); });
+        if (!m_log->Open(options, error)) {
+            m_log.reset();
+            return false;
+        }
+#ifndef _WIN32
+        // sendfile has no MSG_NOSIGNAL, a client hanging up mid replay
+        // would kill us with SIGPIPE
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        m_epoch   = m_log->Epoch();
+        m_lastSeq = m_log->LastSeq();
+        NotifyLog("log " + m_config.logDir + ": carrying on from seq " + std::to_string(m_lastSeq.load()));
+    } else {
+        std::random_device random;
+        do {
+            m_epoch = random();
+        } while (m_epoch == 0);
+        m_lastSeq = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        socket_t listener = CHAT_INVALID_SOCKET;
+        if (i == 0 || !m_sharedListener) {
+            listener = OpenListener(m_config.port, count > 1, error);
+            if (listener == CHAT_INVALID_SOCKET) {
+                m_workers.clear();
+                m_log.reset();
+                return false;
+            }
+        }
+
+        std::unique_ptr<ChatWorker> worker(new ChatWorker(*this, i));
+        if (!worker->Open(listener, error)) {
+            CloseSocket(listener);
+            m_workers.clear();
+            m_log.reset();
+            return false;
+        }
+        m_workers.push_back(std::move(worker));
+    }
+
+    m_running = true;
+    // before the workers, they report joins to it right away
+    if (m_config.presenceMs > 0) {
+        m_presence.Start(m_config.presenceMs, [this](const BufferRef& frame) {
+            BufferRef packed = Pack(frame, nullptr);
+            for (auto& worker : m_workers) {
+                WorkerMail mail;
+                mail.kind   = WorkerMail::Presence;
+                mail.frame  = frame;
+                mail.packed = packed;
+                PostTo(*worker, std::move(mail), nullptr);
+            }
+        });
+    }
+    for (auto& worker : m_workers) {
+        worker->StartThread();
+    }
+
+    if (m_config.metricsPort > 0) {
+        m_metricsEndpoint.reset(new MetricsEndpoint());
+        if (!m_metricsEndpoint->Start(m_config.metricsPort,
+                                      [this]() { return PrometheusText(Metrics()); }, error)) {
+            m_metricsEndpoint.reset();
+            Stop();
+            return false;
+        }
+        NotifyLog("metrics on http://127.0.0.1:" + std::to_string(m_config.metricsPort) +
+                  "/metrics");
+    }
+    return true;
+}
+
+void ChatServer::Stop() {
+    if (!m_running) {
+        return;
+    }
+
+    // it reads m_workers
+    m_metricsEndpoint.reset();
+
+    m_running = false;
+    m_presence.Stop();   // it posts to the workers
+    for (auto& worker : m_workers) {
+        worker->Join();
+    }
+    // only once every thread is gone, mail may still point across workers
+    for (auto& worker : m_workers) {
+        worker->CloseAll();
+    }
+    m_workers.clear();
+    m_clientCount = 0;
+
+    // last batch hits the disk here
+    if (m_log) {
+        m_log->Close();
+    }
+}
+
+ChatServerStats ChatServer::Stats() const {
+    ChatServerStats stats;
+    for (const auto& worker : m_workers) {
+        stats.framesDropped   += worker->metrics.framesDropped.Get();
+        stats.framesCoalesced += worker->metrics.framesCoalesced.Get();
+        stats.slowDisconnects += worker->metrics.slowDisconnects.Get();
+    }
+    if (m_log) {
+        ChatLogStats log = m_log->Stats();
+        stats.logFrames  = log.frames;
+        stats.logBatches = log.batches;
+    }
+    return stats;
+}
+
+MetricsSnapshot ChatServer::Metrics() const {
+    MetricsSnapshot snapshot;
+    snapshot.takenMs = MetricsNowNs() / 1000000;
+    snapshot.clients = m_clientCount;
+    snapshot.rooms   = m_rooms.Count();
+    for (const auto& worker : m_workers) {
+        snapshot.Add(worker->metrics);
+    }
+    if (m_log) {
+        ChatLogStats log = m_log->Stats();
+        snapshot.logFrames  = log.frames;
+        snapshot.logBatches = log.batches;
+    }
+    return snapshot;
+}
+
+uint64_t ChatServer::CpuNanos() const {
+    uint64_t total = 0;
+    for (const auto& worker : m_workers) {
+        total += worker->CpuNanos();
+    }
+    return total;
+}
+
+void ChatServer::Broadcast(const std::string& text) {
+    if (!m_running) {
+        return;
+    }
+
+    // encoded once here, every worker fans out the same bytes
+    BufferRef frame = EncodeSharedFrame(FrameType::Chat, 0, text);
+    SetFrameRoom(frame, kAllRooms);
+    Publish(frame, nullptr);
+}
+
+bool ChatServer::SendDirect(int clientId, const std::string& text) {
+    return SendDirect(std::to_string(clientId), text);
+}
+
+bool ChatServer::SendDirect(const std::string& who, const std::string& text) {
+    ClientRoute route;
+    if (!m_running || !FindClient(who, &route)) {
+        return false;
+    }
+    std::string head = "[Server -> " + route.name + "] ";
+    BufferRef   frame = EncodeSharedFrame(FrameType::Direct, 0, head.data(), head.size(),
+                                          text.data(), text.size());
+    Deliver(route, frame, nullptr);
+    return true;
+}
+
+void ChatServer::Publish(BufferRef frame, ChatWorker* from) {
+    int64_t started = MetricsNowNs();
+    // outside the lock, the seq isnt part of what gets deflated
+    BufferRef packed = Pack(frame, from);
+
+    // a worker waiting here might be the one someone else is trying to
+    // post to, keep emptying our own mailbox meanwhile
+    while (!m_publishLock.try_lock()) {
+        if (from) {
+            from->DrainMailbox();
+        }
+        std::this_thread::yield();
+    }
+
+    uint32_t seq = ++m_lastSeq;
+    SetFrameSeq(frame, seq);
+    if (packed) {
+        SetFrameSeq(packed, seq);
+    }
+    if (m_log) {
+        m_log->Append(frame, ChatLog::NowMs());   // a copy into the batch, no io
+    }
+    WorkerMail mail;
+    mail.kind     = WorkerMail::Broadcast;
+    mail.frame    = frame;
+    mail.packed   = packed;
+    mail.postedNs = MetricsNowNs();
+    for (auto& worker : m_workers) {
+        WorkerMail copy = mail;
+        PostTo(*worker, std::move(copy), from);
+    }
+    m_publishLock.unlock();
+
+    // our own clients dont have to wait for the next wakeup
+    if (from) {
+        from->metrics.publishNs.Record(uint64_t(MetricsNowNs() - started));
+        from->DrainMailbox();
+    }
+}
+
+BufferRef ChatServer::Pack(const BufferRef& frame, ChatWorker* from) {
+    if (m_deflateClients == 0) {
+        return BufferRef();
+    }
+    if (from) {
+        return from->Pack(frame);
+    }
+    std::lock_guard<std::mutex> lock(m_codecLock);
+    return m_codec.PackShared(frame);
+}
+
+void ChatServer::PostTo(ChatWorker& target, WorkerMail&& mail, ChatWorker* from) {
+    while (!target.Post(std::move(mail))) {
+        // targets backed up. if we're a worker ourselves, empty our own
+        // mailbox while we wait in case the target is waiting on us
+        if (!m_running) {
+            if (mail.kind == WorkerMail::Adopt) {
+                CloseSocket(mail.sock);
+            }
+            return;
+        }
+        if (from) {
+            from->DrainMailbox();
+        }
+        std::this_thread::yield();
+    }
+}
+
+ChatWorker& ChatServer::NextHandoffWorker() {
+    unsigned n = m_nextHandoff.fetch_add(1, std::memory_order_relaxed);
+    return *m_workers[n % m_workers.size()];
+}
+
+// client routes ---------------------------------------------------------------
+
+namespace {
+
+std::string Lower(std::string s) {
+    for (char& c : s) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return s;
+}
+
+}  // namespace
+
+void ChatServer::RegisterClient(const ClientRoute& route) {
+    std::unique_lock<std::shared_mutex> lock(m_routeLock);
+    m_routes[route.id] = route;
+    // UserN names are kept back for client N (RenameClient), so this only
+    // misses if something is very wrong. never take someone else's entry
+    m_names.emplace(Lower(route.name), route.id);
+    lock.unlock();
+    m_presence.Joined(static_cast<uint32_t>(route.id), route.name);
+}
+
+void ChatServer::UnregisterClient(int id) {
+    std::unique_lock<std::shared_mutex> lock(m_routeLock);
+    auto it = m_routes.find(id);
+    if (it == m_routes.end()) {
+        return;
+    }
+    DropName(it->second.name, id);
+    m_routes.erase(it);
+    lock.unlock();
+    m_presence.Left(static_cast<uint32_t>(id));
+}
+
+bool ChatServer::RenameClient(int id, const std::string& name, std::string* error) {
+    // same alphabet as room names. all digits would read as an id in /msg,
+    // and [Server] is taken
+    bool digitsOnly = true;
+    for (char c : name) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (!std::isalnum(u) && c != '-' && c != '_') {
+            *error = "usage: /nick NAME, letters digits - and _ only, up to " +
+                     std::to_string(kMaxNickName);
+            return false;
+        }
+        digitsOnly = digitsOnly && std::isdigit(u);
+    }
+    if (name.empty() || name.size() > kMaxNickName || digitsOnly) {
+        *error = "usage: /nick NAME, letters digits - and _ only, up to " +
+                 std::to_string(kMaxNickName) + ", not just digits";
+        return false;
+    }
+    std::string lower = Lower(name);
+    if (lower == "server") {
+        *error = "nice try";
+        return false;
+    }
+    // UserN is what client N gets on connect, someone else having it
+    // first would leave two of them
+    if (lower.size() > 4 && lower.compare(0, 4, "user") == 0 &&
+        lower.find_first_not_of("0123456789", 4) == std::string::npos &&
+        lower.compare(4, std::string::npos, std::to_string(id)) != 0) {
+        *error = name + " is kept for client " + lower.substr(4);
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_routeLock);
+    auto route = m_routes.find(id);
+    if (route == m_routes.end()) {
+        *error = "not connected";
+        return false;
+    }
+    auto taken = m_names.find(lower);
+    if (taken != m_names.end() && taken->second != id) {
+        *error = name + " is taken";
+        return false;
+    }
+    DropName(route->second.name, id);
+    m_names[lower]      = id;
+    route->second.name  = name;
+    lock.unlock();
+    m_presence.Renamed(static_cast<uint32_t>(id), name);
+    return true;
+}
+
+// only if its ours, m_routeLock held
+void ChatServer::DropName(const std::string& name, int id) {
+    auto it = m_names.find(Lower(name));
+    if (it != m_names.end() && it->second == id) {
+        m_names.erase(it);
+    }
+}
+
+bool ChatServer::FindClient(const std::string& who, ClientRoute* route) {
+    // all digits = an id, anything else a name
+    char* end = nullptr;
+    long  id  = std::strtol(who.c_str(), &end, 10);
+    if (!who.empty() && *end == '\0') {
+        return id > 0 && FindClient(static_cast<int>(id), route);
+    }
+
+    std::shared_lock<std::shared_mutex> lock(m_routeLock);
+    auto name = m_names.find(Lower(who));
+    if (name == m_names.end()) {
+        return false;
+    }
+    auto it = m_routes.find(name->second);
+    if (it == m_routes.end()) {
+        return false;
+    }
+    *route = it->second;
+    return true;
+}
+
+bool ChatServer::FindClient(int id, ClientRoute* route) {
+    std::shared_lock<std::shared_mutex> lock(m_routeLock);
+    auto it = m_routes.find(id);
+    if (it == m_routes.end()) {
+        return false;
+    }
+    *route = it->second;
+    return true;
+}
+
+void ChatServer::Deliver(const ClientRoute& route, const BufferRef& frame, ChatWorker* from) {
+    if (route.worker == from) {
+        from->DeliverDirect(route.handle, frame);
+        return;
+    }
+    // the handle is checked over there, if they left meanwhile it just
+    // doesnt match anymore
+    WorkerMail mail;
+    mail.kind   = WorkerMail::Direct;
+    mail.frame  = frame;
+    mail.handle = route.handle;
+    PostTo(*route.worker, std::move(mail), from);
+}
+
+// observer calls, one at a time -------------------------------------------
+
+void ChatServer::NotifyLog(const std::string& line) {
+    if (m_observer) {
+        std::lock_guard<std::mutex> lock(m_observerLock);
+        m_observer->OnServerLog(line);
+    }
+}
+
+void ChatServer::NotifyJoined(int id, const std::string& name, const std::string& address) {
+    if (m_observer) {
+        std::lock_guard<std::mutex> lock(m_observerLock);
+        m_observer->OnClientJoined(id, name, address);
+    }
+}
+
+void ChatServer::NotifyLeft(int id, const std::string& name) {
+    if (m_observer) {
+        std::lock_guard<std::mutex> lock(m_observerLock);
+        m_observer->OnClientLeft(id, name);
+    }
+}
+
+void ChatServer::NotifyRenamed(int id, const std::string& oldName, const std::string& newName) {
+    if (m_observer) {
+        std::lock_guard<std::mutex> lock(m_observerLock);
+        m_observer->OnClientRenamed(id, oldName, newName);
+    }
+}
+
+void ChatServer::NotifyMessages(const ObservedMessage* lines, size_t count) {
+    if (m_observer && count > 0) {
+        std::lock_guard<std::mutex> lock(m_observerLock);
+        m_observer->OnClientMessages(lines, count);
+    }
+}
+
+// command line --------------------------------------------------------------
+
+bool ParseServerOption(const char* arg, ChatServerConfig* config) {
+    if (std::strncmp(arg, "--workers=", 10) == 0) {
+        config->workers = std::atoi(arg + 10);
+    } else if (std::strncmp(arg, "--max-queue=", 12) == 0) {
+        long bytes = std::strtol(arg + 12, nullptr, 10);
+        if (bytes > 0) {
+            config->maxQueuedBytes = static_cast<size_t>(bytes);
+        }
+    } else if (std::strncmp(arg, "--history=", 10) == 0) {
+        long frames = std::strtol(arg + 10, nullptr, 10);
+        if (frames >= 0) {
+            config->historyFrames = static_cast<size_t>(frames);
+        }
+    } else if (std::strncmp(arg, "--history-age=", 14) == 0) {
+        long seconds = std::strtol(arg + 14, nullptr, 10);
+        if (seconds >= 0) {
+            config->historySeconds = static_cast<uint32_t>(seconds);
+        }
+    } else if (std::strncmp(arg, "--log=", 6) == 0) {
+        config->logDir = arg + 6;
+    } else if (std::strncmp(arg, "--log-keep=", 11) == 0) {
+        long segments = std::strtol(arg + 11, nullptr, 10);
+        if (segments >= 0) {
+            config->logKeepSegments = static_cast<unsigned>(segments);
+        }
+    } else if (std::strncmp(arg, "--log-segment-mb=", 17) == 0) {
+        long mb = std::strtol(arg + 17, nullptr, 10);
+        if (mb > 0) {
+            config->logSegmentBytes = static_cast<size_t>(mb) * 1024 * 1024;
+        }
+    } else if (std::strncmp(arg, "--metrics=", 10) == 0) {
+        long port = std::strtol(arg + 10, nullptr, 10);
+        if (port > 0 && port < 65536) {
+            config->metricsPort = static_cast<int>(port);
+        }
+    } else if (std::strncmp(arg, "--presence-ms=", 14) == 0) {
+        long ms = std::strtol(arg + 14, nullptr, 10);
+        if (ms >= 0 && ms <= 60000) {
+            config->presenceMs = static_cast<uint32_t>(ms);
+        }
+    } else if (std::strncmp(arg, "--flush-us=", 11) == 0) {
+        long us = std::strtol(arg + 11, nullptr, 10);
+        if (us >= 0 && us <= 1000000) {
+            config->flushDelayUs = static_cast<uint32_t>(us);
+        }
+    } else if (std::strncmp(arg, "--msg-rate=", 11) == 0) {
+        return ParseRateLimit(arg + 11, &config->limits.messages);
+    } else if (std::strncmp(arg, "--byte-rate=", 12) == 0) {
+        return ParseRateLimit(arg + 12, &config->limits.bytes);
+    } else if (std::strncmp(arg, "--addr-msg-rate=", 16) == 0) {
+        return ParseRateLimit(arg + 16, &config->limits.addressMessages);
+    } else if (std::strncmp(arg, "--addr-byte-rate=", 17) == 0) {
+        return ParseRateLimit(arg + 17, &config->limits.addressBytes);
+    } else if (std::strncmp(arg, "--heartbeat=", 12) == 0) {
+        long seconds = std::strtol(arg + 12, nullptr, 10);
+        if (seconds >= 0 && seconds <= 86400) {
+            config->heartbeatMs = static_cast<uint32_t>(seconds) * 1000;
+        }
+    } else if (std::strncmp(arg, "--heartbeat-timeout=", 20) == 0) {
+        long seconds = std::strtol(arg + 20, nullptr, 10);
+        if (seconds > 0 && seconds <= 86400) {   // 0 would drop everyone we ping
+            config->heartbeatTimeoutMs = static_cast<uint32_t>(seconds) * 1000;
+        }
+    } else if (std::strncmp(arg, "--hello-timeout=", 16) == 0) {
+        long seconds = std::strtol(arg + 16, nullptr, 10);
+        if (seconds >= 0 && seconds <= 86400) {
+            config->helloTimeoutMs = static_cast<uint32_t>(seconds) * 1000;
+        }
+    } else if (std::strcmp(arg, "--flood=delay") == 0) {
+        config->limits.policy = FloodPolicy::Delay;
+    } else if (std::strcmp(arg, "--flood=drop") == 0) {
+        config->limits.policy = FloodPolicy::Drop;
+    } else if (std::strcmp(arg, "--flood=disconnect") == 0) {
+        config->limits.policy = FloodPolicy::Disconnect;
+    } else if (std::strcmp(arg, "--compress=deflate") == 0) {
+        config->compress = true;
+    } else if (std::strcmp(arg, "--compress=off") == 0) {
+        config->compress = false;
+    } else if (std::strcmp(arg, "--slow=drop") == 0) {
+        config->slowPolicy = SlowConsumerPolicy::DropOldest;
+    } else if (std::strcmp(arg, "--slow=coalesce") == 0) {
+        config->slowPolicy = SlowConsumerPolicy::Coalesce;
+    } else if (std::strcmp(arg, "--slow=disconnect") == 0) {
+        config->slowPolicy = SlowConsumerPolicy::Disconnect;
+    } else {
+        return false;
+    }
+    return true;
+}
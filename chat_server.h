@@ -0,0 +1,258 @@
+// chat_server.h
+// headless chat server core (no wx). owns the listeners, every client socket,
+// and the read -> broadcast path. runs on its own worker threads so a gui
+// (user1_gui) or a plain main (chat_server) can sit on top and just watch.
+
+#pragma once
+
+#include "chat_compress.h"
+#include "chat_conntable.h"
+#include "chat_http.h"
+#include "chat_log.h"
+#include "chat_metrics.h"
+#include "chat_net.h"
+#include "chat_outqueue.h"
+#include "chat_presence.h"
+#include "chat_protocol.h"
+#include "chat_ratelimit.h"
+#include "chat_rooms.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ChatWorker;
+struct WorkerMail;
+
+// longest /nick
+const size_t kMaxNickName = 24;
+
+// one chat line, for the observer
+struct ObservedMessage {
+    int         id = 0;
+    std::string name;
+    std::string text;
+};
+
+// whoever wants to hear about the room implements this.
+// NOTE: called from the server's worker threads, not the gui thread. the
+// server serializes the calls so an observer never sees two at once
+class ChatServerObserver {
+public:
+    virtual ~ChatServerObserver() {}
+
+    virtual void OnServerLog(const std::string& /*line*/) {}
+    virtual void OnClientJoined(int /*id*/, const std::string& /*name*/,
+                                const std::string& /*address*/) {}
+    virtual void OnClientLeft(int /*id*/, const std::string& /*name*/) {}
+    virtual void OnClientRenamed(int /*id*/, const std::string& /*oldName*/,
+                                 const std::string& /*newName*/) {}
+    virtual void OnClientMessage(int /*id*/, const std::string& /*name*/,
+                                 const std::string& /*text*/) {}
+    // chat lines come in batches, what one worker saw in one pass of its
+    // loop. the default hands them to OnClientMessage one by one
+    virtual void OnClientMessages(const ObservedMessage* lines, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            OnClientMessage(lines[i].id, lines[i].name, lines[i].text);
+        }
+    }
+};
+
+struct ChatServerConfig {
+    int port = 8888;
+
+    // reactor threads. each one owns its own listener (SO_REUSEPORT) and
+    // its own clients. 0 = one per core
+    int workers = 0;
+
+    // per client cap on bytes waiting to be written, and what to do
+    // when a client hits it
+    size_t             maxQueuedBytes = 256 * 1024;
+    SlowConsumerPolicy slowPolicy     = SlowConsumerPolicy::DropOldest;
+
+    // broadcasts each worker keeps around: a new client gets them as a
+    // catch-up, one that reconnects gets what it missed. historySeconds > 0
+    // also drops anything older than that
+    size_t   historyFrames  = 1024;
+    uint32_t historySeconds = 0;
+
+    // persistent broadcast log (chat_log.h), off while logDir is empty.
+    // with it the epoch and seqs survive a restart, and history older than
+    // what the workers keep in memory is served from disk
+    std::string logDir;
+    size_t      logSegmentBytes = 64 * 1024 * 1024;
+    unsigned    logKeepSegments = 16;
+
+    // GET /metrics (prometheus text) on 127.0.0.1:metricsPort, 0 = off.
+    // the counters themselves are always kept, see Metrics()
+    int metricsPort = 0;
+
+    // how long queued frames may wait for company before the worker
+    // writes them (one writev per client per flush). 0 = at the end of
+    // every pass through the event loop, which already batches whatever
+    // arrived together
+    uint32_t flushDelayUs = 0;
+
+    // clients get told who is online and who is typing (chat_presence.h),
+    // in deltas at most every presenceMs. 0 = off
+    uint32_t presenceMs = 100;
+
+    // flood protection: how fast one connection, and one address, may
+    // send, and what happens past that (chat_ratelimit.h)
+    RateLimits limits;
+
+    // dead peers (a pi that lost power never closes its socket): a client
+    // we havent heard from for heartbeatMs gets a Ping, and is dropped if
+    // heartbeatTimeoutMs more go by without a word. one that hasnt said
+    // Hello helloTimeoutMs after connecting is dropped too. 0 = off
+    uint32_t heartbeatMs        = 30000;
+    uint32_t heartbeatTimeoutMs = 10000;
+    uint32_t helloTimeoutMs     = 10000;
+
+    // offer deflate (chat_compress.h) to clients on slow links. only
+    // those that ask get it, and while any of them is online every
+    // broadcast is deflated once and shared between them
+    bool compress = true;
+};
+
+// the command line options every server binary understands
+// (--workers=N, --max-queue=BYTES, --slow=drop|coalesce|disconnect,
+// --history=FRAMES, --history-age=SECONDS, --log=DIR, --log-keep=SEGMENTS,
+// --log-segment-mb=MB, --metrics=PORT, --flush-us=MICROSECONDS,
+// --presence-ms=MS, --msg-rate=MSGS[:BURST], --byte-rate=BYTES[:BURST],
+// --addr-msg-rate=MSGS[:BURST], --addr-byte-rate=BYTES[:BURST],
+// --flood=delay|drop|disconnect, --heartbeat=SECONDS,
+// --heartbeat-timeout=SECONDS, --hello-timeout=SECONDS,
+// --compress=deflate|off). a rate of 0
+// turns that limit off, a heartbeat or hello timeout of 0 turns it off.
+// false = not one of these, the caller deals with it
+bool ParseServerOption(const char* arg, ChatServerConfig* config);
+
+// how often the slow consumer policies kicked in
+struct ChatServerStats {
+    uint64_t framesDropped   = 0;   // DropOldest threw these away
+    uint64_t framesCoalesced = 0;   // Coalesce squashed these into notices
+    uint64_t slowDisconnects = 0;   // Disconnect kicked this many clients
+
+    uint64_t logFrames  = 0;   // written to the persistent log
+    uint64_t logBatches = 0;   // fsyncs it took
+};
+
+class ChatServer {
+public:
+    ChatServer(const ChatServerConfig& config, ChatServerObserver* observer = nullptr);
+    ~ChatServer();
+
+    // opens the port and starts the worker threads
+    bool Start(std::string* error = nullptr);
+    void Stop();
+
+    bool IsRunning() const { return m_running; }
+    int  Port() const { return m_config.port; }
+    int  WorkerCount() const { return static_cast<int>(m_workers.size()); }
+    int  ClientCount() const { return m_clientCount; }
+    ChatServerStats Stats() const;   // safe from any thread
+    // every counter and latency histogram, safe from any thread
+    MetricsSnapshot Metrics() const;
+    // cpu time burned by all worker threads so far (0 if the os wont say)
+    uint64_t CpuNanos() const;
+    // random per Start(), see the handshake in chat_protocol.h
+    uint32_t Epoch() const { return m_epoch; }
+    // what the Hello offers (kCodec*)
+    uint8_t  Codecs() const { return m_config.compress ? SupportedCodecs() : 0; }
+
+    // queue a chat line (from "the server") for every client, whatever
+    // room they're in. safe from any thread
+    void Broadcast(const std::string& text);
+    // a private line from the server to one client, nobody else gets a
+    // copy. false = no such client (anymore). safe from any thread
+    bool SendDirect(int clientId, const std::string& text);
+    // same, who = their name or id as text
+    bool SendDirect(const std::string& who, const std::string& text);
+
+private:
+    friend class ChatWorker;
+
+    // bits the workers share ------------------------------------------------
+    int  NextClientId() { return m_nextClientId.fetch_add(1); }
+    // hand mail to a worker (`from` = the posting worker, null = posting
+    // from outside, e.g. the gui). spins if the mailbox is full
+    void PostTo(ChatWorker& target, WorkerMail&& mail, ChatWorker* from);
+    // give a broadcast frame the next seq and send it to every worker
+    // (`from` included). one lock around both, so every worker sees
+    // broadcasts in seq order and a resuming client can trust its last seq
+    void Publish(BufferRef frame, ChatWorker* from);
+    // frame deflated for the clients that asked, null if none are online
+    // or it doesnt shrink. `from` as above, its codec does the work
+    BufferRef Pack(const BufferRef& frame, ChatWorker* from);
+    // worker to give a socket to when only one worker can listen
+    ChatWorker& NextHandoffWorker();
+
+    // where each client lives, so a direct message goes to one socket
+    // instead of through every worker
+    struct ClientRoute {
+        int         id = 0;
+        std::string name;
+        ChatWorker* worker = nullptr;
+        ConnHandle  handle = 0;
+    };
+    // these tell the presence hub too
+    void RegisterClient(const ClientRoute& route);
+    void UnregisterClient(int id);
+    // /nick. false = not allowed or taken, *error says why
+    bool RenameClient(int id, const std::string& name, std::string* error);
+    // m_names entry for name, if it points at id
+    void DropName(const std::string& name, int id);
+    // who = an id ("12") or a name ("User12", any case). false = nobody
+    bool FindClient(const std::string& who, ClientRoute* route);
+    bool FindClient(int id, ClientRoute* route);
+    // hand frame to route's worker for its socket (straight in if thats
+    // `from`, by mail otherwise)
+    void Deliver(const ClientRoute& route, const BufferRef& frame, ChatWorker* from);
+
+    void NotifyLog(const std::string& line);
+    void NotifyJoined(int id, const std::string& name, const std::string& address);
+    void NotifyLeft(int id, const std::string& name);
+    void NotifyRenamed(int id, const std::string& oldName, const std::string& newName);
+    // a worker's chat lines of one pass, one lock for all of them
+    void NotifyMessages(const ObservedMessage* lines, size_t count);
+
+    ChatServerConfig    m_config;
+    ChatServerObserver* m_observer;
+    std::mutex          m_observerLock;
+
+    std::vector<std::unique_ptr<ChatWorker>> m_workers;
+    bool                                     m_sharedListener;   // no SO_REUSEPORT
+    std::atomic<unsigned>                    m_nextHandoff;
+
+    std::mutex            m_publishLock;
+    std::atomic<uint32_t> m_lastSeq;   // written under m_publishLock, read anywhere
+    uint32_t              m_epoch;
+
+    std::unique_ptr<ChatLog> m_log;   // null = no persistent log
+
+    std::unique_ptr<MetricsEndpoint> m_metricsEndpoint;   // null = no --metrics
+
+    RoomDirectory m_rooms;   // names and head counts, the members are per worker
+    PresenceHub   m_presence;
+
+    // clients that picked deflate, on any worker. 0 = dont bother packing
+    std::atomic<int> m_deflateClients;
+    // Pack() for callers that arent a worker (the gui, the presence hub)
+    std::mutex       m_codecLock;
+    FrameCodec       m_codec;
+
+    // written on connect/disconnect only, read per direct message
+    std::shared_mutex                    m_routeLock;
+    std::unordered_map<int, ClientRoute> m_routes;   // id -> route
+    std::unordered_map<std::string, int> m_names;    // lower case name -> id
+
+    std::atomic<int>  m_nextClientId;
+    std::atomic<int>  m_clientCount;
+    std::atomic<bool> m_running;
+};
@@ -0,0 +1,120 @@
+// chat_server_main.cpp
+// headless chat server - same room as user1_gui but no window,
+// so it can run on a box with no display
+//
+// usage: chat_server [port] [--workers=N] [--max-queue=BYTES]
+//                    [--slow=drop|coalesce|disconnect]
+//                    [--history=FRAMES] [--history-age=SECONDS]
+//                    [--log=DIR] [--log-keep=SEGMENTS] [--log-segment-mb=MB]
+//                    [--metrics=PORT] [--flush-us=MICROSECONDS]
+//                    [--presence-ms=MS] [--flood=delay|drop|disconnect]
+//                    [--msg-rate=N[:BURST]] [--byte-rate=N[:BURST]]
+//                    [--addr-msg-rate=N[:BURST]] [--addr-byte-rate=N[:BURST]]
+//                    [--heartbeat=SECONDS] [--heartbeat-timeout=SECONDS]
+//                    [--hello-timeout=SECONDS] [--compress=deflate|off]
+
+#include "chat_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+std::atomic<bool> g_quit(false);
+
+void OnSignal(int) {
+    g_quit = true;
+}
+
+// just prints what happens in the room
+class ConsoleObserver : public ChatServerObserver {
+public:
+    void OnServerLog(const std::string& line) override {
+        std::printf("%s\n", line.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientJoined(int, const std::string& name, const std::string& address) override {
+        std::printf("client in: %s (%s)\n", name.c_str(), address.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientLeft(int, const std::string& name) override {
+        std::printf("client out: %s\n", name.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientMessage(int, const std::string& name, const std::string& text) override {
+        std::printf("[%s] %s\n", name.c_str(), text.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientMessages(const ObservedMessage* lines, size_t count) override {
+        for (size_t i = 0; i < count; i++) {
+            std::printf("[%s] %s\n", lines[i].name.c_str(), lines[i].text.c_str());
+        }
+        std::fflush(stdout);   // once a batch
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::fprintf(stderr, "winsock init fail\n");
+        return 1;
+    }
+#endif
+
+    // port and options from argv or defaults
+    ChatServerConfig config;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (ParseServerOption(arg, &config)) {
+            continue;
+        }
+        long p = std::strtol(arg, nullptr, 10);
+        if (p > 0 && p < 65536) {
+            config.port = static_cast<int>(p);
+        } else {
+            std::fprintf(stderr, "ignoring unknown arg %s\n", arg);
+        }
+    }
+
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    ConsoleObserver observer;
+    ChatServer      server(config, &observer);
+
+    std::string error;
+    if (!server.Start(&error)) {
+        std::fprintf(stderr, "ERR: %s\n", error.c_str());
+        return 1;
+    }
+
+    while (!g_quit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    ChatServerStats stats = server.Stats();
+    server.Stop();
+
+    std::printf("slow consumers: %llu frames dropped, %llu coalesced, %llu clients kicked\n",
+                (unsigned long long)stats.framesDropped,
+                (unsigned long long)stats.framesCoalesced,
+                (unsigned long long)stats.slowDisconnects);
+    if (!config.logDir.empty()) {
+        std::printf("log: %llu frames written in %llu fsyncs\n",
+                    (unsigned long long)stats.logFrames,
+                    (unsigned long long)stats.logBatches);
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,337 @@
+// chat_session.cpp
+// client protocol state machine (handshake, resume, outbox)
+
+#include "chat_session.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+const char* kLobby = "lobby";
+
+// one Typing frame per this long however fast they type, the server
+// batches them anyway but theres no point sending each keystroke
+const int64_t kTypingEveryMs = 3000;
+
+// quiet this long and we ask if the server is still there, then give it
+// this long to say so. the server pings us the same way
+const int64_t kPingAfterMs = 30000;
+const int64_t kPongWaitMs  = 10000;
+
+// same spelling the server uses: no #, lower case
+std::string RoomName(const std::string& name) {
+    std::string out = (!name.empty() && name[0] == '#') ? name.substr(1) : name;
+    for (char& c : out) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return out;
+}
+
+}  // namespace
+
+ClientSession::ClientSession(ClientSessionListener* listener)
+    : m_listener(listener),
+      m_active(false),
+      m_connected(false),
+      m_reconnecting(false),
+      m_live(false),
+      m_epoch(0),
+      m_lastSeq(0),
+      m_clientId(0),
+      m_wantCodecs(SupportedCodecs()),
+      m_codec(0),
+      m_replays(0),
+      m_rooms(1, kLobby),
+      m_room(kLobby),
+      m_rosterVersion(0),
+      m_typingSentMs(0),
+      m_bytesIn(0),
+      m_bytesAtTick(0),
+      m_heardMs(0),
+      m_pingedMs(0)
+{
+}
+
+void ClientSession::Begin() {
+    m_active       = true;
+    m_reconnecting = false;
+    m_backoff.Reset();
+}
+
+void ClientSession::End() {
+    m_active       = false;
+    m_connected    = false;
+    m_reconnecting = false;
+    m_live         = false;
+    m_outbox.Clear();
+    m_out.clear();
+    m_decoder.Reset();
+    m_rooms.assign(1, kLobby);
+    m_room = kLobby;
+    m_nick.clear();
+    m_roster.clear();
+}
+
+void ClientSession::Connected() {
+    m_connected = true;
+    m_live      = false;   // until the Hello swap is done
+    m_decoder.Reset();
+    m_out.clear();
+    m_unpackError.clear();
+    m_codec    = 0;   // until the Hello says otherwise
+    m_replays  = 0;
+    m_heardMs  = 0;
+    m_pingedMs = 0;
+}
+
+void ClientSession::Lost() {
+    m_connected    = false;
+    m_live         = false;
+    m_reconnecting = m_active;
+    // whatever didnt make it out is gone with the socket
+    m_out.clear();
+}
+
+bool ClientSession::Process() {
+    FrameView            frame;
+    FrameDecoder::Result result = FrameDecoder::NeedMore;
+    while (m_connected && (result = m_decoder.Next(&frame)) == FrameDecoder::Ready) {
+        if (frame.header.type != FrameType::Deflate) {
+            HandleFrame(frame);
+            continue;
+        }
+        FrameView inner;
+        if (!m_packer.Unpack(frame, &inner, &m_unpackError)) {
+            return false;
+        }
+        HandleFrame(inner);
+    }
+    return result != FrameDecoder::Bad;
+}
+
+bool ClientSession::Send(const std::string& text) {
+    if (!m_live) {
+        // offline: hold on to it, it goes out once we're back
+        return m_outbox.Push(text);
+    }
+    TrackCommands(text);
+    SendText(text);
+    return true;
+}
+
+bool ClientSession::Typing(int64_t nowMs) {
+    if (!m_live || (m_typingSentMs != 0 && nowMs - m_typingSentMs < kTypingEveryMs)) {
+        return false;
+    }
+    m_typingSentMs = nowMs;
+    m_out += EncodeFrame(FrameType::Typing, 0, nullptr, 0);
+    return true;
+}
+
+bool ClientSession::Tick(int64_t nowMs) {
+    if (!m_connected) {
+        return true;
+    }
+    if (m_heardMs == 0 || m_bytesIn != m_bytesAtTick) {
+        m_bytesAtTick = m_bytesIn;
+        m_heardMs     = nowMs;
+        m_pingedMs    = 0;
+        return true;
+    }
+    if (m_pingedMs != 0) {
+        return nowMs - m_pingedMs < kPongWaitMs;
+    }
+    if (nowMs - m_heardMs >= kPingAfterMs) {
+        m_pingedMs = nowMs;
+        m_out += EncodeFrame(FrameType::Ping, 0, nullptr, 0);
+    }
+    return true;
+}
+
+void ClientSession::SendText(const std::string& text) {
+    std::string frame;
+    if (text.compare(0, 5, "/msg ") == 0) {
+        // sender 0 = "who" is the first word, the server looks it up
+        frame = EncodeFrame(FrameType::Direct, 0, text.substr(5));
+    } else {
+        frame = EncodeFrame(FrameType::Chat, 0, text);
+    }
+    if (!(m_codec & kCodecDeflate) || !m_packer.Pack(frame.data(), frame.size(), &m_out)) {
+        m_out += frame;
+    }
+}
+
+// mirrors what the server does with them (chat_worker.cpp)
+void ClientSession::TrackCommands(const std::string& text) {
+    if (text.compare(0, 6, "/nick ") == 0) {
+        m_nick = text.substr(6);
+    } else if (text == "/history" || text.compare(0, 9, "/history ") == 0) {
+        m_replays++;
+    } else if (text.compare(0, 6, "/join ") == 0) {
+        std::string room = RoomName(text.substr(6));
+        if (std::find(m_rooms.begin(), m_rooms.end(), room) == m_rooms.end()) {
+            m_rooms.push_back(room);
+        }
+        m_room = room;
+    } else if (text == "/leave" || text.compare(0, 7, "/leave ") == 0) {
+        std::string room = text.size() > 7 ? RoomName(text.substr(7)) : m_room;
+        auto        it   = std::find(m_rooms.begin(), m_rooms.end(), room);
+        if (it == m_rooms.end()) {
+            return;
+        }
+        m_rooms.erase(it);
+        if (room == m_room) {
+            m_room = m_rooms.empty() ? "" : m_rooms.back();
+        }
+    }
+}
+
+// a new connection starts out in the lobby only. put it back the way it
+// was, before the Hello so the catch-up covers our rooms
+void ClientSession::Rejoin() {
+    if (!m_nick.empty()) {
+        m_out += EncodeFrame(FrameType::Chat, 0, "/nick " + m_nick);
+    }
+    if (m_rooms.size() == 1 && m_rooms[0] == kLobby && m_room == kLobby) {
+        return;   // nothing else to do
+    }
+    if (std::find(m_rooms.begin(), m_rooms.end(), kLobby) == m_rooms.end()) {
+        m_out += EncodeFrame(FrameType::Chat, 0, std::string("/leave ") + kLobby);
+    }
+    for (const std::string& room : m_rooms) {
+        if (room != kLobby) {
+            m_out += EncodeFrame(FrameType::Chat, 0, "/join " + room);
+        }
+    }
+    if (!m_room.empty() && m_room != m_rooms.back()) {
+        m_out += EncodeFrame(FrameType::Chat, 0, "/join " + m_room);
+    }
+}
+
+void ClientSession::HandleFrame(const FrameView& frame) {
+    switch (frame.header.type) {
+        case FrameType::Hello:
+            HandleHello(frame);
+            break;
+
+        case FrameType::Exit:
+            // server said bye after we sent Exit
+            m_listener->OnSessionExit();
+            break;
+
+        case FrameType::Chat:
+            // after a reconnect the server may resend a few we already
+            // have (seq only goes up, so anything not newer is a repeat).
+            // unless we asked for them with /history
+            if (frame.header.seq != 0) {
+                if (frame.header.seq <= m_lastSeq && m_replays == 0) {
+                    break;
+                }
+                m_lastSeq = std::max(m_lastSeq, frame.header.seq);
+            }
+            m_listener->OnSessionText(frame.header.type, frame.header.sender, frame.Text());
+            break;
+
+        case FrameType::Direct:
+            // private, never sequenced or replayed
+            m_listener->OnSessionText(frame.header.type, frame.header.sender, frame.Text());
+            break;
+
+        case FrameType::Presence:
+            HandlePresence(frame);
+            break;
+
+        case FrameType::Ping:
+            m_out += EncodeFrame(FrameType::Pong, 0, nullptr, 0);
+            break;
+
+        case FrameType::System:
+            if (m_clientId == 0 && frame.header.sender != 0) {
+                m_clientId = frame.header.sender;   // the welcome carries our id
+            }
+            if (frame.header.seq != 0 && m_replays > 0) {
+                m_replays--;   // end of a /history answer
+            }
+            m_listener->OnSessionText(frame.header.type, frame.header.sender, frame.Text());
+            break;
+
+        default:
+            break;
+    }
+}
+
+// resume handshake. same server as before = ask for what we missed,
+// otherwise ask for its recent history
+void ClientSession::HandleHello(const FrameView& frame) {
+    uint32_t epoch = HelloEpoch(frame);
+    if (epoch != m_epoch) {
+        // new to this server: 0 = send me whatever recent history you have
+        if (m_reconnecting) {
+            m_listener->OnSessionNotice("back online (server restarted, older msgs are gone)");
+        }
+        m_epoch   = epoch;
+        m_lastSeq = 0;
+    } else if (m_reconnecting) {
+        m_listener->OnSessionNotice("back online, catching up");
+    }
+    Rejoin();
+    // deflate if we both can, from right after our Hello
+    m_codec = HelloCodecs(frame) & m_wantCodecs & kCodecDeflate;
+    m_out += EncodeHello(m_lastSeq, m_epoch, m_codec);
+
+    m_live         = true;
+    m_reconnecting = false;
+    m_clientId     = 0;   // new connection, new id (comes with the welcome)
+    m_replays      = 0;   // answers to the old connection arent coming
+    m_backoff.Reset();
+
+    // now the stuff typed while we were gone
+    while (!m_outbox.Empty()) {
+        std::string text = m_outbox.Pop();
+        TrackCommands(text);
+        SendText(text);
+    }
+}
+
+void ClientSession::HandlePresence(const FrameView& frame) {
+    uint8_t                     flags = 0;
+    std::vector<PresenceRecord> records;
+    if (!DecodePresence(frame, &flags, &records)) {
+        return;
+    }
+    if (flags & kPresenceSnapshot) {
+        if (flags & kPresenceReset) {
+            m_roster.clear();
+        }
+        m_rosterVersion = frame.header.seq;
+    } else if (frame.header.seq <= m_rosterVersion) {
+        return;   // the snapshot had this already
+    }
+
+    bool changed = false;
+    for (const PresenceRecord& record : records) {
+        switch (record.kind) {
+            case PresenceKind::Join:
+            case PresenceKind::Rename:
+                m_roster[record.id] = record.name;
+                changed = true;
+                break;
+
+            case PresenceKind::Leave:
+                changed = m_roster.erase(record.id) > 0 || changed;
+                break;
+
+            case PresenceKind::Typing: {
+                auto who = m_roster.find(record.id);
+                if (who != m_roster.end() && record.id != m_clientId) {
+                    m_listener->OnSessionTyping(record.id, who->second);
+                }
+                break;
+            }
+        }
+    }
+    if (changed || (flags & kPresenceReset)) {
+        m_listener->OnSessionRoster();
+    }
+}
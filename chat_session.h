@@ -0,0 +1,162 @@
+// chat_session.h
+// the client side of the protocol, minus the socket.
+//
+// everything a client does between "bytes came in" and "bytes should go
+// out" lives here: frame decoding, the Hello/resume handshake, dropping
+// repeated broadcasts, the offline outbox and the reconnect backoff. the
+// socket part stays with whoever owns the session (wxSocketClient in the
+// gui client, a plain non-blocking socket in the cli one), so the fiddly
+// bits exist once and every client binary gets the same fixes.
+//
+// rooms too: the session notes the /join and /leave lines that went out
+// and says them again on a new connection, before its Hello, so a
+// reconnect lands back in the same rooms and catches up on them. same
+// for /nick.
+//
+// and presence: the server's snapshot + deltas (see chat_protocol.h) are
+// kept here as Roster(), the owner just gets told when it changed.
+//
+// compression too: if the server offers deflate (chat_compress.h) the
+// session asks for it, unpacks what comes in and packs the longer lines
+// it sends. the owner only ever sees plain frames.
+//
+// usage, roughly:
+//   Begin()                        user wants to be connected
+//   Connected()                    socket is up
+//   ReadPtr()/Commit() + Process() whenever bytes arrive
+//   Send(text)                     user typed something
+//   write Output(), then Consumed(n)
+//   Typing(now)                    user is typing (throttled in here)
+//   Tick(now)                      every second or so, false = server is gone
+//   Lost() -> RetryDelayMs()       socket died, dial again after that
+//   End()                          user disconnected (or Exit)
+
+#pragma once
+
+#include "chat_compress.h"
+#include "chat_protocol.h"
+#include "chat_reconnect.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class ClientSessionListener {
+public:
+    virtual ~ClientSessionListener() {}
+
+    // a chat or system line to show
+    virtual void OnSessionText(FrameType type, uint32_t sender, const std::string& text) = 0;
+    // the session's own status lines ("back online, catching up" etc)
+    virtual void OnSessionNotice(const std::string& line) = 0;
+    // server answered our Exit, the owner should drop the socket and End()
+    virtual void OnSessionExit() {}
+    // who is online changed, see ClientSession::Roster()
+    virtual void OnSessionRoster() {}
+    // someone in a room of ours is typing (no "stopped", it just wears off)
+    virtual void OnSessionTyping(uint32_t /*id*/, const std::string& /*name*/) {}
+};
+
+class ClientSession {
+public:
+    explicit ClientSession(ClientSessionListener* listener);
+
+    void Begin();
+    void End();
+    // true between Begin() and End(): a lost socket means "reconnect"
+    bool Active() const { return m_active; }
+
+    void Connected();
+    void Lost();
+    bool Reconnecting() const { return m_reconnecting; }
+    // handshake done, Send() goes straight out
+    bool Live() const { return m_live; }
+    // how long to wait before the next dial (grows per failed try)
+    uint32_t RetryDelayMs() { return m_backoff.NextDelayMs(); }
+
+    // incoming bytes: read into ReadPtr(), Commit(n), then Process()
+    char*  ReadPtr(size_t minSpace) { return m_decoder.WritePtr(minSpace); }
+    size_t ReadSpace() const { return m_decoder.WriteSpace(); }
+    void   Commit(size_t n) { m_decoder.Commit(n); m_bytesIn += n; }
+    // handles every whole frame. false = server sent garbage (ErrorText()),
+    // drop the connection
+    bool   Process();
+    const std::string& ErrorText() const {
+        return m_unpackError.empty() ? m_decoder.ErrorText() : m_unpackError;
+    }
+
+    // ask for deflate if the server has it (the default, if built with
+    // zlib). takes effect on the next connection
+    void SetCompression(bool on) { m_wantCodecs = on ? SupportedCodecs() : 0; }
+    // this connection is deflated
+    bool Compressed() const { return m_codec != 0; }
+
+    // utf-8 chat text. offline it waits in the outbox, false = the outbox
+    // was full and lost its oldest message. "/msg WHO text" goes out as a
+    // Direct frame (private, see chat_protocol.h)
+    bool Send(const std::string& text);
+    size_t Queued() const { return m_outbox.Size(); }
+    // user is typing. sends a Typing frame at most every few seconds, true
+    // if it did (Output() has something)
+    bool Typing(int64_t nowMs);
+    // heartbeat, call it every second or so while connected. pings a
+    // server that has been quiet for a while (Output() has it), false =
+    // it didnt answer that either: drop the socket and Lost()
+    bool Tick(int64_t nowMs);
+
+    // bytes the owner should write to the socket
+    const std::string& Output() const { return m_out; }
+    void Consumed(size_t n) { m_out.erase(0, n); }
+
+    uint32_t ClientId() const { return m_clientId; }   // from the welcome
+    // the room our chat goes to, as far as we know ("" = none)
+    const std::string& Room() const { return m_room; }
+    // who is online: id -> name, as of the last Presence frame
+    const std::map<uint32_t, std::string>& Roster() const { return m_roster; }
+
+private:
+    void HandleFrame(const FrameView& frame);
+    void HandleHello(const FrameView& frame);
+    void HandlePresence(const FrameView& frame);
+    // text is about to go out, note any /join, /leave, /nick or /history in it
+    void TrackCommands(const std::string& text);
+    // typed line -> frame (Chat, or Direct for /msg), onto m_out. deflated
+    // if we agreed on that and its worth it
+    void SendText(const std::string& text);
+    void Rejoin();
+
+    ClientSessionListener* m_listener;
+    FrameDecoder           m_decoder;
+    std::string            m_out;
+    FrameCodec             m_packer;
+    std::string            m_unpackError;
+    Backoff                m_backoff;
+    Outbox                 m_outbox;
+
+    bool     m_active;
+    bool     m_connected;
+    bool     m_reconnecting;
+    bool     m_live;
+    uint32_t m_epoch;      // server we last talked to
+    uint32_t m_lastSeq;    // newest broadcast shown
+    uint32_t m_clientId;
+    uint8_t  m_wantCodecs;   // we'd take these
+    uint8_t  m_codec;        // this connection's, 0 = plain
+    uint32_t m_replays;      // /history answers still coming, repeats are wanted
+
+    std::vector<std::string> m_rooms;   // in join order, starts as the lobby
+    std::string              m_room;    // where we talk
+    std::string              m_nick;    // last /nick, "" = whatever the server calls us
+
+    std::map<uint32_t, std::string> m_roster;
+    uint32_t                        m_rosterVersion;   // of the last snapshot
+    int64_t                         m_typingSentMs;
+
+    // heartbeat. "heard" = m_bytesIn moved since the last Tick
+    uint64_t m_bytesIn;
+    uint64_t m_bytesAtTick;
+    int64_t  m_heardMs;    // 0 = not since Connected()
+    int64_t  m_pingedMs;   // 0 = no Ping out
+};
@@ -0,0 +1,115 @@
+// chat_timerwheel.cpp
+// bucket lists and pouring the levels down
+
+#include "chat_timerwheel.h"
+
+TimerWheel::TimerWheel(int64_t nowMs)
+    : m_tick(static_cast<uint64_t>(nowMs / kTickMs)),
+      m_count(0)
+{
+    for (uint32_t& head : m_heads) {
+        head = kNil;
+    }
+}
+
+void TimerWheel::Schedule(uint32_t id, int64_t dueMs) {
+    if (id >= m_nodes.size()) {
+        m_nodes.resize(id + 1);
+    }
+    if (m_nodes[id].bucket != kNil) {
+        Unlink(id);
+    }
+    // round up, early would mean firing for nothing
+    uint64_t due = dueMs > 0 ? static_cast<uint64_t>((dueMs + kTickMs - 1) / kTickMs) : 0;
+    m_nodes[id].due = due > m_tick ? due : m_tick + 1;
+    Insert(id);
+}
+
+void TimerWheel::Cancel(uint32_t id) {
+    if (Scheduled(id)) {
+        Unlink(id);
+    }
+}
+
+void TimerWheel::Insert(uint32_t id) {
+    Node&    node  = m_nodes[id];
+    uint64_t delta = node.due - m_tick;   // due >= m_tick always
+    int      level = 0;
+    while (level < kLevels - 1 && delta >= (uint64_t(1) << (kBits * (level + 1)))) {
+        level++;
+    }
+    uint64_t due = node.due;
+    if (level == kLevels - 1) {
+        // past the top: park it as far out as the wheel goes, it gets
+        // looked at again when that bucket pours down
+        uint64_t last = m_tick + (uint64_t(1) << (kBits * kLevels)) - 1;
+        due = due < last ? due : last;
+    }
+    uint32_t bucket = static_cast<uint32_t>(level) * kSize +
+                      static_cast<uint32_t>((due >> (kBits * level)) & (kSize - 1));
+
+    node.bucket = bucket;
+    node.prev   = kNil;
+    node.next   = m_heads[bucket];
+    if (node.next != kNil) {
+        m_nodes[node.next].prev = id;
+    }
+    m_heads[bucket] = id;
+    m_count++;
+}
+
+void TimerWheel::Unlink(uint32_t id) {
+    Node& node = m_nodes[id];
+    if (node.prev != kNil) {
+        m_nodes[node.prev].next = node.next;
+    } else {
+        m_heads[node.bucket] = node.next;
+    }
+    if (node.next != kNil) {
+        m_nodes[node.next].prev = node.prev;
+    }
+    node.prev   = kNil;
+    node.next   = kNil;
+    node.bucket = kNil;
+    m_count--;
+}
+
+uint32_t TimerWheel::Step() {
+    m_tick++;
+    // which levels wrapped. top one first, what comes down from it may
+    // have to go on down through the next one in the same tick
+    int wrapped = 0;
+    while (wrapped < kLevels - 1 && (m_tick & ((uint64_t(1) << (kBits * (wrapped + 1))) - 1)) == 0) {
+        wrapped++;
+    }
+    for (int level = wrapped; level >= 1; level--) {
+        uint32_t bucket = static_cast<uint32_t>(level) * kSize +
+                          static_cast<uint32_t>((m_tick >> (kBits * level)) & (kSize - 1));
+        uint32_t id     = m_heads[bucket];
+        m_heads[bucket] = kNil;
+        while (id != kNil) {
+            uint32_t next = m_nodes[id].next;
+            m_count--;    // Insert counts it again
+            Insert(id);
+            id = next;
+        }
+    }
+    return static_cast<uint32_t>(m_tick & (kSize - 1));
+}
+
+int64_t TimerWheel::NextMs(int64_t nowMs, int64_t maxMs) const {
+    if (m_count == 0) {
+        return maxMs;
+    }
+    // the next non-empty level 0 bucket, or the next pour, whichever first
+    uint64_t ticks = 1;
+    for (; ticks <= kSize; ticks++) {
+        uint64_t tick = m_tick + ticks;
+        if (m_heads[tick & (kSize - 1)] != kNil || (tick & (kSize - 1)) == 0) {
+            break;
+        }
+    }
+    int64_t left = static_cast<int64_t>(m_tick + ticks) * kTickMs - nowMs;
+    left = left < 0 ? 0 : left;
+    return left < maxMs ? left : maxMs;
+}
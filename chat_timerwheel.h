@@ -0,0 +1,87 @@
+// chat_timerwheel.h
+// hierarchical timer wheel for per-connection deadlines. (server side, no wx)
+//
+// one per worker, one timer per connection slot, no os timer per socket.
+// time moves in ticks (kTickMs). four levels of 64 buckets each: level 0
+// holds what is due in the next 64 ticks, one bucket per tick, level 1
+// the next 64*64 ticks in 64-tick buckets, and so on up to ~46 hours
+// (anything later waits at the top and is checked again from there).
+// when level 0 wraps, the next level 1 bucket is poured down into it, the
+// same for the levels above. so a timer is touched once per level it
+// falls through, at most four times, however many there are.
+//
+// timers are intrusive doubly linked lists over one node array indexed by
+// the id, so Schedule and Cancel are O(1) and make no allocation (after
+// the node array has grown to the number of slots).
+//
+// deadlines are meant to be lazy: an idle timeout is armed for "last heard
+// + idle", and when it fires the owner checks whether it heard something
+// since and simply arms it again. nothing has to touch the wheel per read.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TimerWheel {
+public:
+    static const int64_t kTickMs = 10;
+
+    explicit TimerWheel(int64_t nowMs);
+
+    // (re)arms id for dueMs. due in the past = the next tick
+    void Schedule(uint32_t id, int64_t dueMs);
+    void Cancel(uint32_t id);
+    bool Scheduled(uint32_t id) const {
+        return id < m_nodes.size() && m_nodes[id].bucket != kNil;
+    }
+    size_t Count() const { return m_count; }
+
+    // moves time on to nowMs, fire(id) for every timer that came due.
+    // fire may Schedule or Cancel anything, its own id included
+    template <typename Fn>
+    void Advance(int64_t nowMs, Fn fire);
+
+    // ms until the wheel needs Advance() again (something due, or a level
+    // to pour down), at most maxMs
+    int64_t NextMs(int64_t nowMs, int64_t maxMs) const;
+
+private:
+    static const int      kLevels = 4;
+    static const int      kBits   = 6;
+    static const uint32_t kSize   = 1u << kBits;   // buckets per level
+    static const uint32_t kNil    = ~0u;
+
+    struct Node {
+        uint64_t due    = 0;      // tick
+        uint32_t prev   = kNil;
+        uint32_t next   = kNil;
+        uint32_t bucket = kNil;   // level * kSize + index, kNil = not scheduled
+    };
+
+    void Insert(uint32_t id);
+    void Unlink(uint32_t id);
+    // tick m_tick + 1: pours down whatever levels wrapped. returns the
+    // level 0 bucket that is due now
+    uint32_t Step();
+
+    std::vector<Node>     m_nodes;
+    uint32_t              m_heads[kLevels * kSize];
+    uint64_t              m_tick;    // last tick handled
+    size_t                m_count;
+};
+
+template <typename Fn>
+void TimerWheel::Advance(int64_t nowMs, Fn fire) {
+    uint64_t target = static_cast<uint64_t>(nowMs / kTickMs);
+    while (m_tick < target) {
+        uint32_t bucket = Step();
+        // one at a time: fire may cancel the next one in here
+        while (m_heads[bucket] != kNil) {
+            uint32_t id = m_heads[bucket];
+            Unlink(id);
+            fire(id);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+// chat_transcript.cpp
+// ring buffer behind Transcript
+
+#include "chat_transcript.h"
+
+#include <utility>
+
+Transcript::Transcript(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1),
+      m_head(0),
+      m_size(0),
+      m_evicted(0)
+{
+}
+
+void Transcript::Append(const std::string& line) {
+    Append(std::string(line));
+}
+
+void Transcript::Append(std::string&& line) {
+    if (m_size < m_capacity) {
+        // still filling up, storage grows as needed (not up front)
+        size_t slot = (m_head + m_size) % m_capacity;
+        if (slot == m_lines.size()) {
+            m_lines.push_back(std::move(line));
+        } else {
+            m_lines[slot] = std::move(line);
+        }
+        m_size++;
+        return;
+    }
+
+    // full: newest line takes the oldest one's slot
+    m_lines[m_head] = std::move(line);
+    m_head = (m_head + 1) % m_capacity;
+    m_evicted++;
+}
+
+void Transcript::Clear() {
+    m_lines.clear();
+    m_head    = 0;
+    m_size    = 0;
+    m_evicted = 0;
+}
+
+void Transcript::SetCapacity(size_t capacity) {
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    if (capacity == m_capacity) {
+        return;
+    }
+
+    // unroll into order, keep the newest ones that fit
+    size_t keep  = m_size < capacity ? m_size : capacity;
+    size_t first = m_size - keep;
+    std::vector<std::string> lines;
+    lines.reserve(keep);
+    for (size_t i = first; i < m_size; i++) {
+        lines.push_back(std::move(m_lines[(m_head + i) % m_capacity]));
+    }
+
+    m_lines.swap(lines);
+    m_capacity = capacity;
+    m_head     = 0;
+    m_size     = keep;
+    m_evicted += first;
+}
+
+const std::string& Transcript::Line(size_t index) const {
+    return m_lines[(m_head + index) % m_capacity];
+}
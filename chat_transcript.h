@@ -0,0 +1,45 @@
+// chat_transcript.h
+// bounded chat history for the gui windows.
+//
+// the old windows did AppendText into a rich text control forever, so a
+// busy day meant hundreds of MB and every append getting slower. this is
+// just a ring of utf-8 lines with a cap: once its full the oldest line
+// falls off. the view (chat_transcript_view.h) only asks for the rows that
+// are actually on screen.
+//
+// no wx in here on purpose, its plain data.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Transcript {
+public:
+    static const size_t kDefaultLines = 5000;
+
+    explicit Transcript(size_t capacity = kDefaultLines);
+
+    void Append(const std::string& line);
+    void Append(std::string&& line);
+    void Clear();
+
+    // shrinking keeps the newest lines
+    void   SetCapacity(size_t capacity);
+    size_t Capacity() const { return m_capacity; }
+
+    size_t Size() const { return m_size; }
+    // 0 = oldest line still kept
+    const std::string& Line(size_t index) const;
+
+    // lines that fell off the front since the last Clear()
+    size_t Evicted() const { return m_evicted; }
+
+private:
+    std::vector<std::string> m_lines;   // grows up to m_capacity, then wraps
+    size_t                   m_capacity;
+    size_t                   m_head;    // slot of the oldest line
+    size_t                   m_size;
+    size_t                   m_evicted;
+};
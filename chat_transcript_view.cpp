@@ -0,0 +1,96 @@
+// chat_transcript_view.cpp
+// batched appends + virtual rows for TranscriptView
+
+#include "chat_transcript_view.h"
+
+namespace {
+
+const int kFlushIntervalMs = 16;   // about one frame at 60hz
+
+}
+
+TranscriptView::TranscriptView(wxWindow* parent, wxWindowID id, size_t maxLines)
+    : wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize,
+                 wxLC_REPORT | wxLC_VIRTUAL | wxLC_NO_HEADER | wxLC_SINGLE_SEL),
+      m_transcript(maxLines),
+      m_flushTimer(this)
+{
+    AppendColumn("", wxLIST_FORMAT_LEFT, 400);
+    SetItemCount(0);
+
+    Bind(wxEVT_TIMER, &TranscriptView::OnFlushTimer, this, m_flushTimer.GetId());
+    Bind(wxEVT_SIZE, &TranscriptView::OnSize, this);
+}
+
+void TranscriptView::AppendLine(const wxString& line) {
+    m_pending.push_back(std::string(line.ToUTF8()));
+    if (!m_flushTimer.IsRunning()) {
+        m_flushTimer.StartOnce(kFlushIntervalMs);
+    }
+}
+
+void TranscriptView::ClearLines() {
+    m_flushTimer.Stop();
+    m_pending.clear();
+    m_transcript.Clear();
+    SetItemCount(0);
+    Refresh();
+}
+
+void TranscriptView::SetMaxLines(size_t maxLines) {
+    Flush();
+    m_transcript.SetCapacity(maxLines);
+    SetItemCount(static_cast<long>(m_transcript.Size()));
+    Refresh();
+}
+
+wxString TranscriptView::OnGetItemText(long item, long WXUNUSED(column)) const {
+    if (item < 0 || static_cast<size_t>(item) >= m_transcript.Size()) {
+        return wxString();
+    }
+    return wxString::FromUTF8(m_transcript.Line(static_cast<size_t>(item)).c_str());
+}
+
+void TranscriptView::OnFlushTimer(wxTimerEvent& WXUNUSED(event)) {
+    Flush();
+}
+
+void TranscriptView::OnSize(wxSizeEvent& event) {
+    // one column, as wide as the window
+    SetColumnWidth(0, GetClientSize().GetWidth());
+    event.Skip();
+}
+
+void TranscriptView::Flush() {
+    if (m_pending.empty()) {
+        return;
+    }
+
+    // only follow new lines if the user wasnt scrolled up reading
+    bool follow = AtBottom();
+
+    // a storm bigger than the cap only keeps its tail anyway
+    size_t first = 0;
+    if (m_pending.size() > m_transcript.Capacity()) {
+        first = m_pending.size() - m_transcript.Capacity();
+    }
+    for (size_t i = first; i < m_pending.size(); i++) {
+        m_transcript.Append(std::move(m_pending[i]));
+    }
+    m_pending.clear();
+
+    long count = static_cast<long>(m_transcript.Size());
+    SetItemCount(count);
+    if (follow && count > 0) {
+        EnsureVisible(count - 1);
+    }
+    Refresh();
+}
+
+bool TranscriptView::AtBottom() const {
+    long count = GetItemCount();
+    if (count == 0) {
+        return true;
+    }
+    return GetTopItem() + GetCountPerPage() >= count;
+}
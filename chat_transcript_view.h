@@ -0,0 +1,46 @@
+// chat_transcript_view.h
+// virtual list that shows a Transcript.
+//
+// wxLC_VIRTUAL means the control never holds the text itself, it calls
+// OnGetItemText for the rows it is drawing and thats it. appends dont touch
+// the control either: they sit in a pending list and a timer moves them
+// into the transcript and repaints once per frame, so a message storm costs
+// one refresh per ~16ms no matter how many lines came in.
+
+#pragma once
+
+#include <wx/wx.h>
+#include <wx/listctrl.h>
+
+#include <string>
+#include <vector>
+
+#include "chat_transcript.h"
+
+class TranscriptView : public wxListCtrl {
+public:
+    TranscriptView(wxWindow* parent, wxWindowID id,
+                   size_t maxLines = Transcript::kDefaultLines);
+
+    // gui thread only. shows up on the next flush
+    void AppendLine(const wxString& line);
+    void ClearLines();
+
+    void   SetMaxLines(size_t maxLines);
+    size_t MaxLines() const { return m_transcript.Capacity(); }
+
+    const Transcript& Lines() const { return m_transcript; }
+
+protected:
+    wxString OnGetItemText(long item, long column) const override;
+
+private:
+    void OnFlushTimer(wxTimerEvent& event);
+    void OnSize(wxSizeEvent& event);
+    void Flush();
+    bool AtBottom() const;
+
+    Transcript               m_transcript;
+    std::vector<std::string> m_pending;   // utf-8, not in the transcript yet
+    wxTimer                  m_flushTimer;
+};
@@ -0,0 +1,1268 @@
+// chat_worker.cpp
+// the reactor loop: accept, read frames, broadcast them back out
+
+#include "chat_worker.h"
+
+#include "chat_server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace {
+
+// poller tokens that arent client sockets
+const uint64_t kListenToken = ~0ULL;
+const uint64_t kWakeToken   = ~0ULL - 1;
+
+// biggest single recv we ask for
+const size_t kReadChunk = 16 * 1024;
+// pooled read buffers: room for a recv plus a partial frame left over
+const size_t kReadBuffer     = 2 * kReadChunk;
+const size_t kPooledBuffers  = 16;
+
+// most queued frames handed to one gathered send: as many as the kernel
+// takes, a whole catch-up is one write
+const size_t kMaxGather = kMaxIoSlices;
+
+int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool IsBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+std::string Trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos) {
+        return "";
+    }
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+}  // namespace
+
+ChatWorker::ChatWorker(ChatServer& server, int index)
+    : m_server(server),
+      m_index(index),
+      m_listener(CHAT_INVALID_SOCKET),
+      m_dirtySinceNs(0),
+      m_observedCount(0),
+      m_history(server.m_config.historyFrames, server.m_config.historySeconds * 1000,
+                server.m_lastSeq),
+      m_limiter(server.m_config.limits),
+      m_timers(NowMs())
+{
+    m_readBuffers.reserve(kPooledBuffers);
+}
+
+ChatWorker::~ChatWorker() {
+    Join();
+    CloseAll();
+}
+
+bool ChatWorker::Open(socket_t listener, std::string* error) {
+    if (!m_poller.Ok() || !m_wakeup.Ok()) {
+        if (error) *error = "cant create poller";
+        return false;
+    }
+
+    m_listener = listener;
+    if (m_listener != CHAT_INVALID_SOCKET) {
+        m_poller.Add(m_listener, kListenToken);
+    }
+    m_poller.Add(m_wakeup.Fd(), kWakeToken);
+    return true;
+}
+
+void ChatWorker::StartThread() {
+    m_thread = std::thread(&ChatWorker::Run, this);
+}
+
+void ChatWorker::Join() {
+    m_wakeup.Signal();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void ChatWorker::CloseAll() {
+    // whatever is still sitting in the mailbox
+    WorkerMail mail;
+    while (m_mailbox.TryPop(mail)) {
+        if (mail.kind == WorkerMail::Adopt) {
+            CloseSocket(mail.sock);
+        }
+    }
+
+    for (socket_t sock : m_adopted) {
+        CloseSocket(sock);
+    }
+    m_adopted.clear();
+    m_dirty.clear();
+
+    // drop clients
+    for (uint32_t slot = 0; slot < m_clients.Slots(); slot++) {
+        if (m_clients.state[slot] != ConnState::Free) {
+            m_poller.Remove(m_clients.fd[slot]);
+            CloseSocket(m_clients.fd[slot]);
+            m_server.UnregisterClient(m_clients.id[slot]);
+            m_rooms.LeaveAll(slot, [this](uint16_t room) { m_server.m_rooms.DropMember(room); });
+            m_clients.Remove(m_clients.HandleOf(slot));
+            m_server.m_clientCount--;
+        }
+    }
+
+    if (m_listener != CHAT_INVALID_SOCKET) {
+        m_poller.Remove(m_listener);
+        CloseSocket(m_listener);
+        m_listener = CHAT_INVALID_SOCKET;
+    }
+}
+
+uint64_t ChatWorker::CpuNanos() {
+#ifdef __linux__
+    clockid_t clock;
+    timespec  ts;
+    if (m_thread.joinable() &&
+        pthread_getcpuclockid(m_thread.native_handle(), &clock) == 0 &&
+        clock_gettime(clock, &ts) == 0) {
+        return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+    }
+#endif
+    return 0;
+}
+
+bool ChatWorker::Post(WorkerMail&& mail) {
+    if (!m_mailbox.TryPush(std::move(mail))) {
+        return false;
+    }
+    m_wakeup.Signal();
+    return true;
+}
+
+void ChatWorker::DrainMailbox() {
+    WorkerMail mail;
+    while (m_mailbox.TryPop(mail)) {
+        switch (mail.kind) {
+            case WorkerMail::Broadcast: {
+                int64_t picked = MetricsNowNs();
+                metrics.mailboxNs.Record(uint64_t(picked - mail.postedNs));
+                Remember(mail.frame, mail.packed);
+                FanOut(mail.frame, mail.packed);
+                metrics.fanOutNs.Record(uint64_t(MetricsNowNs() - picked));
+                metrics.broadcasts.Add();
+                break;
+            }
+
+            case WorkerMail::Presence:
+                FanOut(mail.frame, mail.packed);
+                break;
+
+            case WorkerMail::Adopt:
+                // may be called from deep inside a frame handler (see
+                // ChatServer::PostTo), so the table cant grow yet
+                m_adopted.push_back(mail.sock);
+                break;
+
+            case WorkerMail::Direct:
+                DeliverDirect(mail.handle, mail.frame);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+BufferRef ChatWorker::Pack(const BufferRef& frame) {
+    BufferRef packed = m_codec.PackShared(frame);
+    if (packed) {
+        metrics.packed.Add();
+    }
+    return packed;
+}
+
+void ChatWorker::DeliverDirect(ConnHandle handle, const BufferRef& frame) {
+    if (!m_clients.Valid(handle)) {
+        return;
+    }
+    uint32_t slot = ConnectionTable::SlotOf(handle);
+    if (m_clients.state[slot] != ConnState::Closing) {
+        SendTo(slot, frame);
+        metrics.directs.Add();
+    }
+}
+
+void ChatWorker::Run() {
+    if (m_index == 0) {
+        m_server.NotifyLog("server on port " + std::to_string(m_server.m_config.port) +
+                           " (" + std::to_string(m_server.WorkerCount()) + " worker(s))");
+        m_server.NotifyLog("waiting for clients...");
+    }
+
+    PollEvent events[256];
+    while (m_server.m_running) {
+        int n = m_poller.Wait(events, 256, PollTimeoutMs());
+
+        for (int i = 0; i < n && m_server.m_running; i++) {
+            const PollEvent& ev = events[i];
+
+            if (ev.token == kWakeToken) {
+                m_wakeup.Drain();
+                DrainMailbox();
+                AdoptPending();
+                continue;
+            }
+            if (ev.token == kListenToken) {
+                AcceptConnections();
+                continue;
+            }
+
+            // token is the handle, so an event for a client that is already
+            // gone (and maybe replaced in the same slot) just doesnt match
+            ConnHandle handle = ev.token;
+            if (ev.readable) {
+                HandleReadable(handle);
+            }
+            if (!m_clients.Valid(handle)) {
+                continue;
+            }
+            if (ev.hangup || (ev.writable && !Flush(ConnectionTable::SlotOf(handle)))) {
+                RemoveClient(handle);
+            }
+            ReapClients();
+        }
+        // deadlines: pauses that are over, quiet clients, dead ones
+        m_timers.Advance(NowMs(), [this](uint32_t slot) { OnTimer(slot); });
+        ReapClients();
+        // everything this pass queued goes out now, one write per client
+        FlushDirty(false);
+        ReapClients();
+        AdoptPending();
+        HandObserved();
+    }
+    // stopping: whatever is queued gets one last try
+    FlushDirty(true);
+    HandObserved();
+}
+
+void ChatWorker::HandObserved() {
+    if (m_observedCount > 0) {
+        m_server.NotifyMessages(m_observed.data(), m_observedCount);
+        m_observedCount = 0;
+    }
+}
+
+void ChatWorker::AcceptConnections() {
+    // edge triggered, so take everyone who is waiting
+    for (;;) {
+        socket_t sock = accept(m_listener, nullptr, nullptr);
+        if (sock == CHAT_INVALID_SOCKET) {
+            int err = SocketError();
+            if (!IsWouldBlock(err)) {
+                m_server.NotifyLog("ERR: accept failed");
+            }
+            return;
+        }
+
+        if (!SetNonBlocking(sock)) {
+            CloseSocket(sock);
+            continue;
+        }
+        SetNoDelay(sock);
+        metrics.accepts.Add();
+
+        // without SO_REUSEPORT only one worker listens, spread the
+        // clients round robin from here
+        if (m_server.m_sharedListener) {
+            ChatWorker& target = m_server.NextHandoffWorker();
+            if (&target != this) {
+                WorkerMail mail;
+                mail.kind = WorkerMail::Adopt;
+                mail.sock = sock;
+                m_server.PostTo(target, std::move(mail), this);
+                continue;
+            }
+        }
+
+        AddClient(sock);
+    }
+}
+
+void ChatWorker::AdoptPending() {
+    std::vector<socket_t> adopted;
+    adopted.swap(m_adopted);
+    for (socket_t sock : adopted) {
+        AddClient(sock);
+    }
+}
+
+void ChatWorker::AddClient(socket_t sock) {
+    // right here stores in depth client info-------------------
+    ConnHandle handle = m_clients.Add(sock, m_server.NextClientId());
+    uint32_t   slot   = ConnectionTable::SlotOf(handle);
+    int        id     = m_clients.id[slot];
+    m_clients.name[slot]    = "User" + std::to_string(id);
+    m_clients.prefix[slot]  = "[" + m_clients.name[slot] + "] ";
+    m_clients.address[slot] = PeerAddress(sock);
+    int64_t now = NowMs();
+    if (m_limiter.On()) {
+        m_limiter.Attach(m_clients.rate[slot], m_clients.address[slot], now);
+    }
+    m_clients.connectedMs[slot] = now;
+    m_clients.heardMs[slot]     = now;
+    ArmTimer(slot);
+
+    m_server.m_clientCount++;
+    m_poller.Add(sock, handle);
+
+    ChatServer::ClientRoute route;
+    route.id     = id;
+    route.name   = m_clients.name[slot];
+    route.worker = this;
+    route.handle = handle;
+    m_server.RegisterClient(route);
+
+    // everyone starts out in the lobby
+    m_rooms.Join(slot, kLobbyRoom);
+    m_rooms.SetCurrent(slot, kLobbyRoom);
+    m_server.m_rooms.AddLobbyMember();
+
+    m_server.NotifyJoined(id, m_clients.name[slot], m_clients.address[slot]);
+
+    // start of the resume handshake. no broadcasts until it says Hello back
+    SendTo(slot, EncodeSharedHello(m_history.LastSeq(), m_server.Epoch(), m_server.Codecs()));
+
+    //welcome message to the new client. sender = their own id so
+    //the client knows who it is
+    SendTo(slot, EncodeSharedFrame(FrameType::System, id, "Welcome, " + m_clients.name[slot]));
+}
+
+void ChatWorker::HandleReadable(ConnHandle handle) {
+    if (!m_clients.Valid(handle)) {
+        return;
+    }
+    uint32_t slot    = ConnectionTable::SlotOf(handle);
+    socket_t sock    = m_clients.fd[slot];
+    int64_t  started = MetricsNowNs();
+    if (m_clients.rate[slot].resumeMs != 0) {
+        return;   // flooding, OnTimer reads them once they may go on
+    }
+
+    // read until the kernel runs dry (edge triggered). each recv goes
+    // straight into the decoder and every whole frame in it gets handled
+    // before the next one, so one syscall can carry lots of messages.
+    // (the table doesnt grow while we're in here, see AdoptPending)
+    LendReadBuffer(slot);
+    FrameDecoder& decoder  = m_clients.decoder[slot];
+    int64_t       nowMs    = started / 1000000;
+    // frames left over from a pause go first
+    bool          peerGone = !HandleFrames(slot, nowMs);
+    while (!peerGone && m_clients.state[slot] != ConnState::Closing &&
+           m_clients.rate[slot].resumeMs == 0) {
+        char* dst = decoder.WritePtr(kReadChunk);
+        int   n   = recv(sock, dst, static_cast<int>(decoder.WriteSpace()), 0);
+        if (n <= 0) {
+            // 0 = peer closed, anything else but would-block = error
+            peerGone = !(n < 0 && IsWouldBlock(SocketError()));
+            break;
+        }
+        decoder.Commit(n);
+        metrics.bytesIn.Add(static_cast<uint64_t>(n));
+        m_clients.heardMs[slot] = nowMs;   // alive, whatever it was
+        peerGone = !HandleFrames(slot, nowMs);
+    }
+
+    if (peerGone) {
+        m_doomed.push_back(handle);
+    }
+    ReclaimReadBuffer(slot);
+    metrics.readNs.Record(uint64_t(MetricsNowNs() - started));
+}
+
+bool ChatWorker::HandleFrames(uint32_t slot, int64_t nowMs) {
+    FrameDecoder&        decoder = m_clients.decoder[slot];
+    ConnRate&            rate    = m_clients.rate[slot];
+    FrameView            frame;
+    FrameDecoder::Result result  = FrameDecoder::NeedMore;
+    while (m_clients.state[slot] != ConnState::Closing && rate.resumeMs == 0 &&
+           (result = decoder.Next(&frame)) == FrameDecoder::Ready) {
+        // Hello is free, a client cant flood with its one handshake
+        if (frame.header.type != FrameType::Hello && !Admit(slot, frame, nowMs)) {
+            continue;
+        }
+        metrics.framesIn.Add();
+        if (frame.header.type != FrameType::Deflate) {
+            HandleFrame(slot, frame);
+            continue;
+        }
+        // paid for at its packed size above, thats what it cost us
+        FrameView   inner;
+        std::string error;
+        if (!(m_clients.codec[slot] & kCodecDeflate)) {
+            error = "Deflate frame, but didnt ask for deflate";
+        } else if (m_codec.Unpack(frame, &inner, &error)) {
+            metrics.unpacked.Add();
+            HandleFrame(slot, inner);
+            continue;
+        }
+        m_server.NotifyLog("ERR: " + m_clients.name[slot] + " sent garbage (" + error +
+                           "), dropping");
+        return false;
+    }
+    if (result == FrameDecoder::Bad) {
+        m_server.NotifyLog("ERR: " + m_clients.name[slot] + " sent garbage (" +
+                           decoder.ErrorText() + "), dropping");
+        return false;
+    }
+    return true;
+}
+
+bool ChatWorker::Admit(uint32_t slot, const FrameView& frame, int64_t nowMs) {
+    if (!m_limiter.On()) {
+        return true;
+    }
+    ConnRate& rate     = m_clients.rate[slot];
+    int64_t   resumeMs = 0;
+    switch (m_limiter.Admit(rate, kFrameHeaderSize + frame.header.length, nowMs, &resumeMs)) {
+        case RateLimiter::Pass:
+            return true;
+
+        case RateLimiter::Pause:
+            // back in the decoder, and the rest stays in the kernel
+            metrics.throttled.Add();
+            m_clients.decoder[slot].PutBack();
+            rate.resumeMs = resumeMs;
+            Watch(slot);   // not reading till then, poll() mustnt keep waking us for it
+            ArmTimer(slot);
+            return false;
+
+        case RateLimiter::Drop:
+            metrics.throttled.Add();
+            if (!rate.warned) {   // once per burst, not once per frame
+                rate.warned = true;
+                Reply(slot, "(slow down, you're sending too fast. messages dropped)");
+            }
+            // a dropped /history still gets its end, the client waits for it
+            if (AsksHistory(slot, frame)) {
+                EndReplay(slot, "(/history dropped, slow down)");
+            }
+            return false;
+
+        case RateLimiter::Kick:
+            metrics.throttled.Add();
+            metrics.floodDisconnects.Add();
+            m_server.NotifyLog("dropping " + m_clients.name[slot] + ": flooding");
+            Reply(slot, "(too many messages, bye)");
+            m_clients.state[slot] = ConnState::Closing;
+            return false;
+    }
+    return false;
+}
+
+void ChatWorker::ArmTimer(uint32_t slot) {
+    const ChatServerConfig& config = m_server.m_config;
+    int64_t due = INT64_MAX;
+    auto sooner = [&due](int64_t ms) { due = ms < due ? ms : due; };
+
+    if (m_clients.state[slot] == ConnState::Joining && config.helloTimeoutMs > 0) {
+        sooner(m_clients.connectedMs[slot] + config.helloTimeoutMs);
+    }
+    if (config.heartbeatMs > 0) {
+        int64_t pinged = m_clients.pingedMs[slot];
+        sooner(pinged != 0 ? pinged + config.heartbeatTimeoutMs
+                           : m_clients.heardMs[slot] + config.heartbeatMs);
+    }
+    if (m_clients.rate[slot].resumeMs != 0) {
+        sooner(m_clients.rate[slot].resumeMs);
+    }
+
+    if (due == INT64_MAX) {
+        m_timers.Cancel(slot);
+    } else {
+        m_timers.Schedule(slot, due);
+    }
+}
+
+void ChatWorker::OnTimer(uint32_t slot) {
+    if (m_clients.state[slot] == ConnState::Free) {
+        return;   // cant happen (RemoveClient cancels), but cheap
+    }
+    const ChatServerConfig& config = m_server.m_config;
+    int64_t now = NowMs();
+
+    ConnRate& rate = m_clients.rate[slot];
+    if (rate.resumeMs != 0 && rate.resumeMs <= now) {
+        rate.resumeMs = 0;
+        Watch(slot);
+        HandleReadable(m_clients.HandleOf(slot));   // may pause them again
+    }
+
+    if (m_clients.state[slot] == ConnState::Joining && config.helloTimeoutMs > 0 &&
+        now - m_clients.connectedMs[slot] >= config.helloTimeoutMs) {
+        DropDead(slot, "no Hello after " + std::to_string(config.helloTimeoutMs / 1000) + "s");
+        return;
+    }
+
+    // lazy: reads only note the time, the timer works out the rest when
+    // it goes off, and mostly just goes again for last heard + heartbeat
+    if (config.heartbeatMs > 0) {
+        if (rate.resumeMs != 0) {
+            // flood paused: we're the ones not reading. whatever they said
+            // since (their Pong too) waits in the decoder or the kernel, so
+            // they're as alive as it gets
+            m_clients.heardMs[slot] = now;
+        }
+        int64_t& pinged = m_clients.pingedMs[slot];
+        int64_t  heard  = m_clients.heardMs[slot];
+        if (pinged != 0 && heard >= pinged) {
+            pinged = 0;   // answered
+        }
+        if (pinged != 0 && now - pinged >= config.heartbeatTimeoutMs) {
+            DropDead(slot, "no answer to ping in " +
+                           std::to_string(config.heartbeatTimeoutMs / 1000) + "s");
+            return;
+        }
+        if (pinged == 0 && now - heard >= config.heartbeatMs) {
+            pinged = now;
+            metrics.pings.Add();
+            SendTo(slot, EncodeSharedFrame(FrameType::Ping, 0, nullptr, 0));
+        }
+    }
+    ArmTimer(slot);
+}
+
+void ChatWorker::DropDead(uint32_t slot, const std::string& why) {
+    metrics.timeouts.Add();
+    m_server.NotifyLog("dropping " + m_clients.name[slot] + ": " + why);
+    m_clients.state[slot] = ConnState::Closing;
+    m_clients.outq[slot].Clear();
+    m_timers.Cancel(slot);
+    m_doomed.push_back(m_clients.HandleOf(slot));
+}
+
+void ChatWorker::HandleFrame(uint32_t slot, const FrameView& frame) {
+    switch (frame.header.type) {
+        case FrameType::Chat:
+            HandleChat(slot, frame.payload, frame.header.length);
+            break;
+
+        case FrameType::Hello:
+            HandleHello(slot, frame);
+            break;
+
+        case FrameType::Direct:
+            HandleDirect(slot, frame.header.sender, frame.Text());
+            break;
+
+        case FrameType::Ping:
+            SendTo(slot, EncodeSharedFrame(FrameType::Pong, 0, nullptr, 0));
+            break;
+
+        case FrameType::Pong:
+            break;   // reading it was the point (heardMs)
+
+        case FrameType::Typing:
+            // only where they talk, and only once they're properly in
+            if (m_clients.state[slot] == ConnState::Open && m_rooms.Current(slot) != kNoRoom) {
+                m_server.m_presence.Typing(static_cast<uint32_t>(m_clients.id[slot]),
+                                           m_rooms.Current(slot));
+            }
+            break;
+
+        default:
+            // clients dont get to send anything else yet
+            break;
+    }
+}
+
+void ChatWorker::HandleChat(uint32_t slot, const char* text, size_t length) {
+    // trimmed in place, a plain chat line never becomes a std::string
+    const char* end = text + length;
+    while (text < end && IsBlank(*text)) {
+        text++;
+    }
+    while (end > text && IsBlank(end[-1])) {
+        end--;
+    }
+    length = static_cast<size_t>(end - text);
+    if (length == 0) {
+        return;
+    }
+
+    const std::string& name = m_clients.name[slot];
+
+    // special handling for "Exit" to match project requirements
+    if (length == 4 && std::memcmp(text, "Exit", 4) == 0) {
+        m_server.NotifyLog("[" + name + "] requested Exit");
+
+        // send Exit back so client knows to shut down, then drop it
+        m_clients.state[slot] = ConnState::Closing;
+        SendTo(slot, EncodeSharedFrame(FrameType::Exit, 0, nullptr, 0));
+        return;
+    }
+
+    if (text[0] == '/' && HandleCommand(slot, std::string(text, length))) {
+        return;
+    }
+
+    // normal chat message: tell the observer and broadcast to the room.
+    // lobby lines look like they always did, the rest say where they're from
+    uint16_t room = m_rooms.Current(slot);
+    if (room == kNoRoom) {
+        Reply(slot, "(you're not in any room, /join one first)");
+        return;
+    }
+    const std::string& tag = m_server.m_rooms.Tag(room);
+    if (m_server.m_observer) {   // no point building the line for nobody
+        if (m_observedCount == m_observed.size()) {
+            m_observed.emplace_back();
+        }
+        ObservedMessage& line = m_observed[m_observedCount++];
+        line.id = m_clients.id[slot];
+        line.name.assign(name);
+        line.text.assign(tag);
+        line.text.append(text, length);
+    }
+    m_prefix.assign(tag);
+    m_prefix += m_clients.prefix[slot];
+    BroadcastChat(m_clients.id[slot], room, m_prefix, text, length);
+}
+
+bool ChatWorker::HandleCommand(uint32_t slot, const std::string& message) {
+    size_t      space   = message.find(' ');
+    std::string command = message.substr(0, space);
+    std::string arg     = space == std::string::npos ? "" : Trim(message.substr(space + 1));
+
+    if (command == "/join") {
+        JoinRoom(slot, arg);
+    } else if (command == "/leave") {
+        LeaveRoom(slot, arg);
+    } else if (command == "/rooms") {
+        ListRooms(slot);
+    } else if (command == "/msg") {
+        HandleDirect(slot, 0, arg);
+    } else if (command == "/nick") {
+        Rename(slot, arg);
+    } else if (command == "/history") {
+        ReplayHistory(slot, arg);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// one socket to write to, wherever it lives. no seq, no history, no
+// observer: the only copies are the one for them and the one back to us
+void ChatWorker::HandleDirect(uint32_t slot, uint32_t to, const std::string& text) {
+    std::string message = Trim(text);
+    std::string who     = std::to_string(to);
+    if (to == 0) {
+        size_t space = message.find(' ');
+        who     = message.substr(0, space);
+        message = space == std::string::npos ? "" : Trim(message.substr(space + 1));
+    }
+    if (who.empty() || message.empty()) {
+        Reply(slot, "(usage: /msg NAME text, or /msg ID text)");
+        return;
+    }
+
+    ChatServer::ClientRoute route;
+    if (!m_server.FindClient(who, &route)) {
+        Reply(slot, "(nobody called " + who + " is on)");
+        return;
+    }
+
+    std::string head  = "[" + m_clients.name[slot] + " -> " + route.name + "] ";
+    BufferRef   frame = EncodeSharedFrame(FrameType::Direct, m_clients.id[slot],
+                                          head.data(), head.size(),
+                                          message.data(), message.size());
+    m_server.Deliver(route, frame, this);
+    if (route.id != m_clients.id[slot]) {
+        SendTo(slot, frame);   // the receipt
+    }
+}
+
+// joins (making the room if its new) and talks there from now on
+void ChatWorker::JoinRoom(uint32_t slot, const std::string& name) {
+    std::string room = RoomDirectory::Normalize(name);
+    if (room.empty()) {
+        Reply(slot, "(usage: /join name, letters digits - and _ only, up to " +
+                    std::to_string(kMaxRoomName) + ")");
+        return;
+    }
+    if (m_rooms.Joined(slot) >= kMaxJoined) {
+        Reply(slot, "(you're in " + std::to_string(kMaxJoined) + " rooms, /leave one first)");
+        return;
+    }
+    uint16_t id = m_server.m_rooms.Join(room, m_server.m_lastSeq);
+    if (id == kNoRoom) {
+        Reply(slot, "(too many rooms on this server, cant make #" + room + ")");
+        return;
+    }
+    if (!m_rooms.Join(slot, id)) {
+        m_server.m_rooms.DropMember(id);   // already in, counted twice
+    }
+    m_rooms.SetCurrent(slot, id);
+    Reply(slot, "(talking in #" + room + ", " +
+                std::to_string(m_server.m_rooms.Members(id)) + " here)");
+}
+
+void ChatWorker::Rename(uint32_t slot, const std::string& name) {
+    std::string error;
+    if (!m_server.RenameClient(m_clients.id[slot], name, &error)) {
+        Reply(slot, "(" + error + ")");
+        return;
+    }
+    std::string old = m_clients.name[slot];
+    m_clients.name[slot]   = name;
+    m_clients.prefix[slot] = "[" + name + "] ";
+    Reply(slot, "(you're " + name + " now)");
+    m_server.NotifyRenamed(m_clients.id[slot], old, name);
+}
+
+// no name = the room we're talking in
+void ChatWorker::LeaveRoom(uint32_t slot, const std::string& name) {
+    uint16_t id = m_rooms.Current(slot);
+    if (!name.empty()) {
+        std::string room = RoomDirectory::Normalize(name);
+        id = room.empty() ? kNoRoom : m_server.m_rooms.Find(room);
+    }
+    if (id == kNoRoom || !m_rooms.Leave(slot, id)) {
+        Reply(slot, "(you're not in " + (name.empty() ? std::string("any room") : name) + ")");
+        return;
+    }
+    // the name before we let go, the last one out frees the id
+    uint16_t    now  = m_rooms.Current(slot);
+    std::string text = "(left #" + m_server.m_rooms.Name(id) + ", " +
+                       (now == kNoRoom ? std::string("/join a room to talk again")
+                                       : "talking in #" + m_server.m_rooms.Name(now)) + ")";
+    m_server.m_rooms.DropMember(id);
+    Reply(slot, text);
+}
+
+// ours first, then whatever else has people in it
+void ChatWorker::ListRooms(uint32_t slot) {
+    const RoomDirectory& rooms   = m_server.m_rooms;
+    const size_t         kListed = 50;
+
+    std::string text = "(you're in";
+    for (uint16_t id : m_rooms.RoomsOf(slot)) {
+        text += " #" + rooms.Name(id) + (id == m_rooms.Current(slot) ? "*" : "");
+    }
+    if (m_rooms.Current(slot) == kNoRoom) {
+        text += " nothing";
+    }
+
+    text += ". open:";
+    std::vector<std::pair<std::string, uint32_t>> listed;
+    size_t open = rooms.Open(kListed, &listed);
+    for (const auto& room : listed) {
+        text += " #" + room.first + " " + std::to_string(room.second);
+    }
+    if (open > kListed) {
+        text += " and " + std::to_string(open - kListed) + " more";
+    }
+    Reply(slot, text + ")");
+}
+
+void ChatWorker::Reply(uint32_t slot, const std::string& text) {
+    SendTo(slot, EncodeSharedFrame(FrameType::System, 0, text));
+}
+
+// the client's half of the handshake: send what it missed, then it's live
+void ChatWorker::HandleHello(uint32_t slot, const FrameView& frame) {
+    if (m_clients.state[slot] != ConnState::Joining) {
+        return;   // only once
+    }
+
+    // deflate from here on, both ways, if they asked and we offered it
+    if (HelloCodecs(frame) & m_server.Codecs() & kCodecDeflate) {
+        m_clients.codec[slot] = kCodecDeflate;
+        m_server.m_deflateClients++;
+    }
+
+    // a seq from another epoch (server restarted since) is worthless, and
+    // a brand new client has none. both get all the history we have
+    uint32_t lastSeen = frame.header.seq;
+    if (HelloEpoch(frame) != m_server.Epoch()) {
+        lastSeen = 0;
+    }
+
+    m_history.Expire(NowMs());
+    uint32_t newest = m_history.LastSeq();
+    uint32_t from   = lastSeen + 1;
+    if (lastSeen == 0) {
+        // newcomer: the same amount the ring would hold
+        const ChatServerConfig& config = m_server.m_config;
+        from = newest >= config.historyFrames ? newest - uint32_t(config.historyFrames) + 1 : 1;
+        if (m_server.m_log && config.historySeconds > 0) {
+            uint32_t recent = m_server.m_log->SeqAtTime(ChatLog::NowMs() -
+                                                        int64_t(config.historySeconds) * 1000);
+            from = recent > from ? recent : from;
+        }
+    }
+
+    // only the rooms this client is in. its in the lobby unless it sent
+    // /join and /leave before the Hello (a reconnecting client does, to
+    // get its rooms back first)
+    std::vector<FileSpan> spans;
+    uint32_t              have = HistorySpans(slot, from, newest, &spans);
+
+    if (lastSeen != 0 && from <= newest && have > from) {
+        if (!Queue(slot, EncodeSharedFrame(FrameType::System, 0,
+                                           "(some messages from while you were away are gone)"))) {
+            return;
+        }
+    }
+
+    // who is online, before any chat so the names make sense. deltas from
+    // here on reach it like everyone else (its Open before the mailbox is
+    // looked at again), the version in the snapshot sorts out overlap
+    for (const BufferRef& frame : m_server.m_presence.Snapshot()) {
+        if (!Queue(slot, frame)) {
+            return;
+        }
+    }
+
+    if (!QueueHistory(slot, from, newest, spans)) {
+        return;
+    }
+    if (!Flush(slot)) {
+        m_doomed.push_back(m_clients.HandleOf(slot));
+        return;
+    }
+
+    // nothing can slip in between: broadcasts only arrive through our
+    // own mailbox, which isnt drained while we're in here
+    m_clients.state[slot] = ConnState::Open;
+}
+
+// what the ring no longer has of from..to: the persistent log might still
+// have it, served straight from the file (sendfile, no copy through here).
+// return = oldest seq the slot will get
+uint32_t ChatWorker::HistorySpans(uint32_t slot, uint32_t from, uint32_t to,
+                                  std::vector<FileSpan>* spans) {
+    uint32_t ringFirst = m_history.FirstSeq();
+    if (from >= ringFirst || !m_server.m_log) {
+        return ringFirst;
+    }
+    uint32_t upTo  = std::min(to, ringFirst - 1);
+    uint32_t first = 0;
+    uint32_t last  = m_server.m_log->Spans(from, upTo, spans, &first, Wanted(slot));
+    // only if it joins up with the ring (or reaches to), a hole in the
+    // middle would look like nothing was missed
+    if (last != upTo) {
+        spans->clear();
+        return ringFirst;
+    }
+    return first;
+}
+
+// the whole catch-up is queued first (refs to frames we already have,
+// nothing re-encoded) and goes out in as few gathered writes as the
+// socket allows, not one send per message
+bool ChatWorker::QueueHistory(uint32_t slot, uint32_t from, uint32_t to,
+                              const std::vector<FileSpan>& spans) {
+    OutboundQueue& outq = m_clients.outq[slot];
+    for (const FileSpan& span : spans) {
+        outq.PushFile(span);
+    }
+    auto wanted = Wanted(slot);
+    bool packed = (m_clients.codec[slot] & kCodecDeflate) != 0;
+    for (size_t i = m_history.FirstAfter(from - 1); i < m_history.Size(); i++) {
+        const BufferRef& frame = m_history.At(i);
+        if (FrameSeq(frame) > to) {
+            break;
+        }
+        if (!wanted(FrameRoom(frame), FrameSeq(frame))) {
+            continue;
+        }
+        if (!Queue(slot, packed && m_history.PackedAt(i) ? m_history.PackedAt(i) : frame)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// only the rooms the slot is in, and only from the room that has the id
+// now, not an older one
+ChatLog::RoomFilter ChatWorker::Wanted(uint32_t slot) const {
+    return [this, slot](uint16_t room, uint32_t seq) {
+        return room == kAllRooms ||
+               (m_rooms.IsMember(slot, room) && m_server.m_rooms.Fresh(room, seq));
+    };
+}
+
+// "/history 120-300" (seqs, no end = up to now) or "/history 30m" (s, m
+// or h ago). the rooms it's in, at most as much as a newcomer gets, sent
+// like a catch-up. whatever happens the answer ends with a System frame
+// that has a seq, that's how the client knows the repeats are over
+void ChatWorker::ReplayHistory(uint32_t slot, const std::string& arg) {
+    const ChatServerConfig& config = m_server.m_config;
+    auto end = [this, slot](const std::string& text) { EndReplay(slot, text); };
+
+    m_history.Expire(NowMs());
+    uint32_t newest = m_history.LastSeq();
+    uint32_t from   = 0;
+    uint32_t to     = newest;
+    char*    rest   = nullptr;
+    unsigned long value = std::strtoul(arg.c_str(), &rest, 10);
+    if (arg.empty() || !std::isdigit(static_cast<unsigned char>(arg[0])) || value > UINT32_MAX) {
+        end("(usage: /history FROM[-TO] with seqs, or /history 30m for the last s/m/h)");
+        return;
+    }
+    if (*rest == 's' || *rest == 'm' || *rest == 'h') {
+        int64_t ms = int64_t(value) * (*rest == 's' ? 1000 : *rest == 'm' ? 60000 : 3600000);
+        size_t  i  = m_history.FirstAt(NowMs() - ms);
+        from = i < m_history.Size() ? FrameSeq(m_history.At(i)) : newest + 1;
+        if (m_server.m_log && i == 0) {
+            // the ring doesnt go back that far, the log might
+            uint32_t logged = m_server.m_log->SeqAtTime(ChatLog::NowMs() - ms);
+            from = logged != 0 && logged < from ? logged : from;
+        }
+        rest++;
+    } else {
+        from = static_cast<uint32_t>(value);
+        if (*rest == '-' && std::isdigit(static_cast<unsigned char>(rest[1]))) {
+            unsigned long upTo = std::strtoul(rest + 1, &rest, 10);
+            to = static_cast<uint32_t>(std::min<unsigned long>(upTo, newest));
+        }
+    }
+    if (*rest != '\0') {
+        end("(usage: /history FROM[-TO] with seqs, or /history 30m for the last s/m/h)");
+        return;
+    }
+
+    from = std::max<uint32_t>(from, 1);
+    if (config.historyFrames == 0 || from > to) {
+        end("(no history for that)");
+        return;
+    }
+    // the newest part of a range that's too long
+    if (to - from >= config.historyFrames) {
+        from = to - uint32_t(config.historyFrames) + 1;
+        Reply(slot, "(only the last " + std::to_string(config.historyFrames) + " of those)");
+    }
+
+    std::vector<FileSpan> spans;
+    uint32_t              have = HistorySpans(slot, from, to, &spans);
+    if (have > from) {
+        Reply(slot, have > to ? std::string("(thats gone, history starts at seq ") +
+                                    std::to_string(have) + ")"
+                              : "(seqs " + std::to_string(from) + "-" +
+                                    std::to_string(have - 1) + " are gone)");
+    }
+    if (have <= to && !QueueHistory(slot, from, to, spans)) {
+        return;
+    }
+    end("(end of history)");
+}
+
+// the System frame with a seq that ends a /history answer. kept in the
+// queue whatever the slow consumer policy throws away, or the client
+// would wait for it forever
+void ChatWorker::EndReplay(uint32_t slot, const std::string& text) {
+    if (m_clients.state[slot] == ConnState::Closing) {
+        return;
+    }
+    BufferRef frame = EncodeSharedFrame(FrameType::System, 0, text);
+    SetFrameSeq(frame, m_history.LastSeq() + 1);
+    m_clients.outq[slot].PushKept(frame);
+    metrics.framesOut.Add();
+    MarkDirty(slot);
+}
+
+// is this (maybe deflated) frame a /history. only asked on the drop path
+bool ChatWorker::AsksHistory(uint32_t slot, const FrameView& frame) {
+    FrameView   inner = frame;
+    std::string error;
+    if (frame.header.type == FrameType::Deflate &&
+        (!(m_clients.codec[slot] & kCodecDeflate) || !m_codec.Unpack(frame, &inner, &error))) {
+        return false;
+    }
+    if (inner.header.type != FrameType::Chat) {
+        return false;
+    }
+    const char* text = inner.payload;
+    const char* end  = text + inner.header.length;
+    while (text < end && IsBlank(*text)) {
+        text++;
+    }
+    while (end > text && IsBlank(end[-1])) {
+        end--;
+    }
+    // split like HandleCommand does, at the first space
+    size_t length = static_cast<size_t>(end - text);
+    return length >= 8 && std::memcmp(text, "/history", 8) == 0 &&
+           (length == 8 || text[8] == ' ');
+}
+
+void ChatWorker::Remember(const BufferRef& frame, const BufferRef& packed) {
+    m_history.Push(frame, NowMs(), packed);
+}
+
+bool ChatWorker::Queue(uint32_t slot, const BufferRef& frame) {
+    OutboundQueue& outq     = m_clients.outq[slot];
+    size_t         affected = 0;
+    switch (outq.Push(frame, m_server.m_config.maxQueuedBytes,
+                      m_server.m_config.slowPolicy, &affected)) {
+        case OutboundQueue::Queued:
+            break;
+
+        case OutboundQueue::DroppedOldest:
+            metrics.framesDropped.Add(affected);
+            break;
+
+        case OutboundQueue::Coalesced:
+            metrics.framesCoalesced.Add(affected);
+            break;
+
+        case OutboundQueue::Overflow:
+            // its already behind, no point queueing a goodbye it wont read
+            metrics.slowDisconnects.Add();
+            m_server.NotifyLog("dropping " + m_clients.name[slot] + ": slow consumer (" +
+                               std::to_string(outq.Bytes()) + " bytes stuck in queue)");
+            m_clients.state[slot] = ConnState::Closing;
+            outq.Clear();
+            m_doomed.push_back(m_clients.HandleOf(slot));
+            return false;
+    }
+    metrics.framesOut.Add();
+    metrics.queueBytes.Record(outq.Bytes());
+    return true;
+}
+
+void ChatWorker::SendTo(uint32_t slot, const BufferRef& frame) {
+    if (Queue(slot, frame)) {
+        MarkDirty(slot);
+    }
+}
+
+// what the poller should wake us for: write while there's a backlog,
+// read unless the client is paused for flooding
+void ChatWorker::Watch(uint32_t slot) {
+    m_poller.Modify(m_clients.fd[slot], m_clients.HandleOf(slot), !m_clients.outq[slot].Empty(),
+                    m_clients.rate[slot].resumeMs == 0);
+}
+
+void ChatWorker::MarkDirty(uint32_t slot) {
+    if (m_clients.dirty[slot]) {
+        return;
+    }
+    m_clients.dirty[slot] = 1;
+    if (m_dirty.empty()) {
+        m_dirtySinceNs = MetricsNowNs();
+    }
+    m_dirty.push_back(m_clients.HandleOf(slot));
+}
+
+void ChatWorker::FlushDirty(bool force) {
+    if (m_dirty.empty()) {
+        return;
+    }
+    uint32_t budgetUs = m_server.m_config.flushDelayUs;
+    if (!force && budgetUs > 0 &&
+        MetricsNowNs() - m_dirtySinceNs < int64_t(budgetUs) * 1000) {
+        return;
+    }
+
+    // Flush doesnt queue anything, so nobody gets added while we walk
+    m_flushing.swap(m_dirty);
+    for (ConnHandle handle : m_flushing) {
+        // gone since (the slot may have someone new, with its own entry)
+        if (!m_clients.Valid(handle)) {
+            continue;
+        }
+        uint32_t slot = ConnectionTable::SlotOf(handle);
+        m_clients.dirty[slot] = 0;
+        if (!Flush(slot)) {
+            m_doomed.push_back(handle);
+        }
+    }
+    m_flushing.clear();
+}
+
+int ChatWorker::PollTimeoutMs() const {
+    int64_t timeout = m_timers.NextMs(NowMs(), 1000);
+    if (!m_dirty.empty()) {
+        int64_t left = int64_t(m_server.m_config.flushDelayUs) * 1000 -
+                       (MetricsNowNs() - m_dirtySinceNs);
+        // round up, waking early would just mean another round trip
+        left    = (left + 999999) / 1000000;
+        timeout = left < timeout ? left : timeout;
+    }
+    return timeout <= 0 ? 0 : static_cast<int>(timeout);
+}
+
+// writes as much of the queue as the kernel takes. false = socket is dead
+bool ChatWorker::Flush(uint32_t slot) {
+    OutboundQueue& outq = m_clients.outq[slot];
+    socket_t       sock = m_clients.fd[slot];
+
+    // everything queued goes in one syscall (up to kMaxGather frames),
+    // a backlog or a join catch-up doesnt cost a send per message. history
+    // from the log goes file -> socket with sendfile. if it takes more than
+    // one, cork so the pieces leave as full segments, not a short one per
+    // call (nodelay is on)
+    IoSlice slices[kMaxGather];
+    bool    corked = false;
+    while (!outq.Empty()) {
+        uint64_t fileOffset = 0;
+        size_t   fileSize   = 0;
+        long     n;
+        if (const FileSpan* span = outq.HeadFile(&fileOffset, &fileSize)) {
+            n = SendFileRange(sock, span->fd, fileOffset, fileSize);
+        } else {
+            size_t count = outq.Gather(slices, kMaxGather);
+            n = SendGather(sock, slices, count);
+        }
+        metrics.writes.Add();
+        if (n > 0) {
+            outq.Consume(static_cast<size_t>(n));
+            metrics.bytesOut.Add(static_cast<uint64_t>(n));
+            if (!corked && !outq.Empty()) {
+                SetCork(sock, true);
+                corked = true;
+            }
+            continue;
+        }
+        bool blocked = n < 0 && IsWouldBlock(SocketError());
+        if (corked) {
+            SetCork(sock, false);
+        }
+        if (blocked) {
+            Watch(slot);   // outq isnt empty: wants write
+            return true;
+        }
+        return false;
+    }
+    if (corked) {
+        SetCork(sock, false);
+    }
+
+    Watch(slot);
+
+    if (m_clients.state[slot] == ConnState::Closing) {
+        // done saying goodbye
+        return false;
+    }
+    return true;
+}
+
+// encode once, every worker (us too) gets the same bytes
+void ChatWorker::BroadcastChat(uint32_t sender, uint16_t room,
+                               const std::string& prefix, const char* text, size_t length) {
+    BufferRef msg = EncodeSharedFrame(FrameType::Chat, sender,
+                                      prefix.data(), prefix.size(), text, length);
+    SetFrameRoom(msg, room);
+    m_server.Publish(msg, this);
+}
+
+// a room frame walks only that room's members here. kAllRooms is a
+// linear walk over the packed state column. Joining clients are skipped
+// either way (their catch-up comes with the Hello)
+void ChatWorker::FanOut(const BufferRef& frame, const BufferRef& packed) {
+    // without a packed one everybody gets the plain one, codec or not
+    const uint8_t  mask    = packed ? kCodecDeflate : 0;
+    const uint8_t* codec   = m_clients.codec.data();
+    uint16_t       room    = FrameRoom(frame);
+    if (room != kAllRooms) {
+        const std::vector<uint32_t>* members = m_rooms.Members(room);
+        // sat in the mailbox while its room emptied and the id went to a
+        // new one: nobody left to get it
+        if (!members || !m_server.m_rooms.Fresh(room, FrameSeq(frame))) {
+            return;
+        }
+        // SendTo never removes anyone (that waits for ReapClients), so
+        // the member list holds still while we walk it
+        for (uint32_t slot : *members) {
+            if (m_clients.state[slot] == ConnState::Open) {
+                SendTo(slot, (codec[slot] & mask) ? packed : frame);
+            }
+        }
+        return;
+    }
+
+    const uint32_t slots = m_clients.Slots();
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        if (m_clients.state[slot] == ConnState::Open) {
+            SendTo(slot, (codec[slot] & mask) ? packed : frame);
+        }
+    }
+}
+
+void ChatWorker::RemoveClient(ConnHandle handle) {
+    if (!m_clients.Valid(handle)) {
+        return;
+    }
+
+    uint32_t    slot = ConnectionTable::SlotOf(handle);
+    socket_t    sock = m_clients.fd[slot];
+    int         id   = m_clients.id[slot];
+    std::string name = m_clients.name[slot];
+
+    m_poller.Remove(sock);
+    CloseSocket(sock);
+    m_clients.decoder[slot].Reset();   // whatever half frame it left behind
+    ReclaimReadBuffer(slot);
+    m_limiter.Detach(m_clients.rate[slot]);
+    m_timers.Cancel(slot);
+    if (m_clients.codec[slot] & kCodecDeflate) {
+        m_server.m_deflateClients--;
+    }
+    m_server.UnregisterClient(id);
+    m_rooms.LeaveAll(slot, [this](uint16_t room) { m_server.m_rooms.DropMember(room); });
+    m_clients.Remove(handle);
+    m_server.m_clientCount--;
+
+    m_server.NotifyLeft(id, name);
+}
+
+void ChatWorker::LendReadBuffer(uint32_t slot) {
+    FrameDecoder& decoder = m_clients.decoder[slot];
+    if (decoder.Capacity() > 0) {
+        return;   // kept one from last time (half a frame in it)
+    }
+    if (m_readBuffers.empty()) {
+        std::vector<char> fresh(kReadBuffer);
+        decoder.SwapBuffer(fresh);
+        return;
+    }
+    decoder.SwapBuffer(m_readBuffers.back());
+    m_readBuffers.pop_back();
+}
+
+void ChatWorker::ReclaimReadBuffer(uint32_t slot) {
+    FrameDecoder& decoder = m_clients.decoder[slot];
+    if (decoder.Capacity() == 0 || decoder.Buffered() > 0) {
+        return;
+    }
+    // one grown past the usual size (a big frame) goes back to the heap
+    if (m_readBuffers.size() < kPooledBuffers && decoder.Capacity() <= kReadBuffer) {
+        m_readBuffers.emplace_back();
+        decoder.SwapBuffer(m_readBuffers.back());
+    } else {
+        std::vector<char> drop;
+        decoder.SwapBuffer(drop);
+    }
+}
+
+void ChatWorker::ReapClients() {
+    std::vector<ConnHandle> doomed;
+    doomed.swap(m_doomed);
+    for (ConnHandle handle : doomed) {
+        RemoveClient(handle);
+    }
+}
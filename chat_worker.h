@@ -0,0 +1,205 @@
+// chat_worker.h
+// one reactor thread of the chat server. (internal, use ChatServer)
+//
+// each worker has its own poller, its own listener on the shared port
+// (SO_REUSEPORT, the kernel spreads new connections across them) and its
+// own set of clients, so workers never lock each other on the hot path.
+// a broadcast is published (ChatServer::Publish) to every worker's mailbox
+// as one shared frame, the sender's own included, so all workers see all
+// broadcasts in the same seq order. each keeps the recent ones in m_history
+// for clients that join, or come back after a dropped connection.
+//
+// a broadcast belongs to one room (its header says which) and only goes
+// to this worker's members of that room, see chat_rooms.h.
+
+#pragma once
+
+#include "chat_compress.h"
+#include "chat_conntable.h"
+#include "chat_history.h"
+#include "chat_log.h"
+#include "chat_mailbox.h"
+#include "chat_metrics.h"
+#include "chat_net.h"
+#include "chat_outqueue.h"
+#include "chat_poller.h"
+#include "chat_protocol.h"
+#include "chat_ratelimit.h"
+#include "chat_rooms.h"
+#include "chat_timerwheel.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ChatServer;
+struct ObservedMessage;
+
+// something another thread wants a worker to do
+struct WorkerMail {
+    enum Kind {
+        None,
+        Broadcast,   // fan frame out to my clients
+        Adopt,       // take over sock (accepted by a worker without a listener of its own)
+        Direct,      // frame is for one client of mine (handle)
+        Presence     // presence delta, fan out like a broadcast but not kept
+    };
+
+    Kind       kind = None;
+    BufferRef  frame;
+    BufferRef  packed;   // Broadcast, Presence: frame deflated, null = send it plain
+    socket_t   sock     = CHAT_INVALID_SOCKET;
+    ConnHandle handle   = 0;
+    int64_t    postedNs = 0;   // Broadcast: when it was published (MetricsNowNs)
+};
+
+class ChatWorker {
+public:
+    ChatWorker(ChatServer& server, int index);
+    ~ChatWorker();
+
+    // listener may be CHAT_INVALID_SOCKET (then we only get adopted clients)
+    bool Open(socket_t listener, std::string* error);
+    void StartThread();
+    void Join();
+    void CloseAll();   // after Join()
+
+    // any thread. false = mailbox full
+    bool Post(WorkerMail&& mail);
+    // owner thread, used while spinning on someone elses full mailbox so
+    // two workers posting to each other cant deadlock
+    void DrainMailbox();
+    // owner thread. a direct message for one of ours, dropped if the
+    // handle is stale (they left)
+    void DeliverDirect(ConnHandle handle, const BufferRef& frame);
+    // owner thread. frame deflated with our codec, null = it didnt shrink
+    BufferRef Pack(const BufferRef& frame);
+
+    int Index() const { return m_index; }
+    // cpu time this worker's thread has burned (0 where we cant tell)
+    uint64_t CpuNanos();
+
+    // counters and timings (written by this worker, read by anyone)
+    WorkerMetrics metrics;
+
+private:
+    void Run();
+    void AcceptConnections();
+    void AdoptPending();
+    void AddClient(socket_t sock);
+    void HandleReadable(ConnHandle handle);
+    // every whole frame in the decoder, up to a flood pause.
+    // false = garbage, drop them
+    bool HandleFrames(uint32_t slot, int64_t nowMs);
+    // the rate limiter's say on one frame. false = dont handle it
+    bool Admit(uint32_t slot, const FrameView& frame, int64_t nowMs);
+    // the slot's timer: the soonest of its hello deadline, heartbeat and
+    // flood pause
+    void ArmTimer(uint32_t slot);
+    // it went off: resume a paused client, ping a quiet one, drop a dead one
+    void OnTimer(uint32_t slot);
+    // no goodbye, they're not listening
+    void DropDead(uint32_t slot, const std::string& why);
+    void HandleFrame(uint32_t slot, const FrameView& frame);
+    // text is the payload, still in the read buffer
+    void HandleChat(uint32_t slot, const char* text, size_t length);
+    // /join, /leave, /rooms, /msg, /nick, /history. false = not a command, chat it
+    bool HandleCommand(uint32_t slot, const std::string& message);
+    // to = client id, 0 = the text starts with their name or id
+    void HandleDirect(uint32_t slot, uint32_t to, const std::string& text);
+    void JoinRoom(uint32_t slot, const std::string& name);
+    void LeaveRoom(uint32_t slot, const std::string& name);
+    void ListRooms(uint32_t slot);
+    void Rename(uint32_t slot, const std::string& name);
+    void Reply(uint32_t slot, const std::string& text);
+    void HandleHello(uint32_t slot, const FrameView& frame);
+    // /history: a range of seqs, or the last so many minutes
+    void ReplayHistory(uint32_t slot, const std::string& arg);
+    void EndReplay(uint32_t slot, const std::string& text);
+    bool AsksHistory(uint32_t slot, const FrameView& frame);
+    // log spans for the part of from..to the ring doesnt have. return =
+    // the oldest seq there is for it
+    uint32_t HistorySpans(uint32_t slot, uint32_t from, uint32_t to, std::vector<FileSpan>* spans);
+    // spans, then the ring's frames up to to. false = the client got dropped
+    bool QueueHistory(uint32_t slot, uint32_t from, uint32_t to, const std::vector<FileSpan>& spans);
+    // the frames of history the slot should see (its rooms, kAllRooms)
+    ChatLog::RoomFilter Wanted(uint32_t slot) const;
+    void Remember(const BufferRef& frame, const BufferRef& packed);
+    // queue without writing yet. false = the client got dropped for it
+    bool Queue(uint32_t slot, const BufferRef& frame);
+    void SendTo(uint32_t slot, const BufferRef& frame);   // Queue + MarkDirty
+    // the slot gets flushed with everyone else's at the end of the pass
+    void MarkDirty(uint32_t slot);
+    // tell the poller whether we want to read / write the slot now
+    void Watch(uint32_t slot);
+    // this pass's chat lines to the observer, if any
+    void HandObserved();
+    // one Flush per dirty client. with a flush budget, only once the
+    // oldest dirty one has waited that long
+    void FlushDirty(bool force);
+    // poll timeout that still meets the flush budget and the next timer
+    int  PollTimeoutMs() const;
+    bool Flush(uint32_t slot);
+    void BroadcastChat(uint32_t sender, uint16_t room,
+                       const std::string& prefix, const char* text, size_t length);
+    // pooled read buffers: one goes to a client while we read it and comes
+    // back once the client is read dry, see FrameDecoder::SwapBuffer
+    void LendReadBuffer(uint32_t slot);
+    void ReclaimReadBuffer(uint32_t slot);
+    // packed goes to the clients that picked deflate, if there is one
+    void FanOut(const BufferRef& frame, const BufferRef& packed);
+    void RemoveClient(ConnHandle handle);
+    void ReapClients();
+
+    ChatServer& m_server;
+    int         m_index;
+
+    Poller   m_poller;
+    Wakeup   m_wakeup;
+    socket_t m_listener;
+
+    ConnectionTable         m_clients;
+    std::vector<ConnHandle> m_doomed;   // removed once we're out of the loop body
+    // adopted sockets wait here until we're back at the top of the loop,
+    // adding a client can grow the table under whoever is mid-frame
+    std::vector<socket_t>   m_adopted;
+
+    // clients with frames queued since their last flush. each one is on
+    // here once (see ConnectionTable::dirty), so a burst of broadcasts
+    // costs one write per client, not one per frame
+    std::vector<ConnHandle> m_dirty;
+    std::vector<ConnHandle> m_flushing;      // spare, swapped with m_dirty
+    int64_t                 m_dirtySinceNs;  // when m_dirty last went non-empty
+
+    // read buffers nobody is using. only a client with half a frame left
+    // over keeps one between reads, so this is usually one or two
+    std::vector<std::vector<char>> m_readBuffers;
+    // "[#room] [name] " gets put together here, no fresh string per line
+    std::string                    m_prefix;
+    // chat lines for the observer, handed over once per pass (the server
+    // lock is shared by every worker, it doesnt get taken per message).
+    // the first m_observedCount are this pass's, the rest are kept for
+    // their string buffers
+    std::vector<ObservedMessage>   m_observed;
+    size_t                         m_observedCount;
+
+    // newest broadcasts in seq order (oldest first)
+    HistoryRing m_history;
+
+    // who is in which room, our slots only
+    RoomMembers m_rooms;
+
+    // flood buckets, see chat_ratelimit.h
+    RateLimiter m_limiter;
+
+    // one timer per client slot, see ArmTimer
+    TimerWheel  m_timers;
+
+    // deflates broadcasts our clients said, inflates what they send packed
+    FrameCodec  m_codec;
+
+    Mailbox<WorkerMail> m_mailbox;
+    std::thread         m_thread;
+};
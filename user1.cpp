@@ -0,0 +1,235 @@
+// user1.cpp
+// user1 without the window: the chat server in a terminal.
+// same room as user1_gui (ChatServer underneath), no wxWidgets, so it
+// starts right away and runs fine on a pi or in a container.
+//
+// usage: user1 [port] [--workers=N] [--max-queue=BYTES]
+//              [--slow=drop|coalesce|disconnect]
+//              [--history=FRAMES] [--history-age=SECONDS]
+//              [--log=DIR] [--log-keep=SEGMENTS] [--log-segment-mb=MB]
+//              [--metrics=PORT] [--flush-us=MICROSECONDS]
+//              [--presence-ms=MS] [--flood=delay|drop|disconnect]
+//              [--msg-rate=N[:BURST]] [--byte-rate=N[:BURST]]
+//              [--addr-msg-rate=N[:BURST]] [--addr-byte-rate=N[:BURST]]
+//              [--heartbeat=SECONDS] [--heartbeat-timeout=SECONDS]
+//              [--hello-timeout=SECONDS] [--compress=deflate|off]
+//
+// typing a line sends it to everyone as [Server], like the gui's send box.
+//   /who              list who is connected
+//   /stats            throughput since the last /stats, latencies, drops
+//   /msg WHO text     just to one client (name or id), like "Send sel"
+//   /quit             stop the server (so does ctrl-c, or SIGTERM)
+// stdin closing (e.g. </dev/null in a container) just stops the typing
+// part, the server keeps going until a signal.
+
+#include "chat_server.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace {
+
+std::atomic<bool> g_quit(false);
+
+void OnSignal(int) {
+    g_quit = true;
+}
+
+// prints the room, and keeps a who's-online list for /who
+class ConsoleObserver : public ChatServerObserver {
+public:
+    void OnServerLog(const std::string& line) override {
+        std::printf("%s\n", line.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientJoined(int id, const std::string& name, const std::string& address) override {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_online[id] = name + " (" + address + ")";
+        }
+        std::printf("client in: %s (%s)\n", name.c_str(), address.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientLeft(int id, const std::string& name) override {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_online.erase(id);
+        }
+        std::printf("client out: %s\n", name.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientRenamed(int id, const std::string& oldName, const std::string& newName) override {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto entry = m_online.find(id);
+            if (entry != m_online.end()) {
+                // "name (address)", keep the address part
+                entry->second = newName + entry->second.substr(oldName.size());
+            }
+        }
+        std::printf("client %s is now %s\n", oldName.c_str(), newName.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientMessage(int, const std::string& name, const std::string& text) override {
+        std::printf("[%s] %s\n", name.c_str(), text.c_str());
+        std::fflush(stdout);
+    }
+    void OnClientMessages(const ObservedMessage* lines, size_t count) override {
+        for (size_t i = 0; i < count; i++) {
+            std::printf("[%s] %s\n", lines[i].name.c_str(), lines[i].text.c_str());
+        }
+        std::fflush(stdout);   // once a batch
+    }
+
+    // main thread
+    void PrintWho() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::printf("%zu online\n", m_online.size());
+        for (const auto& entry : m_online) {
+            std::printf("  %s\n", entry.second.c_str());
+        }
+        std::fflush(stdout);
+    }
+
+private:
+    std::mutex                 m_lock;     // observer runs on the workers
+    std::map<int, std::string> m_online;
+};
+
+// one typed line. false = time to stop. lastStats = what the previous
+// /stats saw (rates are per second since then)
+bool HandleLine(const std::string& line, ChatServer& server, ConsoleObserver& observer,
+                MetricsSnapshot& lastStats) {
+    if (line.empty()) {
+        return true;
+    }
+    if (line == "/quit") {
+        return false;
+    }
+    if (line == "/who") {
+        observer.PrintWho();
+        return true;
+    }
+    if (line == "/stats") {
+        MetricsSnapshot now = server.Metrics();
+        std::printf("%s\n", MetricsSummary(now, lastStats).c_str());
+        std::fflush(stdout);
+        lastStats = now;
+        return true;
+    }
+    if (line.compare(0, 5, "/msg ") == 0) {
+        size_t      space = line.find(' ', 5);
+        std::string who   = line.substr(5, space == std::string::npos ? std::string::npos : space - 5);
+        std::string text  = space == std::string::npos ? "" : line.substr(space + 1);
+        if (who.empty() || text.empty()) {
+            std::printf("usage: /msg NAME text (or /msg ID text)\n");
+        } else if (!server.SendDirect(who, text)) {
+            std::printf("nobody called %s is on\n", who.c_str());
+        } else {
+            std::printf("[Server -> %s] %s\n", who.c_str(), text.c_str());
+        }
+        std::fflush(stdout);
+        return true;
+    }
+    if (server.ClientCount() == 0) {
+        std::printf("no clients to send to.\n");
+        std::fflush(stdout);
+        return true;
+    }
+    server.Broadcast("[Server] " + line);
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ChatServerConfig config;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (ParseServerOption(arg, &config)) {
+            continue;
+        }
+        long p = std::strtol(arg, nullptr, 10);
+        if (p > 0 && p < 65536) {
+            config.port = static_cast<int>(p);
+        } else {
+            std::fprintf(stderr, "ignoring unknown arg %s\n", arg);
+        }
+    }
+
+    // plain signal() would restart the poll below, we want it to wake up
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    ConsoleObserver observer;
+    ChatServer      server(config, &observer);
+
+    std::string error;
+    if (!server.Start(&error)) {
+        std::fprintf(stderr, "ERR: %s\n", error.c_str());
+        return 1;
+    }
+
+    // the server runs on its own threads, this one just reads the keyboard
+    bool            haveStdin = true;
+    std::string     pending;
+    MetricsSnapshot lastStats = server.Metrics();
+    while (!g_quit) {
+        struct pollfd pfd;
+        pfd.fd      = STDIN_FILENO;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        // no stdin left: poll on nothing, only wakes for the timeout/signal
+        int ready = poll(&pfd, haveStdin ? 1 : 0, 200);
+        if (ready <= 0 || !(pfd.revents & (POLLIN | POLLHUP))) {
+            continue;
+        }
+
+        char    buf[1024];
+        ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if (n <= 0) {
+            haveStdin = false;
+            continue;
+        }
+        pending.append(buf, static_cast<size_t>(n));
+
+        size_t nl;
+        while ((nl = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, nl);
+            pending.erase(0, nl + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (!HandleLine(line, server, observer, lastStats)) {
+                g_quit = true;
+                break;
+            }
+        }
+    }
+
+    ChatServerStats stats = server.Stats();
+    server.Stop();
+
+    std::printf("slow consumers: %llu frames dropped, %llu coalesced, %llu clients kicked\n",
+                (unsigned long long)stats.framesDropped,
+                (unsigned long long)stats.framesCoalesced,
+                (unsigned long long)stats.slowDisconnects);
+    if (!config.logDir.empty()) {
+        std::printf("log: %llu frames written in %llu fsyncs\n",
+                    (unsigned long long)stats.logFrames,
+                    (unsigned long long)stats.logBatches);
+    }
+    return 0;
+}
@@ -3,63 +3,77 @@
 // user1 = host/server
 
 #include <wx/wx.h>        //this is the wx header file
-#include <wx/socket.h>    //sockets header
-#include <wx/listctrl.h>  // list for clients
+#include <wx/listctrl.h>  // list events
 #include <map> 
+#include <iterator>
+#include <mutex>
+#include <vector>
 
-// windows and linux have different net headers so we need both
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
-#else
-#include <arpa/inet.h>   
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#endif
+// the actual networking lives in the headless core (chat_server.cpp),
+// this window just watches it
+#include "chat_server.h"
+#include "chat_transcript_view.h"  // capped chat log, only draws visible rows
+#include "chat_roster_view.h"      // client list + ClientInfo
+
+// something the server threads want the window to know about. they only
+// queue these, the gui thread picks them up on its next tick
+struct UiEvent {
+    enum Kind { Log, Joined, Left, Renamed };
 
-// client info that is stored for every client connected
-struct ClientInfo {
-    wxSocketBase* socket;  //their socket
-    wxString      address; // they ip:port
-    wxString      name;    
-    int           id;      //#id
+    Kind       kind;
+    ClientInfo info;   // Joined/Left/Renamed (Left/Renamed only fill id + name)
+    wxString   text;   // Log
 };
+
 //class for the main chat window
-class ChatFrame : public wxFrame {
+class ChatFrame : public wxFrame, public ChatServerObserver {
 public:
     ChatFrame(const wxString& title, int port);
     ~ChatFrame();
 
+    // server observer. these come in on the server's worker threads (one
+    // at a time, the server serializes them). they never touch a widget,
+    // just drop a UiEvent in the queue and get back to the sockets
+    void OnServerLog(const std::string& line) override;
+    void OnClientJoined(int id, const std::string& name, const std::string& address) override;
+    void OnClientLeft(int id, const std::string& name) override;
+    void OnClientRenamed(int id, const std::string& oldName, const std::string& newName) override;
+    void OnClientMessage(int id, const std::string& name, const std::string& text) override;
+    void OnClientMessages(const ObservedMessage* lines, size_t count) override;
+
 private:
     // ui events handling 
     void OnQuit(wxCommandEvent& event);
     void OnAbout(wxCommandEvent& event);
     void OnSendMessage(wxCommandEvent& event);
-    void OnServerEvent(wxSocketEvent& event);   // new conn
-    void OnSocketEvent(wxSocketEvent& event);   // data / lost
     void OnClientSelected(wxListEvent& event);  // clicked in list
+    void OnUiTick(wxTimerEvent& event);         // drain m_uiEvents
     
     //helpers
-    void AcceptConnection();
-    void HandleSocketInput(wxSocketBase* sock);
-    void BroadcastMessage(const wxString& message);
-    void RemoveClient(wxSocketBase* sock);
     void LogMessage(const wxString& message);
+    void PostUiEvent(UiEvent&& event);
+    void UpdateClientCount();
+    void UpdateStats();   // the panel under the client list
     
 //these are the bits that show on screen
-    wxTextCtrl* m_chatDisplay;
+    TranscriptView* m_chatDisplay;
     wxTextCtrl* m_messageInput;
     wxButton*   m_sendButton;
     wxButton*   m_broadcastButton;
-    wxListCtrl* m_clientList;
+    RosterView* m_clientList;  // also the gui side copy of who is connected
+    wxStaticText* m_statsText; // live server numbers, see UpdateStats
     
 //this shows the state of the server when running
-    wxSocketServer*                   m_server;
-    std::map<wxSocketBase*, ClientInfo> m_clients;
-    int   m_nextClientId;
+    ChatServer*                 m_server;
     int   m_port;
+
+    // network -> gui handoff. a reconnect storm of hundreds of clients
+    // turns into one list update + one status update per tick
+    std::mutex            m_uiLock;
+    std::vector<UiEvent>  m_uiEvents;    // guarded by m_uiLock
+    wxTimer               m_uiTimer;
+    int                   m_statsTicks;   // ui ticks since the stats panel was redrawn
+    MetricsSnapshot       m_lastStats;    // what it showed last time (for rates)
     
     wxDECLARE_EVENT_TABLE();  
 };
@@ -71,9 +85,11 @@ enum {
     ID_Send,
     ID_Broadcast,
     ID_ClientList,
-    SOCKET_ID,
-    SERVER_ID
+    ID_UiTimer
 };
+
+static const int kUiTickMs = 50;   // how often queued server events hit the widgets
+static const int kStatsMs  = 1000; // and how often the stats panel is redrawn
   
 
 //event table for the chat frame documenting which events call which functions
@@ -82,16 +98,17 @@ wxBEGIN_EVENT_TABLE(ChatFrame, wxFrame)
      EVT_MENU(ID_About,     ChatFrame::OnAbout)
     EVT_BUTTON(ID_Send,    ChatFrame::OnSendMessage)
      EVT_BUTTON(ID_Broadcast, ChatFrame::OnSendMessage)
-    EVT_SOCKET(SERVER_ID,  ChatFrame::OnServerEvent)
-    EVT_SOCKET(SOCKET_ID,  ChatFrame::OnSocketEvent)
      EVT_LIST_ITEM_SELECTED(ID_ClientList, ChatFrame::OnClientSelected)
+    EVT_TIMER(ID_UiTimer,  ChatFrame::OnUiTick)
 wxEND_EVENT_TABLE()
    
    //the constructor for the chat frame to help set up the gui
 ChatFrame::ChatFrame(const wxString& title, int port)
     : wxFrame(nullptr, wxID_ANY, title, wxDefaultPosition, wxSize(800, 600)),
-      m_nextClientId(1),
-      m_port(port)
+      m_server(nullptr),
+      m_port(port),
+      m_uiTimer(this, ID_UiTimer),
+      m_statsTicks(0)
 {
     //menu on the guicd ch
     wxMenu* menuFile = new wxMenu;
@@ -116,30 +133,22 @@ ChatFrame::ChatFrame(const wxString& title, int port)
     wxStaticText* clientLabel = new wxStaticText(panel, wxID_ANY, "clients:");
     leftSizer->Add(clientLabel, 0, wxALL, 5);
     
-    m_clientList = new wxListCtrl(
-        panel,
-        ID_ClientList,
-        wxDefaultPosition,
-        wxSize(200, -1),
-        wxLC_REPORT | wxLC_SINGLE_SEL
-    );
-    m_clientList->AppendColumn("ID", wxLIST_FORMAT_LEFT, 50);
-    m_clientList->AppendColumn("Client", wxLIST_FORMAT_LEFT, 140);
+    m_clientList = new RosterView(panel, ID_ClientList, wxSize(200, -1));
     leftSizer->Add(m_clientList, 1, wxALL | wxEXPAND, 5);
+
+    // server numbers under the list (same text as user1's /stats)
+    wxStaticText* statsLabel = new wxStaticText(panel, wxID_ANY, "stats:");
+    leftSizer->Add(statsLabel, 0, wxLEFT | wxRIGHT, 5);
+    m_statsText = new wxStaticText(panel, wxID_ANY, "", wxDefaultPosition, wxSize(200, -1));
+    m_statsText->SetFont(wxFont(8, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+    leftSizer->Add(m_statsText, 0, wxALL | wxEXPAND, 5);
     
     mainSizer->Add(leftSizer, 0, wxEXPAND);
     
     // right: chat area
     wxBoxSizer* rightSizer = new wxBoxSizer(wxVERTICAL);
     
-    m_chatDisplay = new wxTextCtrl(
-        panel,
-        wxID_ANY,
-        "",
-        wxDefaultPosition,
-        wxDefaultSize,
-        wxTE_MULTILINE | wxTE_READONLY | wxTE_RICH
-    );
+    m_chatDisplay = new TranscriptView(panel, wxID_ANY);
     rightSizer->Add(m_chatDisplay, 1, wxALL | wxEXPAND, 5);
     
     //input to type messages 
@@ -166,35 +175,31 @@ ChatFrame::ChatFrame(const wxString& title, int port)
     
     panel->SetSizer(mainSizer);
     
-    // server socket setup
-    wxIPV4address addr;
-    addr.Service(port);
-    
-    m_server = new wxSocketServer(addr);
-    
-    if (!m_server->Ok()) {
-        LogMessage("ERR: cant open srv on port " + wxString::Format("%d", port));
+    m_uiTimer.Start(kUiTickMs);
+
+    // server setup, runs on its own thread from here on
+    ChatServerConfig config;
+    config.port = port;
+    m_server = new ChatServer(config, this);
+    
+    std::string error;
+    if (!m_server->Start(&error)) {
+        LogMessage("ERR: cant open srv on port " + wxString::Format("%d", port) +
+                   " - " + wxString::FromUTF8(error.c_str()));
         wxMessageBox("server failed. port busy?", "Error", wxICON_ERROR);
     } else {
-        LogMessage("server on port " + wxString::Format("%d", port));
-        LogMessage("waiting for clients...");
-        SetStatusText(wxString::Format("listening %d", port), 1);
-        
-        m_server->SetEventHandler(*this, SERVER_ID);
-        m_server->SetNotify(wxSOCKET_CONNECTION_FLAG);
-        m_server->Notify(true);
+        SetStatusText(wxString::Format("listening %d (%d workers)",
+                                       port, m_server->WorkerCount()), 1);
     }
 }
 
 ChatFrame::~ChatFrame() {
-    // drop clients
-    for (auto& pair : m_clients) {
-        pair.first->Destroy();
-    }
-    m_clients.clear();
-    
+    // stop the server threads before the widgets go away
+    m_uiTimer.Stop();
     if (m_server) {
-        m_server->Destroy();
+        m_server->Stop();
+        delete m_server;
+        m_server = nullptr;
     }
 }
 
@@ -218,160 +223,195 @@ void ChatFrame::OnSendMessage(wxCommandEvent& event) {
     }
 
     //this figures out if we are sending to selected client or all
-    if (m_clients.empty()) {
+    if (m_clientList->Count() == 0) {
         LogMessage("no clients to send to.");
+    } else if (event.GetId() == ID_Send) {
+        // private, straight to each selected client's socket
+        std::string text = std::string(message.ToUTF8());
+        bool        any  = false;
+        for (long row = m_clientList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+             row != -1;
+             row = m_clientList->GetNextItem(row, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) {
+            const ClientInfo& client = m_clientList->At(row);
+            if (m_server->SendDirect(client.id, text)) {
+                LogMessage("[Server -> " + client.name + "] " + message);
+            } else {
+                LogMessage(client.name + " is gone, not sent");
+            }
+            any = true;
+        }
+        if (!any) {
+            LogMessage("pick a client in the list first (or Send all)");
+            return;   // keep the text
+        }
     } else {
-        BroadcastMessage("[Server] " + message);
+        m_server->Broadcast(std::string(("[Server] " + message).ToUTF8()));
         LogMessage("[Server] " + message);
     }
     m_messageInput->Clear();
 }
-//accepts new client connections here
-void ChatFrame::OnServerEvent(wxSocketEvent& event) {
-    if (event.GetSocketEvent() == wxSOCKET_CONNECTION) {
-        AcceptConnection();
-    }
+
+// observer hooks -- worker threads -----------------------------------------
+void ChatFrame::OnServerLog(const std::string& line) {
+    UiEvent event;
+    event.kind = UiEvent::Log;
+    event.text = wxString::FromUTF8(line.c_str());
+    PostUiEvent(std::move(event));
 }
-// this is the socket event handler for client sockets
-void ChatFrame::OnSocketEvent(wxSocketEvent& event) {
-    wxSocketBase* sock = event.GetSocket();
-    
-    switch (event.GetSocketEvent()) {
-        case wxSOCKET_INPUT:
-            HandleSocketInput(sock);
-            break;
-            
-        case wxSOCKET_LOST:
-            RemoveClient(sock);
-            break;
-            
-        default:
-            break;
-    }
+
+void ChatFrame::OnClientJoined(int id, const std::string& name, const std::string& address) {
+    UiEvent event;
+    event.kind         = UiEvent::Joined;
+    event.info.address = wxString::FromUTF8(address.c_str());
+    event.info.name    = wxString::FromUTF8(name.c_str());
+    event.info.id      = id;
+    PostUiEvent(std::move(event));
 }
 
-void ChatFrame::OnClientSelected(wxListEvent& event) {
-    //this gets the selected client from the list and only logs it for now
-    long index = event.GetIndex();
-    LogMessage("sel: " + m_clientList->GetItemText(index, 1));
+void ChatFrame::OnClientLeft(int id, const std::string& name) {
+    UiEvent event;
+    event.kind      = UiEvent::Left;
+    event.info.name = wxString::FromUTF8(name.c_str());
+    event.info.id   = id;
+    PostUiEvent(std::move(event));
 }
 
-void ChatFrame::AcceptConnection() {
-    wxSocketBase* sock = m_server->Accept(false);
-    if (!sock) {
-        LogMessage("ERR: accept failed");
-        return;
+void ChatFrame::OnClientRenamed(int id, const std::string& oldName, const std::string& newName) {
+    UiEvent event;
+    event.kind      = UiEvent::Renamed;
+    event.info.name = wxString::FromUTF8(newName.c_str());
+    event.info.id   = id;
+    event.text      = wxString::FromUTF8(oldName.c_str());
+    PostUiEvent(std::move(event));
+}
+
+void ChatFrame::OnClientMessage(int WXUNUSED(id), const std::string& name, const std::string& text) {
+    UiEvent event;
+    event.kind = UiEvent::Log;
+    event.text = "[" + wxString::FromUTF8(name.c_str()) + "] " + wxString::FromUTF8(text.c_str());
+    PostUiEvent(std::move(event));
+}
+
+// a worker's whole pass in one go, one m_uiLock for all of it
+void ChatFrame::OnClientMessages(const ObservedMessage* lines, size_t count) {
+    std::vector<UiEvent> batch(count);
+    for (size_t i = 0; i < count; i++) {
+        batch[i].kind = UiEvent::Log;
+        batch[i].text = "[" + wxString::FromUTF8(lines[i].name.c_str()) + "] " +
+                        wxString::FromUTF8(lines[i].text.c_str());
     }
-    
-    //shows who connected
-    wxIPV4address addr;
-    sock->GetPeer(addr);
-    wxString clientAddr = addr.IPAddress() + ":" + wxString::Format("%d", addr.Service());
-    // right here stores in depth client info-------------------
-    ClientInfo info;
-    info.socket  = sock;
-    info.address = clientAddr;
-    info.name    = "User" + wxString::Format("%d", m_nextClientId);
-    info.id      = m_nextClientId++;
-    
-    m_clients[sock] = info;
-    
-    //adds client to the ui list=================
-    long index = m_clientList->InsertItem(
-        m_clientList->GetItemCount(),
-        wxString::Format("%d", info.id)
-    );
-    m_clientList->SetItem(index, 1, info.name);
-    
-    LogMessage("client in: " + info.name + " (" + clientAddr + ")");
-    SetStatusText(wxString::Format("%d client(s)", (int)m_clients.size()), 1);
-    
-    //these are the socket events that manage this client--- and not the server socket
-    sock->SetEventHandler(*this, SOCKET_ID);
-    sock->SetNotify(wxSOCKET_INPUT_FLAG | wxSOCKET_LOST_FLAG);
-    sock->Notify(true);
-    
-    //welcome message to the new client
-    wxString welcome = "Welcome, " + info.name + "\n";
-    sock->Write(welcome.mb_str(), welcome.length());
+    std::lock_guard<std::mutex> lock(m_uiLock);
+    m_uiEvents.insert(m_uiEvents.end(), std::make_move_iterator(batch.begin()),
+                      std::make_move_iterator(batch.end()));
 }
-// this handles incoming data from a client socket 
-void ChatFrame::HandleSocketInput(wxSocketBase* sock) {
-    auto it = m_clients.find(sock);
-    if (it == m_clients.end()) {
-        return;
+
+void ChatFrame::PostUiEvent(UiEvent&& event) {
+    // only ever held for a push_back or a swap
+    std::lock_guard<std::mutex> lock(m_uiLock);
+    m_uiEvents.push_back(std::move(event));
+}
+
+// gui thread ----------------------------------------------------------------
+void ChatFrame::OnUiTick(wxTimerEvent& WXUNUSED(event)) {
+    std::vector<UiEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(m_uiLock);
+        events.swap(m_uiEvents);
     }
-    //reads the incoming data
-    char buffer[1024];
-    sock->Read(buffer, sizeof(buffer) - 1);
-    wxUint32 len = sock->LastCount();
-    
-    if (len == 0) {
-        return;
+
+    if (++m_statsTicks * kUiTickMs >= kStatsMs) {
+        m_statsTicks = 0;
+        UpdateStats();
     }
-    
-    buffer[len] = '\0';
-    wxString message(buffer, wxConvUTF8, len);
-    message.Trim(true).Trim(false);
-    
-    if (message.IsEmpty()) {
+    if (events.empty()) {
         return;
     }
-    
-    // special handling for "Exit" to match project requirements
-    if (message == "Exit") {
-        LogMessage("[" + it->second.name + "] requested Exit");
-        
-        // send Exit back so client knows to shut down
-        wxString reply = "Exit\n";
-        sock->Write(reply.mb_str(), reply.length());
-        
-        // drop this client cleanly
-        RemoveClient(sock);
+
+    // fold the batch down first: someone who joined and left inside the
+    // same tick never makes it into the list at all
+    std::map<int, ClientInfo> joined;   // ids only go up, so this is join order
+    std::vector<int>          left;
+    std::map<int, wxString>   renamed;  // already in the list, new name
+    for (UiEvent& event : events) {
+        switch (event.kind) {
+            case UiEvent::Log:
+                LogMessage(event.text);
+                break;
+
+            case UiEvent::Joined:
+                joined[event.info.id] = event.info;
+                LogMessage("client in: " + event.info.name + " (" + event.info.address + ")");
+                break;
+
+            case UiEvent::Left:
+                renamed.erase(event.info.id);
+                if (joined.erase(event.info.id) == 0) {
+                    left.push_back(event.info.id);
+                }
+                LogMessage("client out: " + event.info.name);
+                break;
+
+            case UiEvent::Renamed: {
+                auto pending = joined.find(event.info.id);
+                if (pending != joined.end()) {
+                    pending->second.name = event.info.name;
+                } else {
+                    renamed[event.info.id] = event.info.name;
+                }
+                LogMessage("client " + event.text + " is now " + event.info.name);
+                break;
+            }
+        }
+    }
+
+    if (joined.empty() && left.empty() && renamed.empty()) {
         return;
     }
-    
-    // normal chat message: log and broadcast to everyone
-    LogMessage("[" + it->second.name + "] " + message);
-    BroadcastMessage("[" + it->second.name + "] " + message);
-}
 
-void ChatFrame::BroadcastMessage(const wxString& message) {
-    wxString msg = message + "\n";
-    
-    for (auto& pair : m_clients) {
-        pair.first->Write(msg.mb_str(), msg.length());
+    // O(1) each, and one repaint for the whole batch
+    for (int id : left) {
+        m_clientList->RemoveClient(id);
+    }
+    for (const auto& pair : joined) {
+        m_clientList->AddClient(pair.second);
     }
+    // no in-place edit in the view, take the row out and put it back
+    for (const auto& pair : renamed) {
+        const ClientInfo* row = m_clientList->Find(pair.first);
+        if (row) {
+            ClientInfo info = *row;
+            info.name       = pair.second;
+            m_clientList->RemoveClient(pair.first);
+            m_clientList->AddClient(info);
+        }
+    }
+    m_clientList->Sync();
+    UpdateClientCount();
 }
 
-void ChatFrame::RemoveClient(wxSocketBase* sock) {
-    auto it = m_clients.find(sock);
-    if (it == m_clients.end()) {
+void ChatFrame::OnClientSelected(wxListEvent& event) {
+    // "Send sel" goes to whoever is selected, this one and any others
+    long index = event.GetIndex();
+    LogMessage("sel: " + m_clientList->At(index).name);
+}
+
+void ChatFrame::UpdateStats() {
+    if (!m_server || !m_server->IsRunning()) {
         return;
     }
-    
-    wxString name = it->second.name;
-    int      id   = it->second.id;
-    
-    //drop from ui list
-    for (int i = 0; i < m_clientList->GetItemCount(); i++) {
-        wxString idStr = m_clientList->GetItemText(i, 0);
-        long itemId;
-        if (idStr.ToLong(&itemId) && itemId == id) {
-            m_clientList->DeleteItem(i);
-            break;
-        }
-    }
-    
-    sock->Destroy();
-    m_clients.erase(it);
-    
-    LogMessage("client out: " + name);
-    SetStatusText(wxString::Format("%d client(s)", (int)m_clients.size()), 1);
+    // a copy of the workers' counters, they never wait on us
+    MetricsSnapshot now = m_server->Metrics();
+    m_statsText->SetLabel(wxString::FromUTF8(MetricsSummary(now, m_lastStats).c_str()));
+    m_lastStats = now;
+}
+
+void ChatFrame::UpdateClientCount() {
+    SetStatusText(wxString::Format("%d client(s)", (int)m_clientList->Count()), 1);
 }
 
 void ChatFrame::LogMessage(const wxString& message) {
-    m_chatDisplay->AppendText(message + "\n");
+    // batched, drawn on the next frame
+    m_chatDisplay->AppendLine(message);
 }
 
 //app bootstrap
@@ -0,0 +1,432 @@
+// user2.cpp
+// user2 without the window: a chat client for the terminal.
+// talks the same protocol as chat_client_gui (it's the same ClientSession
+// underneath, so resume/outbox/backoff all behave the same), but needs no
+// wxWidgets, which is the point on a pi or in a container.
+//
+// usage: user2 [--plain] [host] [port]
+//
+// frames come deflated if the server offers it (less to push through a
+// weak wifi link for a bit of cpu), --plain says no thanks.
+//
+// whatever you type goes to the room you're talking in (/join NAME,
+// /leave, /rooms, see the README). "Exit" asks the server to let us go
+// (same as the gui), /quit just leaves, /who lists who is online (from
+// the presence updates, no round trip). stdin ending (a pipe running dry)
+// counts as Exit, so `echo hi | user2 host` sends hi and quits cleanly.
+// a dropped connection is retried forever with backoff, lines typed
+// meanwhile go out once we're back.
+
+#include "chat_net.h"
+#include "chat_session.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int kAttemptTimeoutMs = 3000;   // per address, then try the next one
+
+std::atomic<bool> g_quit(false);
+
+void OnSignal(int) {
+    g_quit = true;
+}
+
+int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               Clock::now().time_since_epoch()).count();
+}
+
+class ConsoleClient : public ClientSessionListener {
+public:
+    ConsoleClient(const std::string& host, const std::string& port, bool compress)
+        : m_host(host),
+          m_port(port),
+          m_session(this),
+          m_sock(CHAT_INVALID_SOCKET),
+          m_connecting(false),
+          m_nextTarget(0),
+          m_retryAt(Clock::now()),
+          m_haveStdin(true),
+          m_exitCode(0)
+    {
+        m_session.SetCompression(compress);
+    }
+
+    ~ConsoleClient() { CloseSocket(m_sock); }
+
+    int Run();
+
+    // session callbacks
+    void OnSessionText(FrameType, uint32_t, const std::string& text) override {
+        std::printf("%s\n", text.c_str());
+        std::fflush(stdout);
+    }
+    void OnSessionNotice(const std::string& line) override {
+        std::printf("* %s\n", line.c_str());
+        std::fflush(stdout);
+    }
+    void OnSessionExit() override {
+        // server let us go, we're done
+        m_session.End();
+    }
+
+private:
+    void StartConnect();
+    void TryNextTarget();
+    void OnConnectReady();
+    void OnReadable();
+    void Flush();
+    void Lose(const char* why);
+    void ScheduleRetry();
+    void ReadStdin();
+    void HandleLine(const std::string& line);
+    int  PollTimeoutMs() const;
+
+    std::string   m_host;
+    std::string   m_port;
+    ClientSession m_session;
+
+    socket_t                      m_sock;
+    bool                          m_connecting;        // m_sock not up yet
+    std::vector<sockaddr_storage> m_targets;           // from getaddrinfo
+    std::vector<socklen_t>        m_targetLens;
+    size_t                        m_nextTarget;
+    Clock::time_point             m_attemptDeadline;
+    Clock::time_point             m_retryAt;           // when to dial again
+
+    bool        m_haveStdin;
+    std::string m_typed;      // partial line from stdin
+    int         m_exitCode;
+};
+
+int ConsoleClient::Run() {
+    m_session.Begin();
+
+    while (!g_quit && m_session.Active()) {
+        if (m_sock == CHAT_INVALID_SOCKET && Clock::now() >= m_retryAt) {
+            StartConnect();
+        }
+        if (m_connecting && Clock::now() >= m_attemptDeadline) {
+            CloseSocket(m_sock);
+            m_sock = CHAT_INVALID_SOCKET;
+            TryNextTarget();
+        }
+
+        struct pollfd fds[2];
+        nfds_t        count    = 0;
+        int           stdinIdx = -1;
+        int           sockIdx  = -1;
+        if (m_haveStdin) {
+            fds[count].fd      = STDIN_FILENO;
+            fds[count].events  = POLLIN;
+            fds[count].revents = 0;
+            stdinIdx = static_cast<int>(count++);
+        }
+        if (m_sock != CHAT_INVALID_SOCKET) {
+            short events = POLLIN;
+            if (m_connecting) {
+                events = POLLOUT;              // writable = connect finished
+            } else if (!m_session.Output().empty()) {
+                events = POLLIN | POLLOUT;     // still have bytes to send
+            }
+            fds[count].fd      = m_sock;
+            fds[count].events  = events;
+            fds[count].revents = 0;
+            sockIdx = static_cast<int>(count++);
+        }
+
+        int ready = poll(fds, count, PollTimeoutMs());
+        if (m_sock != CHAT_INVALID_SOCKET && !m_connecting) {
+            // a server that lost power never closes the socket on us
+            if (!m_session.Tick(NowMs())) {
+                Lose("server stopped answering");
+            } else {
+                Flush();
+            }
+        }
+        if (ready <= 0) {
+            continue;   // timeout or a signal
+        }
+
+        if (stdinIdx >= 0 && (fds[stdinIdx].revents & (POLLIN | POLLHUP))) {
+            ReadStdin();
+        }
+        if (sockIdx >= 0 && m_sock != CHAT_INVALID_SOCKET && fds[sockIdx].revents) {
+            if (m_connecting) {
+                OnConnectReady();
+            } else {
+                if (fds[sockIdx].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    OnReadable();
+                }
+                if (m_sock != CHAT_INVALID_SOCKET) {
+                    Flush();
+                }
+            }
+        }
+    }
+
+    CloseSocket(m_sock);
+    m_sock = CHAT_INVALID_SOCKET;
+    return m_exitCode;
+}
+
+int ConsoleClient::PollTimeoutMs() const {
+    // wake up for the next dial or to give up on a slow address.
+    // capped so a signal never waits long
+    Clock::time_point next = Clock::now() + std::chrono::milliseconds(200);
+    if (m_sock == CHAT_INVALID_SOCKET) {
+        next = std::min(next, m_retryAt);
+    } else if (m_connecting) {
+        next = std::min(next, m_attemptDeadline);
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+    return ms > 0 ? static_cast<int>(ms) : 0;
+}
+
+// dns + first address. a slow resolver blocks the loop here, which is fine
+// for a terminal client (nothing to redraw)
+void ConsoleClient::StartConnect() {
+    std::printf("* connecting to %s:%s...\n", m_host.c_str(), m_port.c_str());
+    std::fflush(stdout);
+
+    m_targets.clear();
+    m_targetLens.clear();
+    m_nextTarget = 0;
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* list = nullptr;
+    int rc = getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &list);
+    if (rc != 0) {
+        std::printf("* cant resolve %s: %s\n", m_host.c_str(), gai_strerror(rc));
+        ScheduleRetry();
+        return;
+    }
+    for (struct addrinfo* ai = list; ai; ai = ai->ai_next) {
+        sockaddr_storage addr;
+        std::memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+        m_targets.push_back(addr);
+        m_targetLens.push_back(static_cast<socklen_t>(ai->ai_addrlen));
+    }
+    freeaddrinfo(list);
+
+    TryNextTarget();
+}
+
+void ConsoleClient::TryNextTarget() {
+    m_connecting = false;
+    while (m_nextTarget < m_targets.size()) {
+        const sockaddr_storage& addr = m_targets[m_nextTarget];
+        socklen_t               len  = m_targetLens[m_nextTarget];
+        m_nextTarget++;
+
+        socket_t sock = socket(addr.ss_family, SOCK_STREAM, 0);
+        if (sock == CHAT_INVALID_SOCKET) {
+            continue;
+        }
+        SetNonBlocking(sock);
+        if (connect(sock, reinterpret_cast<const sockaddr*>(&addr), len) != 0 &&
+            errno != EINPROGRESS) {
+            CloseSocket(sock);
+            continue;
+        }
+        // up now or later, poll tells us which (POLLOUT either way)
+        m_sock            = sock;
+        m_connecting      = true;
+        m_attemptDeadline = Clock::now() + std::chrono::milliseconds(kAttemptTimeoutMs);
+        return;
+    }
+
+    std::printf("* connect failed\n");
+    ScheduleRetry();
+}
+
+void ConsoleClient::OnConnectReady() {
+    int       err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(m_sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+        CloseSocket(m_sock);
+        m_sock = CHAT_INVALID_SOCKET;
+        TryNextTarget();
+        return;
+    }
+
+    m_connecting = false;
+    m_session.Connected();
+    std::printf("* connected to server (%s)\n", PeerAddress(m_sock).c_str());
+    std::fflush(stdout);
+}
+
+void ConsoleClient::OnReadable() {
+    // edge doesnt matter with poll, but draining here saves wakeups
+    for (;;) {
+        char*   dst = m_session.ReadPtr(4096);
+        ssize_t n   = recv(m_sock, dst, m_session.ReadSpace(), 0);
+        if (n > 0) {
+            m_session.Commit(static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && IsWouldBlock(SocketError())) {
+            break;
+        }
+        // 0 = server closed, <0 = reset. handle what we got first
+        m_session.Process();
+        Lose("connection lost :(");
+        return;
+    }
+
+    if (!m_session.Process()) {
+        std::printf("* bad data from server: %s\n", m_session.ErrorText().c_str());
+        m_exitCode = 1;
+        m_session.End();
+    }
+}
+
+void ConsoleClient::Flush() {
+    while (!m_session.Output().empty()) {
+        const std::string& out = m_session.Output();
+        ssize_t n = send(m_sock, out.data(), out.size(), CHAT_SEND_FLAGS);
+        if (n > 0) {
+            m_session.Consumed(static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && IsWouldBlock(SocketError())) {
+            return;   // poll will say when theres room
+        }
+        Lose("connection lost :(");
+        return;
+    }
+}
+
+void ConsoleClient::Lose(const char* why) {
+    CloseSocket(m_sock);
+    m_sock       = CHAT_INVALID_SOCKET;
+    m_connecting = false;
+    if (!m_session.Active()) {
+        return;   // we were on our way out anyway (Exit)
+    }
+    std::printf("* %s\n", why);
+    m_session.Lost();
+    ScheduleRetry();
+}
+
+void ConsoleClient::ScheduleRetry() {
+    uint32_t delay = m_session.RetryDelayMs();
+    std::printf("* retrying in %.1fs\n", delay / 1000.0);
+    std::fflush(stdout);
+    m_retryAt = Clock::now() + std::chrono::milliseconds(delay);
+}
+
+void ConsoleClient::ReadStdin() {
+    char    buf[1024];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n <= 0) {
+        // input is done: last partial line, then say bye properly so
+        // nothing still in the outbox gets lost
+        m_haveStdin = false;
+        if (!m_typed.empty()) {
+            HandleLine(m_typed);
+            m_typed.clear();
+        }
+        if (m_session.Active()) {
+            HandleLine("Exit");
+        }
+        return;
+    }
+    m_typed.append(buf, static_cast<size_t>(n));
+
+    size_t nl;
+    while ((nl = m_typed.find('\n')) != std::string::npos) {
+        std::string line = m_typed.substr(0, nl);
+        m_typed.erase(0, nl + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        HandleLine(line);
+    }
+}
+
+void ConsoleClient::HandleLine(const std::string& line) {
+    if (line.empty() || !m_session.Active()) {
+        return;
+    }
+    if (line == "/quit") {
+        m_session.End();
+        return;
+    }
+    if (line == "/who") {
+        const auto& roster = m_session.Roster();
+        std::printf("* %zu online:", roster.size());
+        for (const auto& who : roster) {
+            std::printf(" %s", who.second.c_str());
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+        return;
+    }
+
+    bool live = m_session.Live();
+    if (!m_session.Send(line)) {
+        std::printf("* (outbox full, oldest unsent message dropped)\n");
+    }
+    if (!live) {
+        std::printf("* (not connected, will send when back)\n");
+    }
+    std::fflush(stdout);
+    if (live && !m_connecting && m_sock != CHAT_INVALID_SOCKET) {
+        Flush();
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string host     = "127.0.0.1";
+    std::string port     = "8888";
+    bool        compress = true;
+    if (argc > 1 && std::strcmp(argv[1], "--plain") == 0) {
+        compress = false;
+        argc--;
+        argv++;
+    }
+    if (argc > 1) {
+        host = argv[1];
+    }
+    if (argc > 2) {
+        long p = std::strtol(argv[2], nullptr, 10);
+        if (p <= 0 || p > 65535) {
+            std::fprintf(stderr, "bad port (1-65535)\n");
+            return 1;
+        }
+        port = argv[2];
+    }
+
+    // sigaction without SA_RESTART so ctrl-c wakes the poll
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ConsoleClient client(host, port, compress);
+    return client.Run();
+}